@@ -11,6 +11,12 @@
 #include "Engine/Graphics/RHI/RHIDevice.hpp"
 #include "Engine/Debug/Log.hpp"
 #include "Engine/Async/Job.hpp"
+#include "Engine/Async/JobTimeline.hpp"
+#include "Engine/Memory/ScratchArena.hpp"
+#include "Engine/Memory/MemTrack.hpp"
+#include "Engine/Debug/Profile/Profiler.hpp"
+#include "Engine/Debug/Profile/Capture.hpp"
+#include "Engine/Debug/Profile/Overlay.hpp"
 
 bool Application::runFrame() {
   switch(mRunStatus) { 
@@ -65,6 +71,8 @@ void Application::_init() {
 
 void Application::_destroy() {
   onDestroy();
+  // the last frames, before the job system and the log go
+  Profile::stopCapture();
   Log::shutDown();
   Job::shutdown();
 
@@ -74,6 +82,11 @@ void Application::_destroy() {
 
 void Application::_update() {
   GetMainClock().beginFrame();
+  Job::markFrame();
+  ScratchArena::markFrame();
+  ScratchArena::safePoint();
+  Mem::markFrame();
+  Profile::markFrame();
   Input::Get().beforeFrame();
   ImGui::beginFrame();
 
@@ -92,6 +105,7 @@ void Application::_update() {
 
   onRender();
   onGui();
+  Profile::updateOverlay();
   Debug::drawNow();
   ImGui::render();
 
@@ -0,0 +1,38 @@
+﻿#include "EventCount.hpp"
+
+#define WIN32_LEAN_AND_MEAN		// Always #define this before #including <windows.h>
+#include <windows.h>
+#pragma comment(lib, "Synchronization.lib") // WaitOnAddress - Minimum supported OS Win 8
+
+static_assert(sizeof(std::atomic<u64>) == sizeof(u64), "the epoch is addressed in place");
+
+EventCount::key_t EventCount::prepareWait() {
+  u64 prev = mState.fetch_add(kAddWaiter, std::memory_order_seq_cst);
+  // pairs with the fence in notify(), the condition check after this cannot move above the waiter count
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  return key_t(prev >> kEpochShift);
+}
+
+void EventCount::cancelWait() {
+  mState.fetch_sub(kAddWaiter, std::memory_order_seq_cst);
+}
+
+void EventCount::wait(key_t key) {
+  while(key_t(mState.load(std::memory_order_acquire) >> kEpochShift) == key) {
+    WaitOnAddress(epochAddress(), &key, sizeof(key_t), INFINITE);
+  }
+  mState.fetch_sub(kAddWaiter, std::memory_order_seq_cst);
+}
+
+void EventCount::notify(bool all) {
+  // whatever made the condition true has to be visible before we look for waiters
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if((mState.load(std::memory_order_relaxed) & kWaiterMask) == 0) return;
+
+  mState.fetch_add(kAddEpoch, std::memory_order_acq_rel);
+  if(all) {
+    WakeByAddressAll((void*)epochAddress());
+  } else {
+    WakeByAddressSingle((void*)epochAddress());
+  }
+}
@@ -0,0 +1,42 @@
+﻿#pragma once
+#include "Engine/Core/common.hpp"
+#include <atomic>
+
+/**
+ * \brief parks threads until a condition changes, after Vyukov's event count (the same scheme as folly::EventCount).
+ *        waiter:
+ *          auto key = ec.prepareWait();
+ *          if(condition()) { ec.cancelWait(); } else { ec.wait(key); }
+ *        notifier: make condition() true, then notifyOne()/notifyAll().
+ *        A notification between prepareWait and wait is never lost, and notifying with nobody waiting costs a fence and a load.
+ *        Sleeps on WaitOnAddress, so blocked threads do not burn their core.
+ */
+class EventCount {
+public:
+  using key_t = uint32_t;
+
+  EventCount() = default;
+  EventCount(const EventCount&) = delete;
+  EventCount& operator=(const EventCount&) = delete;
+
+  key_t prepareWait();
+  void cancelWait();
+  void wait(key_t key);
+
+  void notifyOne() { notify(false); }
+  void notifyAll() { notify(true); }
+
+  uint waiterCount() const { return uint(mState.load(std::memory_order_relaxed) & kWaiterMask); }
+
+protected:
+  static constexpr u64 kWaiterMask = 0xffffffffull;
+  static constexpr u64 kAddWaiter = 1ull;
+  static constexpr u64 kEpochShift = 32;
+  static constexpr u64 kAddEpoch = 1ull << kEpochShift;
+
+  void notify(bool all);
+  // the high half of mState, what WaitOnAddress sleeps on
+  volatile key_t* epochAddress() { return reinterpret_cast<volatile key_t*>(&mState) + 1; }
+
+  std::atomic<u64> mState = 0; // [epoch: 32][waiter count: 32]
+};
@@ -2,182 +2,1034 @@
 #include <mutex>
 #include "Thread.hpp"
 #include "Engine/Memory/Pool.hpp"
+#include "Engine/Memory/MemTrack.hpp"
+#include "Engine/Memory/ScratchArena.hpp"
 #include <queue>
 #include "Engine/Core/Time/Clock.hpp"
+#include "Engine/Async/WorkStealingQueue.hpp"
+#include "Engine/Async/Parallel.hpp"
+#include "Engine/Async/EventCount.hpp"
+#include "Engine/Async/JobTimeline.hpp"
+#include "Engine/Debug/Console/Command.hpp"
+#include "Engine/Debug/Console/Console.hpp"
+#include "Engine/Debug/Log.hpp"
+#include "Engine/Debug/Profile/Profiler.hpp"
+#include "Engine/Persistence/xml.hpp"
+#include <thread>
+
+#define WIN32_LEAN_AND_MEAN		// Always #define this before #including <windows.h>
+#include <windows.h>
 using namespace Job;
 
+/*
+ * category injection queue, takes jobs issued from threads which are not workers of the category.
+ * one fifo per priority, all behind the same lock.
+ */
 class JobQueue {
 public:
   JobQueue() = default;
   JobQueue(const JobQueue& q)
-	  : mCategory(q.mCategory) {}
-  S<Counter> enqueue(const S<Counter>& counter);
-  S<Counter> dequeue();
+	  : idlePolicy(q.idlePolicy), mCategory(q.mCategory) {}
+  void enqueue(Counter* counter);
+  Counter* dequeue(ePriority priority);
   void category(category_t cat) { mCategory = cat; }
+  bool empty() const;
+  bool empty(ePriority priority) const { return depth(priority) == 0; }
+  uint depth(ePriority priority) const { return mSize[priority].load(std::memory_order_relaxed); }
+
+  // idle workers of the category park here, notified for every job issued to the category
+  EventCount idleEvent;
+  idle_policy_t idlePolicy;
 
-  auto clear();
+  // claim stats of each priority, from every worker of the category
+  struct lane_stats_t {
+    std::atomic<u64> executed = 0;
+    std::atomic<u64> waitHpc = 0;
+    std::atomic<u64> maxWaitHpc = 0;
+    std::atomic<u64> deadlineMisses = 0;
+  };
+  lane_stats_t stats[NUM_PRIORITY];
 
 protected:
   category_t mCategory;
-  std::queue<S<Counter>> mCounters;
+  std::queue<Counter*> mCounters[NUM_PRIORITY];
   std::mutex mLock;
+  std::atomic<uint> mSize[NUM_PRIORITY] = {}; // readable without the lock
+};
+
+/*
+ * every job on a worker runs on a fiber owned by the worker. When a job waits, its fiber is parked and the worker switches
+ * to an idle fiber to keep running jobs; a resume job chained after the awaited counter hands the parked fiber back.
+ * Fibers never move to another thread, so thread locals stay valid across a wait.
+ */
+struct JobWorker {
+  static constexpr size_t kFiberStackCommit = 64 KB;
+  static constexpr size_t kFiberStackReserve = 1024 KB;
+
+  enum eSwitchAction {
+    SWITCH_NONE,
+    SWITCH_RECYCLE, // the fiber switched away from goes back to the idle list
+    SWITCH_SUSPEND, // the fiber switched away from waits for `awaited`
+  };
+
+  struct fiber_switch_t {
+    eSwitchAction action = SWITCH_NONE;
+    void* fiber = nullptr;
+    Counter* awaited = nullptr;
+  };
+
+  void* acquireFiber();
+  void switchTo(void* fiber, eSwitchAction action, Counter* awaited = nullptr);
+  void completeSwitch();
+  void resume(void* fiber);
+  void* popReadyFiber();
+  bool hasLocalWork() const;
+
+  JobCenter* center = nullptr;
+  category_t category = CAT_GENERIC;
+  uint index = 0;            // index in the category worker list
+  uint stealSeed = 0;
+  WorkStealingQueue<Counter*> local[NUM_PRIORITY];
+  uint agingCredit[NUM_PRIORITY] = {}; // times a waiting priority got passed over by a higher one
+  int processor = -1;        // pinned logical processor, -1 to let the os schedule the thread
+
+  // fibers, only touched by the worker thread except the ready list
+  void* threadFiber = nullptr;
+  std::vector<void*> fibers;
+  std::vector<void*> idleFibers;
+  fiber_switch_t pendingSwitch;
+  mutable std::mutex readyLock;
+  std::vector<void*> readyFibers; // resumed fibers, pushed by whoever runs the resume job
+
+  // idle stats, written by the worker, read by anyone
+  std::atomic<u64> parkStartHpc = 0; // 0 when not parked
+  std::atomic<u64> wakeups = 0;
+  std::atomic<u64> emptyWakeups = 0;
+  std::atomic<u64> parkedHpc = 0;
 };
 
 class JobCenter {
+  friend struct JobWorker;
 public:
 
   ~JobCenter();
-  S<Counter> claimJob(category_t category);
-  S<Counter> createJob(const S<Decl>& decl, category_t cat);
-  S<Counter> issueJob(const S<Counter>& counter);
-  S<Counter> issueJob(const S<Decl>& decl, category_t cat);
+  Counter* claimJob(category_t category);
+  counter_ref_t createJob(Decl&& decl, category_t cat);
+  void issueJob(Counter* counter);
+  counter_ref_t issueJob(Decl&& decl, category_t cat);
   void shutdown();
   void startup(uint categoryCount);
+  void startup(uint categoryCount, const pool_config_t& config);
+  void startup(uint categoryCount, span<const uint> workerCountPerCategory);
   bool opening() const { return mIsOpening; }
+  uint workerCount(category_t category) const;
+  bool starving(category_t category) const;
+  void setIdlePolicy(category_t category, const idle_policy_t& policy);
+  idle_stats_t idleStats(category_t category) const;
+  queue_stats_t queueStats(category_t category, ePriority priority) const;
+  void resetQueueStats();
+
+  // when disabled, every job goes through the category injection queue, which is how the job system used to work.
+  void useWorkStealing(bool enabled) { mUseWorkStealing = enabled; }
+
+  static void execute(Counter* counter);
+  static void discard(Counter* counter);
 
 protected:
+  Counter* claimJob(category_t category, ePriority priority, JobWorker* ownWorker);
+  Counter* steal(category_t category, ePriority priority, uint seed);
+  void recordClaim(Counter* counter);
+  void createWorkers(uint categoryCount, span<const uint> workerCountPerCategory);
+  void pinWorkers(bool reserveCallerCore);
+  void launchWorkers();
+  static void systemThreadEntry(JobWorker* worker);
+  static void WINAPI workerFiberEntry(void* param);
+  void workerLoop(JobWorker& worker);
+  bool runOne(JobWorker& worker);
+  bool hasWork(const JobWorker& worker) const;
+  void park(JobWorker& worker);
+
   std::vector<JobQueue> mQueues;
+  std::vector<std::vector<JobWorker*>> mWorkers; // per category
+  std::vector<U<JobWorker>> mWorkerStorage;
   std::vector<Thread> mSystemJobThreads;
-  static void systemThreadEntry(category_t category);
-  bool mIsOpening = false;
+  std::atomic<bool> mIsOpening = false;
+  bool mUseWorkStealing = true;
+};
+
+
+/*
+ * fixed size block pool backing counters and their blockee overflow blocks.
+ * every thread keeps a small free list; once it grows past two batches, one batch is handed back to the shared list,
+ * so blocks freed on workers flow back to the thread dispatching the jobs.
+ */
+class CounterPool {
+public:
+  static constexpr size_t kBlockSize = align_to(64, sizeof(Counter));
+  static constexpr size_t kChunkSize = 64 KB;
+  static constexpr uint   kBatchSize = 32;
+
+  ~CounterPool();
+  void* alloc();
+  void  free(void* ptr);
+  mem_stats_t stats() const;
+
+protected:
+  struct block_t {
+    block_t* next;
+  };
+
+  struct batch_t {
+    block_t* head = nullptr;
+    uint count = 0;
+  };
+
+  struct cache_t: batch_t {
+    ~cache_t();
+  };
+
+  void refill(cache_t& cache);
+
+  static thread_local cache_t sCache;
+
+  std::mutex mLock;
+  std::vector<batch_t> mBatches; // block lists handed back by threads
+  std::vector<void*> mChunks;
+  std::atomic<size_t> mReservedBytes = 0;
+  std::atomic<size_t> mLiveBlocks = 0;
+  std::atomic<u64> mTotalCounters = 0;
+
+  friend class Job::Counter;
 };
 
+static CounterPool gCounterPool;
+thread_local CounterPool::cache_t CounterPool::sCache;
+
+struct Counter::blockee_block_t {
+  static constexpr uint kCapacity = uint((CounterPool::kBlockSize - sizeof(void*)) / sizeof(Counter*));
+  Counter* blockees[kCapacity];
+  blockee_block_t* next = nullptr;
+};
 
 static JobCenter gJobCenter;
 thread_local Counter* gCurrentJob = nullptr;
+thread_local JobWorker* gCurrentWorker = nullptr;
 
+// jobs issued from a worker go to the center owns the worker
+static JobCenter& activeCenter() {
+  return gCurrentWorker == nullptr ? gJobCenter : *gCurrentWorker->center;
+}
 
+static const char* kCategoryThreadName[NUM_CATEGORY] = {
+  "Job Generic",
+  "Job GenericSlow",
+  "Job MainThread",
+  "Job IO",
+};
 
+static const char* kCategoryName[NUM_CATEGORY] = {
+  "Generic",
+  "GenericSlow",
+  "MainThread",
+  "IO",
+};
 
+static const pool_config_t kDefaultPoolConfig;
 
 
 
 
+void JobCenter::startup(uint categoryCount) {
+  startup(categoryCount, kDefaultPoolConfig);
+}
 
+void JobCenter::startup(uint categoryCount, const pool_config_t& config) {
+  pool_config_t resolved = config.resolved();
+  uint configuredCount = std::min<uint>(categoryCount, NUM_CATEGORY);
 
-void JobCenter::startup(uint categoryCount) {
+  createWorkers(categoryCount, span<const uint>(resolved.workerCount, configuredCount));
+  for(uint i = 0; i < configuredCount; i++) {
+    mQueues[i].idlePolicy = resolved.idlePolicy[i];
+  }
+  if(resolved.pinWorkers) {
+    pinWorkers(resolved.reserveMainThreadCore);
+  }
+
+  for(uint i = 0; i < configuredCount; i++) {
+    std::string processors;
+    for(JobWorker* worker: mWorkers[i]) {
+      processors += worker->processor < 0 ? " -" : Stringf(" %d", worker->processor);
+    }
+    Log::logf("[job] %-12s %2u workers, processors:%s", kCategoryName[i], (uint)mWorkers[i].size(), processors.c_str());
+  }
+
+  launchWorkers();
+}
+
+void JobCenter::startup(uint categoryCount, span<const uint> workerCountPerCategory) {
+  createWorkers(categoryCount, workerCountPerCategory);
+  launchWorkers();
+}
+
+void JobCenter::createWorkers(uint categoryCount, span<const uint> workerCountPerCategory) {
   mIsOpening = true;
 
   mQueues.resize(categoryCount);
+  mWorkers.resize(categoryCount);
   for(uint i = 0; i < categoryCount; i++) {
     // create job queues
     JobQueue& q = mQueues[i];
     q.category((category_t)i);
+    if(i < NUM_CATEGORY) q.idlePolicy = kDefaultPoolConfig.idlePolicy[i];
   }
 
-  // create job threads
-  mSystemJobThreads.emplace_back("Job Generic", systemThreadEntry, CAT_GENERIC);
-  mSystemJobThreads.emplace_back("Job Generic", systemThreadEntry, CAT_GENERIC);
-  mSystemJobThreads.emplace_back("Job Generic", systemThreadEntry, CAT_GENERIC);
-  mSystemJobThreads.emplace_back("Job GenericSlow", systemThreadEntry, CAT_GENERIC_SLOW);
-  mSystemJobThreads.emplace_back("Job GenericSlow", systemThreadEntry, CAT_GENERIC_SLOW);
-  mSystemJobThreads.emplace_back("Job IO", systemThreadEntry, CAT_IO);
+  // create workers first, threads may start stealing from siblings right after launch
+  for(uint cat = 0; cat < (uint)workerCountPerCategory.size() && cat < categoryCount; cat++) {
+    for(uint i = 0; i < workerCountPerCategory[cat]; i++) {
+      JobWorker* worker = mWorkerStorage.emplace_back(std::make_unique<JobWorker>()).get();
+      worker->center = this;
+      worker->category = (category_t)cat;
+      worker->index = i;
+      worker->stealSeed = (uint)mWorkerStorage.size() * 2654435761u;
+      mWorkers[cat].push_back(worker);
+    }
+  }
 }
 
+void JobCenter::pinWorkers(bool reserveCallerCore) {
+  cpu_topology_t topology = queryCpuTopology();
 
-void JobCenter::systemThreadEntry(category_t category) {
-  Consumer consumer;
-  category_t categories[1] = { category };
-  consumer.init(categories);
-  while(running()) {
-    consumer.consumeAll();
-    CurrentThread::yield();
+  // keep the caller on its physical core, and nobody else
+  u64 reserved = 0;
+  if(reserveCallerCore) {
+    uint callerProcessor = CurrentThread::processor();
+    for(const std::vector<uint>& core: topology.cores) {
+      if(std::find(core.begin(), core.end(), callerProcessor) == core.end()) continue;
+      for(uint processor: core) {
+        reserved |= 1ull << processor;
+      }
+      CurrentThread::setAffinity(reserved);
+      break;
+    }
+  }
+
+  // first logical processor of every physical core, then the second ones, so hyper-threads are only shared when cores run out
+  std::vector<uint> order;
+  for(uint round = 0;; round++) {
+    bool anyLeft = false;
+    for(const std::vector<uint>& core: topology.cores) {
+      if(round >= core.size()) continue;
+      anyLeft = true;
+      if((reserved & (1ull << core[round])) == 0) order.push_back(core[round]);
+    }
+    if(!anyLeft) break;
+  }
+
+  // not a single processor left, let the os deal with it
+  if(order.empty()) return;
+
+  // workers are stored generic first, so the busiest category gets the physical cores
+  uint next = 0;
+  for(U<JobWorker>& worker: mWorkerStorage) {
+    worker->processor = (int)order[next++ % order.size()];
+  }
+}
+
+void JobCenter::launchWorkers() {
+  for(U<JobWorker>& worker: mWorkerStorage) {
+    const char* name = worker->category < NUM_CATEGORY ? kCategoryThreadName[worker->category] : "Job";
+    mSystemJobThreads.emplace_back(name, systemThreadEntry, worker.get());
+  }
+}
+
+
+void JobCenter::systemThreadEntry(JobWorker* worker) {
+  gCurrentWorker = worker;
+  if(worker->category < NUM_CATEGORY) {
+    std::string name = Stringf("%s %u", kCategoryName[worker->category], worker->index);
+    nameTimelineLane(name.c_str(), int(worker->category + 1) * 256 + (int)worker->index);
+    CurrentThread::setName(name.c_str());
+  }
+  if(worker->processor >= 0) {
+    CurrentThread::setAffinity(1ull << worker->processor);
+  }
+  worker->threadFiber = ConvertThreadToFiber(nullptr);
+  ENSURES(worker->threadFiber != nullptr);
+
+  // the thread fiber only gets control back when the center is closing
+  SwitchToFiber(worker->acquireFiber());
+
+  // jobs still parked in a wait are dropped with their fibers, their stacks are not unwound
+  for(void* fiber: worker->fibers) {
+    DeleteFiber(fiber);
+  }
+  worker->fibers.clear();
+  worker->idleFibers.clear();
+  worker->readyFibers.clear();
+  ConvertFiberToThread();
+  worker->threadFiber = nullptr;
+  gCurrentWorker = nullptr;
+}
+
+void WINAPI JobCenter::workerFiberEntry(void* param) {
+  JobWorker* worker = (JobWorker*)param;
+  worker->completeSwitch();
+  worker->center->workerLoop(*worker);
+  SwitchToFiber(worker->threadFiber);
+}
+
+void JobCenter::workerLoop(JobWorker& worker) {
+  uint idleRound = 0;
+  while(opening()) {
+    // between two jobs, and with no job parked on this thread none of them holds scratch memory
+    if(worker.fibers.size() == worker.idleFibers.size() + 1) ScratchArena::safePoint();
+
+    if(runOne(worker)) {
+      idleRound = 0;
+      continue;
+    }
+
+    const idle_policy_t& policy = mQueues[worker.category].idlePolicy;
+    if(idleRound < policy.spinCount) {
+      YieldProcessor();
+    } else if(idleRound < policy.spinCount + policy.yieldCount || !policy.park) {
+      CurrentThread::yield();
+    } else {
+      park(worker);
+      idleRound = 0;
+      continue;
+    }
+    ++idleRound;
+  }
+}
+
+bool JobCenter::runOne(JobWorker& worker) {
+  // resumed jobs go first, they may be holding up others
+  void* ready = worker.popReadyFiber();
+  if(ready != nullptr) {
+    worker.switchTo(ready, JobWorker::SWITCH_RECYCLE);
+    return true;
+  }
+
+  Counter* counter = claimJob(worker.category);
+  if(counter == nullptr) return false;
+  execute(counter);
+  return true;
+}
+
+bool JobCenter::hasWork(const JobWorker& worker) const {
+  if(worker.hasLocalWork() || !mQueues[worker.category].empty()) return true;
+
+  for(JobWorker* sibling: mWorkers[worker.category]) {
+    if(sibling->hasLocalWork()) return true;
+  }
+
+  std::scoped_lock lock(worker.readyLock);
+  return !worker.readyFibers.empty();
+}
+
+void JobCenter::park(JobWorker& worker) {
+  EventCount& event = mQueues[worker.category].idleEvent;
+  EventCount::key_t key = event.prepareWait();
+
+  // look again after announcing the wait, a job issued before that would not wake us
+  if(!opening() || hasWork(worker)) {
+    event.cancelWait();
+    return;
+  }
+
+  u64 start = GetPerformanceCounter();
+  worker.parkStartHpc.store(start, std::memory_order_relaxed);
+  event.wait(key);
+  worker.parkedHpc.fetch_add(GetPerformanceCounter() - start, std::memory_order_relaxed);
+  worker.parkStartHpc.store(0, std::memory_order_relaxed);
+
+  worker.wakeups.fetch_add(1, std::memory_order_relaxed);
+  if(opening() && !hasWork(worker)) {
+    worker.emptyWakeups.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void JobCenter::setIdlePolicy(category_t category, const idle_policy_t& policy) {
+  EXPECTS(category < mQueues.size());
+  mQueues[category].idlePolicy = policy;
+  // parked workers pick up the new policy when they wake
+  mQueues[category].idleEvent.notifyAll();
+}
+
+idle_stats_t JobCenter::idleStats(category_t category) const {
+  idle_stats_t stats;
+  if(category >= mWorkers.size()) return stats;
+
+  u64 now = GetPerformanceCounter();
+  u64 parkedHpc = 0;
+  for(JobWorker* worker: mWorkers[category]) {
+    stats.workerCount++;
+    // count the ongoing park as well, so a worker asleep for long does not look busy
+    u64 parkStart = worker->parkStartHpc.load(std::memory_order_relaxed);
+    if(parkStart != 0) {
+      stats.parkedWorkers++;
+      parkedHpc += now > parkStart ? now - parkStart : 0;
+    }
+    stats.wakeups += worker->wakeups.load(std::memory_order_relaxed);
+    stats.emptyWakeups += worker->emptyWakeups.load(std::memory_order_relaxed);
+    parkedHpc += worker->parkedHpc.load(std::memory_order_relaxed);
+  }
+  stats.parkedSeconds = PerformanceCountToSecond(parkedHpc);
+  return stats;
+}
+
+queue_stats_t JobCenter::queueStats(category_t category, ePriority priority) const {
+  queue_stats_t stats;
+  if(category >= mQueues.size() || priority >= NUM_PRIORITY) return stats;
+
+  const JobQueue& queue = mQueues[category];
+  stats.depth = queue.depth(priority);
+  for(JobWorker* worker: mWorkers[category]) {
+    stats.depth += (uint)worker->local[priority].sizeApprox();
+  }
+
+  const JobQueue::lane_stats_t& lane = queue.stats[priority];
+  stats.executed = lane.executed.load(std::memory_order_relaxed);
+  stats.deadlineMisses = lane.deadlineMisses.load(std::memory_order_relaxed);
+  stats.maxWaitSeconds = PerformanceCountToSecond(lane.maxWaitHpc.load(std::memory_order_relaxed));
+  if(stats.executed > 0) {
+    stats.waitSeconds = PerformanceCountToSecond(lane.waitHpc.load(std::memory_order_relaxed)) / double(stats.executed);
+  }
+  return stats;
+}
+
+void JobCenter::resetQueueStats() {
+  for(JobQueue& queue: mQueues) {
+    for(JobQueue::lane_stats_t& lane: queue.stats) {
+      lane.executed.store(0, std::memory_order_relaxed);
+      lane.waitHpc.store(0, std::memory_order_relaxed);
+      lane.maxWaitHpc.store(0, std::memory_order_relaxed);
+      lane.deadlineMisses.store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+void* JobWorker::acquireFiber() {
+  if(!idleFibers.empty()) {
+    void* fiber = idleFibers.back();
+    idleFibers.pop_back();
+    return fiber;
+  }
+
+  void* fiber = CreateFiberEx(kFiberStackCommit, kFiberStackReserve, 0, &JobCenter::workerFiberEntry, this);
+  ENSURES(fiber != nullptr);
+  fibers.push_back(fiber);
+  return fiber;
+}
+
+void JobWorker::switchTo(void* fiber, eSwitchAction action, Counter* awaited) {
+  // other jobs take the thread meanwhile, the profiled scopes of this one must not enclose theirs
+  Profile::open_scopes_t scopes = Profile::suspendScopes();
+  pendingSwitch = { action, GetCurrentFiber(), awaited };
+  SwitchToFiber(fiber);
+  // someone switched back to this fiber
+  completeSwitch();
+  Profile::resumeScopes(scopes);
+}
+
+void JobWorker::completeSwitch() {
+  fiber_switch_t pending = pendingSwitch;
+  pendingSwitch = {};
+
+  switch(pending.action) {
+    case SWITCH_RECYCLE:
+      idleFibers.push_back(pending.fiber);
+    break;
+    case SWITCH_SUSPEND: {
+      // the waiting fiber is off the cpu now, it is safe to let other threads resume it
+      void* fiber = pending.fiber;
+      // a parked fiber holds up its whole job chain, get it back before anything else
+      Decl resumeDecl([this, fiber] { resume(fiber); });
+      resumeDecl.priority(PRIORITY_HIGH);
+      counter_ref_t resumeJob = Counter::create(std::move(resumeDecl), category);
+      if(pending.awaited->addBlockee(resumeJob)) {
+        Job::dispatch(resumeJob);
+      } else {
+        resume(fiber);
+      }
+    } break;
+    case SWITCH_NONE:
+    break;
+  }
+}
+
+void JobWorker::resume(void* fiber) {
+  {
+    std::scoped_lock lock(readyLock);
+    readyFibers.push_back(fiber);
+  }
+  // the owner may be parked, and there is no way to wake one specific worker
+  center->mQueues[category].idleEvent.notifyAll();
+}
+
+void* JobWorker::popReadyFiber() {
+  std::scoped_lock lock(readyLock);
+  if(readyFibers.empty()) return nullptr;
+  void* fiber = readyFibers.back();
+  readyFibers.pop_back();
+  return fiber;
+}
+
+bool JobWorker::hasLocalWork() const {
+  for(const WorkStealingQueue<Counter*>& queue: local) {
+    if(!queue.empty()) return true;
   }
+  return false;
 }
 
-S<Counter> JobQueue::enqueue(const S<Counter>& counter) {
+void JobQueue::enqueue(Counter* counter) {
+  ePriority priority = counter->priority();
   std::scoped_lock lock(mLock);
-  mCounters.push(counter);
-  return counter;
+  mCounters[priority].push(counter);
+  mSize[priority].store((uint)mCounters[priority].size(), std::memory_order_relaxed);
 }
 
-S<Counter> JobQueue::dequeue() {
+Counter* JobQueue::dequeue(ePriority priority) {
+  // idle workers poll this a lot, do not fight over the lock for nothing
+  if(empty(priority)) return nullptr;
   std::scoped_lock lock(mLock);
-  if(mCounters.size() == 0) return nullptr;
-  S<Counter> counter = mCounters.front();
-  mCounters.pop();
+  std::queue<Counter*>& counters = mCounters[priority];
+  if(counters.size() == 0) return nullptr;
+  Counter* counter = counters.front();
+  counters.pop();
+  mSize[priority].store((uint)counters.size(), std::memory_order_relaxed);
   return counter;
 }
 
-auto JobQueue::clear() {
-  std::scoped_lock lock(mLock);
-  while(!mCounters.empty()) {
-    S<Counter>& counter = mCounters.front();
-    counter->terminate();
-    mCounters.pop();
+bool JobQueue::empty() const {
+  for(uint i = 0; i < NUM_PRIORITY; i++) {
+    if(!empty(ePriority(i))) return false;
   }
+  return true;
 }
 
 JobCenter::~JobCenter() {
-  for(Thread& t: mSystemJobThreads) {
-    t.join();
+  if(mIsOpening) shutdown();
+}
+
+counter_ref_t JobCenter::issueJob(Decl&& decl, category_t cat) {
+  counter_ref_t counter = createJob(std::move(decl), cat);
+  uint dispatchCounter = counter->decrementCounter();
+  EXPECTS(dispatchCounter == 0);
+  issueJob(counter.get());
+  return counter;
+}
+
+// how many times a waiting priority lets a higher one go first before it gets a turn
+static constexpr uint kAgingCredit[NUM_PRIORITY] = { 0, 8, 32 };
+
+Counter* JobCenter::claimJob(category_t category) {
+  JobWorker* worker = gCurrentWorker;
+  bool isOwnWorker = worker != nullptr && worker->center == this && worker->category == category;
+  JobWorker* ownWorker = isOwnWorker ? worker : nullptr;
+
+  // a priority passed over often enough goes first, once
+  int aged = -1;
+  if(isOwnWorker) {
+    for(uint i = NUM_PRIORITY - 1; i > PRIORITY_HIGH; i--) {
+      if(worker->agingCredit[i] >= kAgingCredit[i]) {
+        worker->agingCredit[i] = 0;
+        aged = (int)i;
+        break;
+      }
+    }
+  }
+
+  Counter* counter = aged >= 0 ? claimJob(category, ePriority(aged), ownWorker) : nullptr;
+  for(uint i = 0; counter == nullptr && i < NUM_PRIORITY; i++) {
+    if((int)i == aged) continue;
+    counter = claimJob(category, ePriority(i), ownWorker);
+  }
+  if(counter == nullptr) return nullptr;
+
+  if(isOwnWorker) {
+    for(uint i = counter->priority() + 1; i < NUM_PRIORITY; i++) {
+      if(!worker->local[i].empty() || !mQueues[category].empty(ePriority(i))) {
+        worker->agingCredit[i]++;
+      }
+    }
+  }
+
+  recordClaim(counter);
+  return counter;
+}
+
+Counter* JobCenter::claimJob(category_t category, ePriority priority, JobWorker* ownWorker) {
+  if(ownWorker != nullptr) {
+    Counter* counter = ownWorker->local[priority].pop();
+    if(counter != nullptr) return counter;
   }
+
+  Counter* counter = mQueues[category].dequeue(priority);
+  if(counter != nullptr) return counter;
+
+  uint seed = ownWorker != nullptr ? ownWorker->stealSeed++ : (uint)(uintptr_t)&seed;
+  return steal(category, priority, seed);
 }
 
-S<Counter> JobCenter::issueJob(const S<Decl>& decl, category_t cat) {
-  S<Counter> counter = createJob(decl, cat);
-  counter->decrementCounter();
-  EXPECTS(counter->counter() == 0);
-  JobQueue& q = mQueues[cat];
-  return q.enqueue(counter);
+void JobCenter::recordClaim(Counter* counter) {
+  u64 now = GetPerformanceCounter();
+  counter->mClaimHpc = now;
+  u64 wait = now > counter->mIssueHpc ? now - counter->mIssueHpc : 0;
+
+  JobQueue::lane_stats_t& lane = mQueues[counter->category()].stats[counter->priority()];
+  lane.executed.fetch_add(1, std::memory_order_relaxed);
+  lane.waitHpc.fetch_add(wait, std::memory_order_relaxed);
+  u64 maxWait = lane.maxWaitHpc.load(std::memory_order_relaxed);
+  while(wait > maxWait && !lane.maxWaitHpc.compare_exchange_weak(maxWait, wait, std::memory_order_relaxed)) {}
+
+  u64 deadline = counter->mDecl.deadlineHpc();
+  if(deadline != 0 && now > deadline) {
+    lane.deadlineMisses.fetch_add(1, std::memory_order_relaxed);
+  }
 }
 
-S<Counter> JobCenter::claimJob(category_t category) {
-  JobQueue& q = mQueues[category];
-  return q.dequeue();
+Counter* JobCenter::steal(category_t category, ePriority priority, uint seed) {
+  std::vector<JobWorker*>& victims = mWorkers[category];
+  uint count = (uint)victims.size();
+  if(count == 0) return nullptr;
+
+  // start from a pseudo random victim so idle workers do not all hammer the first one
+  uint start = (seed * 2654435761u) % count;
+  for(uint i = 0; i < count; i++) {
+    JobWorker* victim = victims[(start + i) % count];
+    if(victim == gCurrentWorker) continue;
+    Counter* counter = victim->local[priority].steal();
+    if(counter != nullptr) return counter;
+  }
+  return nullptr;
 }
 
-S<Counter> JobCenter::createJob(const S<Decl>& decl, category_t cat) {
-  S<Counter> counter = std::make_shared<Counter>(decl, cat);
-  return counter;
+uint JobCenter::workerCount(category_t category) const {
+  if(!mIsOpening || category >= mWorkers.size()) return 0;
+  return (uint)mWorkers[category].size();
+}
+
+bool JobCenter::starving(category_t category) const {
+  JobWorker* worker = gCurrentWorker;
+  if(mUseWorkStealing && worker != nullptr && worker->center == this && worker->category == category) {
+    return !worker->hasLocalWork();
+  }
+  return mQueues[category].empty();
 }
 
-S<Counter> JobCenter::issueJob(const S<Counter>& counter) {
-  JobQueue& q = mQueues[counter->category()];
-  return q.enqueue(counter);
+counter_ref_t JobCenter::createJob(Decl&& decl, category_t cat) {
+  return Counter::create(std::move(decl), cat);
+}
+
+// a job this close to its deadline does not wait behind anything
+static const double kDeadlineUrgentSecond = 0.002;
+
+void JobCenter::issueJob(Counter* counter) {
+  PROF_COUNTER("jobs issued", 1);
+  category_t cat = counter->category();
+  // the queue holds a reference until the job is executed or discarded
+  counter->retain();
+
+  u64 now = GetPerformanceCounter();
+  u64 deadline = counter->mDecl.deadlineHpc();
+  counter->mIssueHpc = now;
+  counter->mPriority = counter->mDecl.priority();
+  if(deadline != 0 && PerformanceCountToSecond(deadline > now ? deadline - now : 0) < kDeadlineUrgentSecond) {
+    counter->mPriority = PRIORITY_HIGH;
+  }
+
+  JobWorker* worker = gCurrentWorker;
+  if(mUseWorkStealing && worker != nullptr && worker->center == this && worker->category == cat) {
+    worker->local[counter->mPriority].push(counter);
+  } else {
+    mQueues[cat].enqueue(counter);
+  }
+  mQueues[cat].idleEvent.notifyOne();
 }
 
 void JobCenter::shutdown() {
   mIsOpening = false;
   for(JobQueue& queue: mQueues) {
-    queue.clear();
+    queue.idleEvent.notifyAll();
+  }
+  for(Thread& t: mSystemJobThreads) {
+    t.join();
+  }
+  mSystemJobThreads.clear();
+
+  for(JobQueue& queue: mQueues) {
+    for(uint i = 0; i < NUM_PRIORITY; i++) {
+      while(Counter* counter = queue.dequeue(ePriority(i))) {
+        discard(counter);
+      }
+    }
+  }
+
+  for(U<JobWorker>& worker: mWorkerStorage) {
+    for(WorkStealingQueue<Counter*>& queue: worker->local) {
+      while(Counter* counter = queue.steal()) {
+        discard(counter);
+      }
+    }
+  }
+}
+
+void JobCenter::execute(Counter* counter) {
+  // take over the reference the queue was holding
+  counter_ref_t ref(counter, false);
+  Counter* prev = gCurrentJob;
+  gCurrentJob = counter;
+  if(timelineEnabled()) {
+    job_record_t record;
+    record.issueHpc = counter->mIssueHpc;
+    record.name = counter->mDecl.name();
+    record.id = counter->mId;
+    record.category = counter->category();
+    record.priority = counter->priority();
+    // claimed right before, reading the counter again would double the cost of recording
+    record.startHpc = counter->mClaimHpc;
+    counter->invoke();
+    record.endHpc = GetPerformanceCounter();
+    recordJob(record);
+  } else {
+    counter->invoke();
+  }
+  gCurrentJob = prev;
+}
+
+void JobCenter::discard(Counter* counter) {
+  counter->terminate();
+  counter->release();
+}
+
+CounterPool::~CounterPool() {
+  for(void* chunk: mChunks) {
+    ::free(chunk);
+    Mem::onFree(MEMTAG_JOB, kChunkSize);
+  }
+}
+
+void* CounterPool::alloc() {
+  cache_t& cache = sCache;
+  if(cache.head == nullptr) {
+    refill(cache);
+  }
+
+  block_t* block = cache.head;
+  cache.head = block->next;
+  --cache.count;
+  mLiveBlocks.fetch_add(1, std::memory_order_relaxed);
+  return block;
+}
+
+void CounterPool::free(void* ptr) {
+  cache_t& cache = sCache;
+  block_t* block = (block_t*)ptr;
+  block->next = cache.head;
+  cache.head = block;
+  ++cache.count;
+  mLiveBlocks.fetch_sub(1, std::memory_order_relaxed);
+
+  if(cache.count < kBatchSize * 2) return;
+
+  // hand one batch back to the shared list
+  block_t* batch = cache.head;
+  block_t* tail = batch;
+  for(uint i = 1; i < kBatchSize; i++) {
+    tail = tail->next;
+  }
+  cache.head = tail->next;
+  cache.count -= kBatchSize;
+  tail->next = nullptr;
+
+  std::scoped_lock lock(mLock);
+  mBatches.push_back({ batch, kBatchSize });
+}
+
+void CounterPool::refill(cache_t& cache) {
+  {
+    std::scoped_lock lock(mLock);
+    if(!mBatches.empty()) {
+      batch_t& batch = mBatches.back();
+      cache.head = batch.head;
+      cache.count = batch.count;
+      mBatches.pop_back();
+      return;
+    }
+  }
+
+  uint8_t* chunk = (uint8_t*)malloc(kChunkSize);
+  {
+    std::scoped_lock lock(mLock);
+    mChunks.push_back(chunk);
   }
+  mReservedBytes.fetch_add(kChunkSize, std::memory_order_relaxed);
+  Mem::onAlloc(MEMTAG_JOB, kChunkSize);
+
+  constexpr uint kBlockPerChunk = uint(kChunkSize / kBlockSize);
+  for(uint i = 0; i < kBlockPerChunk; i++) {
+    block_t* block = (block_t*)(chunk + i * kBlockSize);
+    block->next = cache.head;
+    cache.head = block;
+  }
+  cache.count += kBlockPerChunk;
+}
+
+mem_stats_t CounterPool::stats() const {
+  mem_stats_t stats;
+  stats.reservedBytes = mReservedBytes.load(std::memory_order_relaxed);
+  stats.liveBlocks = mLiveBlocks.load(std::memory_order_relaxed);
+  stats.totalCounters = mTotalCounters.load(std::memory_order_relaxed);
+  return stats;
 }
 
+CounterPool::cache_t::~cache_t() {
+  if(head == nullptr) return;
+
+  // thread is going away, give everything back
+  std::scoped_lock lock(gCounterPool.mLock);
+  gCounterPool.mBatches.push_back({ head, count });
+  head = nullptr;
+  count = 0;
+}
 
 namespace Job {
   std::atomic<counter_id_t> Counter::sNextId = 0;
 };
 
-void Counter::dispatchBlockees() const {
-  for(uint i = 0; i < mBlockeeCount; i++) {
-    S<Counter> blockee = mBlockees[i];
-    dispatch(blockee);
+counter_ref_t Counter::create(Decl&& decl, category_t cat) {
+  void* mem = gCounterPool.alloc();
+  gCounterPool.mTotalCounters.fetch_add(1, std::memory_order_relaxed);
+  return counter_ref_t(new (mem) Counter(std::move(decl), cat));
+}
+
+Counter::Counter(Decl&& decl, category_t cat)
+  : mDecl(std::move(decl))
+  , mCategory(cat) {}
+
+void Counter::release() {
+  if(mRefCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    this->~Counter();
+    gCounterPool.free(this);
+  }
+}
+
+template<typename Func>
+void Counter::foreachBlockee(Func&& func) const {
+  uint inlineCount = std::min(mBlockeeCount, kInlineBlockeeCount);
+  for(uint i = 0; i < inlineCount; i++) {
+    func(mBlockees[i]);
+  }
+
+  uint rest = mBlockeeCount - inlineCount;
+  for(blockee_block_t* block = mBlockeeOverflow; block != nullptr; block = block->next) {
+    uint count = std::min(rest, blockee_block_t::kCapacity);
+    for(uint i = 0; i < count; i++) {
+      func(block->blockees[i]);
+    }
+    rest -= count;
   }
 }
 
+void Counter::lockBlockees() {
+  while(mBlockeeLock.test_and_set(std::memory_order_acquire)) {}
+}
+
+void Counter::unlockBlockees() {
+  mBlockeeLock.clear(std::memory_order_release);
+}
+
+void Counter::dispatchBlockees() {
+  // the list is closed by now, safe to walk without the lock
+  foreachBlockee([](Counter* blockee) {
+    if(blockee->decrementCounter() == 0) {
+      activeCenter().issueJob(blockee);
+    }
+  });
+}
+
 Counter::~Counter() {
-  for(uint i = 0; i < mBlockeeCount; i++) {
-    mBlockees[i]->terminate();
+  foreachBlockee([this](Counter* blockee) {
+    // never got executed, nobody is going to dispatch them
+    if(!mExecuted) blockee->terminate();
+    blockee->release();
+  });
+
+  blockee_block_t* block = mBlockeeOverflow;
+  while(block != nullptr) {
+    blockee_block_t* next = block->next;
+    block->~blockee_block_t();
+    gCounterPool.free(block);
+    block = next;
   }
 }
 
 void Counter::invoke() {
-  mDecl->execute();
-  dispatchBlockees();
+  mDecl.execute();
+  mExecuted = true;
+
+  // no blockee can be added afterwards
+  lockBlockees();
+  mBlockeesDispatched = true;
+  unlockBlockees();
+
+  // done before dispatching, a resumed waiter should see its counter done.
+  // nothing in the counter is written from here on, so a graph can re-arm it as soon as it is done
   mIsDone = true;
+  dispatchBlockees();
 }
 
-void Counter::reset() {
-  mDecl = nullptr;
-  mDispatchCounter = 1;
-  mBlockees.fill(nullptr);
-  mBlockeeCount = 0;
+void Counter::rearm(uint prerequisiteCount) {
+  lockBlockees();
+  // the overflow blocks stay for the next run, only the references go
+  uint index = 0;
+  foreachBlockee([this, &index](Counter* blockee) {
+    if(index++ >= mKeptBlockeeCount) blockee->release();
+  });
+  mBlockeeCount = mKeptBlockeeCount;
+  mBlockeesDispatched = false;
+  unlockBlockees();
+
+  mDispatchCounter = prerequisiteCount;
+  mExecuted = false;
+  mIsDone = false;
 }
 
-void Counter::addBlockee(const S<Counter>& counter) {
-  mBlockees[mBlockeeCount++] = counter;
+bool Counter::addBlockee(const counter_ref_t& counter) {
+  static_assert(sizeof(blockee_block_t) <= CounterPool::kBlockSize);
+
+  lockBlockees();
+  if(mBlockeesDispatched) {
+    unlockBlockees();
+    return false;
+  }
+
+  uint index = mBlockeeCount++;
+  counter->retain();
   counter->mDispatchCounter++;
+
+  if(index < kInlineBlockeeCount) {
+    mBlockees[index] = counter.get();
+    unlockBlockees();
+    return true;
+  }
+
+  // spill into overflow blocks, append a new block when the last one is full
+  index -= kInlineBlockeeCount;
+  blockee_block_t** slot = &mBlockeeOverflow;
+  while(index >= blockee_block_t::kCapacity) {
+    EXPECTS(*slot != nullptr);
+    slot = &(*slot)->next;
+    index -= blockee_block_t::kCapacity;
+  }
+  if(*slot == nullptr) {
+    *slot = new (gCounterPool.alloc()) blockee_block_t();
+  }
+  (*slot)->blockees[index] = counter.get();
+  unlockBlockees();
+  return true;
 }
 
 void Consumer::init(span<category_t> categories) {
@@ -187,11 +1039,9 @@ void Consumer::init(span<category_t> categories) {
 
 bool Consumer::consume() {
   for(category_t category: mCategories) {
-    S<Counter> counter = gJobCenter.claimJob(category);
+    Counter* counter = activeCenter().claimJob(category);
     if(counter != nullptr) {
-      gCurrentJob = counter.get();
-      counter->invoke();
-      gCurrentJob = nullptr;
+      JobCenter::execute(counter);
       return true;
     }
   }
@@ -217,9 +1067,65 @@ void Consumer::consumeFor(uint ms) {
 }
 
 void Job::startup(uint categoryCount) {
+  nameTimelineLane("Main", 0);
   gJobCenter.startup(categoryCount);
 }
 
+void Job::startup(const pool_config_t& config) {
+  nameTimelineLane("Main", 0);
+  gJobCenter.startup(NUM_CATEGORY, config);
+}
+
+pool_config_t pool_config_t::resolved() const {
+  pool_config_t config = *this;
+
+  // the thread calling startup keeps one for itself
+  int hardwareThreads = (int)std::max(2u, std::thread::hardware_concurrency());
+  int io = hardwareThreads >= 16 ? 2 : 1;
+  int slow = std::max(1, hardwareThreads / 8);
+  int generic = std::max(1, hardwareThreads - 1 - io - slow);
+  uint autoCount[NUM_CATEGORY] = { (uint)generic, (uint)slow, 0, (uint)io };
+
+  for(uint i = 0; i < NUM_CATEGORY; i++) {
+    if(config.workerCount[i] == kAuto) config.workerCount[i] = autoCount[i];
+  }
+  return config;
+}
+
+pool_config_t pool_config_t::load(const char* path) {
+  pool_config_t config;
+
+  Xml file(path);
+  Xml root = file.firstChild("JobSystem");
+  if(!root) {
+    Log::warnf("[job] no JobSystem in %s, use the default worker pool", path);
+    return config;
+  }
+
+  config.pinWorkers = root.attribute("pinWorkers", config.pinWorkers);
+  config.reserveMainThreadCore = root.attribute("reserveMainThreadCore", config.reserveMainThreadCore);
+
+  root.traverseChilds("Category", [&config, path](const Xml& node) {
+    std::string name = node.attribute("name", std::string());
+    auto iter = std::find_if(std::begin(kCategoryName), std::end(kCategoryName), [&name](const char* n) { return name == n; });
+    if(iter == std::end(kCategoryName)) {
+      Log::warnf("[job] unknown job category `%s` in %s", name.c_str(), path);
+      return;
+    }
+    uint cat = uint(iter - std::begin(kCategoryName));
+
+    std::string workers = node.attribute("workers", std::string("auto"));
+    config.workerCount[cat] = workers == "auto" ? kAuto : parse<uint>(workers);
+
+    idle_policy_t& policy = config.idlePolicy[cat];
+    policy.spinCount = node.attribute("spin", policy.spinCount);
+    policy.yieldCount = node.attribute("yield", policy.yieldCount);
+    policy.park = node.attribute("park", policy.park);
+  });
+
+  return config;
+}
+
 void Job::shutdown() {
   gJobCenter.shutdown();
 }
@@ -232,33 +1138,31 @@ Counter* Job::currentJob() {
   return gCurrentJob;
 }
 
-S<Counter> Job::create(Decl& decl, category_t cat) {
+counter_ref_t Job::create(Decl& decl, category_t cat) {
   return create(std::move(decl), cat);
 }
 
-S<Counter> Job::create(Decl&& decl, category_t cat) {
-  S<Decl> realDecl = S<Decl>(new Decl(decl));
-  return gJobCenter.createJob(realDecl, cat);
+counter_ref_t Job::create(Decl&& decl, category_t cat) {
+  return activeCenter().createJob(std::move(decl), cat);
 }
 
-void Job::dispatch(const S<Counter>& counter) {
-  counter->decrementCounter();
-  if(counter->counter() == 0) {
-    gJobCenter.issueJob(counter);
+void Job::dispatch(const counter_ref_t& counter) {
+  if(counter->decrementCounter() == 0) {
+    activeCenter().issueJob(counter.get());
   }
 }
 
-W<Counter> Job::dispatch(Decl& decl,  category_t cat) {
+counter_ref_t Job::dispatch(Decl& decl,  category_t cat) {
   return dispatch(std::move(decl), cat);
 }
 
-W<Counter> Job::dispatch(Decl&& decl, category_t cat) {
-  S<Decl> realDecl = std::make_shared<Decl>(decl);
-  return gJobCenter.issueJob(realDecl, cat);
+counter_ref_t Job::dispatch(Decl&& decl, category_t cat) {
+  return activeCenter().issueJob(std::move(decl), cat);
 }
 
-void Job::chain(const S<Counter>& prerequisite, const S<Counter>& afterFinish) {
+void Job::chain(const counter_ref_t& prerequisite, const counter_ref_t& afterFinish) {
   EXPECTS(afterFinish != nullptr);
+  // a prerequisite already done does not hold afterFinish back
   prerequisite->addBlockee(afterFinish);
 }
 
@@ -266,14 +1170,303 @@ bool Job::ready() {
   return gJobCenter.opening();
 }
 
+uint Job::workerCount(category_t cat) {
+  return activeCenter().workerCount(cat);
+}
+
+bool Job::executeOne(category_t cat) {
+  Counter* counter = activeCenter().claimJob(cat);
+  if(counter == nullptr) return false;
+  JobCenter::execute(counter);
+  return true;
+}
+
+bool Job::starving(category_t cat) {
+  return activeCenter().starving(cat);
+}
+
+void Job::setIdlePolicy(category_t cat, const idle_policy_t& policy) {
+  gJobCenter.setIdlePolicy(cat, policy);
+}
+
+idle_stats_t Job::idleStats(category_t cat) {
+  return gJobCenter.idleStats(cat);
+}
+
+queue_stats_t Job::queueStats(category_t cat, ePriority priority) {
+  return gJobCenter.queueStats(cat, priority);
+}
+
+void Job::resetQueueStats() {
+  gJobCenter.resetQueueStats();
+}
+
+mem_stats_t Job::memoryStats() {
+  return gCounterPool.stats();
+}
+
+Decl& Decl::deadline(double secondsFromNow) {
+  mDeadlineHpc = GetPerformanceCounter() + u64(std::max(0.0, secondsFromNow) / PerformanceCountToSecond(1));
+  return *this;
+}
+
+void Job::wait(const counter_ref_t& counter, float maxTimeSecond) {
+  if(counter == nullptr || counter->done()) return;
+
+  JobWorker* worker = gCurrentWorker;
+  if(worker != nullptr && worker->threadFiber != nullptr) {
+    Counter* job = gCurrentJob;
+    worker->switchTo(worker->acquireFiber(), JobWorker::SWITCH_SUSPEND, counter.get());
+    gCurrentJob = job;
+    return;
+  }
 
-void Job::wait(W<Counter> counter, float maxTimeSecond) {
   float start = (float)GetMainClock().total.second;
-  // see whether someone is holding it
-  S<Counter> c = counter.lock();
-  if(c == nullptr) return;
 
-  while(!c->done() && (float)GetMainClock().total.second < start + maxTimeSecond) {
+  while(!counter->done() && (float)GetMainClock().total.second < start + maxTimeSecond) {
+    CurrentThread::yield();
+  };
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// benchmark: 1M tiny jobs, spawned from 16 root jobs so both the injection queue and the worker local queues get exercised
+
+struct alignas(64) job_bench_slot_t {
+  std::atomic<u64> executed = 0; // only written by the owner worker, polled by the main thread
+  u64 latencyTotal = 0;
+  u64 latencyMax = 0;
+};
+
+static constexpr uint kJobBenchMaxWorker = 16;
+static job_bench_slot_t gJobBenchSlots[kJobBenchMaxWorker];
+
+static void jobBenchTiny(u64 issuedHpc) {
+  u64 latency = GetPerformanceCounter() - issuedHpc;
+  job_bench_slot_t& slot = gJobBenchSlots[gCurrentWorker->index];
+  slot.executed.store(slot.executed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  slot.latencyTotal += latency;
+  slot.latencyMax = std::max(slot.latencyMax, latency);
+}
+
+static void jobBenchRoot(uint count) {
+  for(uint i = 0; i < count; i++) {
+    Job::dispatch({ &jobBenchTiny, GetPerformanceCounter() }, CAT_GENERIC);
+  }
+}
+
+// return the throughput in jobs per second
+static double jobBench(uint workerCount, bool workStealing, uint jobCount) {
+  constexpr uint kRootCount = 16;
+  for(job_bench_slot_t& slot: gJobBenchSlots) {
+    slot.executed = 0;
+    slot.latencyTotal = 0;
+    slot.latencyMax = 0;
+  }
+
+  JobCenter center;
+  center.useWorkStealing(workStealing);
+  uint workerCounts[] = { workerCount };
+  center.startup(1, workerCounts);
+
+  size_t reservedBefore = Job::memoryStats().reservedBytes;
+  u64 start = GetPerformanceCounter();
+  for(uint i = 0; i < kRootCount; i++) {
+    center.issueJob(Decl(&jobBenchRoot, jobCount / kRootCount), CAT_GENERIC);
+  }
+
+  u64 executed = 0, latencyTotal = 0, latencyMax = 0;
+  uint expected = jobCount / kRootCount * kRootCount;
+  while(executed < expected) {
     CurrentThread::yield();
+    executed = 0;
+    for(uint i = 0; i < workerCount; i++) {
+      executed += gJobBenchSlots[i].executed.load(std::memory_order_relaxed);
+    }
+  }
+  double elapsed = PerformanceCountToSecond(GetPerformanceCounter() - start);
+  center.shutdown();
+
+  for(uint i = 0; i < workerCount; i++) {
+    latencyTotal += gJobBenchSlots[i].latencyTotal;
+    latencyMax = std::max(latencyMax, gJobBenchSlots[i].latencyMax);
+  }
+
+  size_t reservedBytes = Job::memoryStats().reservedBytes - reservedBefore;
+
+  Log::logf("[job_bench] %-14s workers: %2u, jobs: %u, throughput: %10.0lf jobs/s, heap: %.2lf bytes/job, latency avg: %s, max: %s",
+            workStealing ? "work-stealing" : "shared-queue",
+            workerCount, expected, double(expected) / elapsed, double(reservedBytes) / double(expected),
+            beautifySeconds(PerformanceCountToSecond(latencyTotal) / double(expected)).c_str(),
+            beautifySeconds(PerformanceCountToSecond(latencyMax)).c_str());
+  return double(expected) / elapsed;
+}
+
+COMMAND_REG("job_bench", "", "measure job dispatch throughput and latency, shared queue vs work-stealing, 1/4/8/16 workers")(Command&) {
+  constexpr uint kJobCount = 1000000;
+  uint workerCounts[] = { 1, 4, 8, 16 };
+  for(uint workerCount: workerCounts) {
+    jobBench(workerCount, false, kJobCount);
+    jobBench(workerCount, true, kJobCount);
+  }
+  return true;
+}
+
+COMMAND_REG("job_timeline_bench", "", "measure what recording the job timeline costs per job, on one worker")(Command&) {
+  constexpr uint kJobCount = 1000000;
+  constexpr uint kRepeat = 3;
+  bool wasEnabled = timelineEnabled();
+
+  double off = 0, on = 0;
+  for(uint r = 0; r < kRepeat; r++) {
+    enableTimeline(false);
+    off = std::max(off, jobBench(1, true, kJobCount));
+    enableTimeline(true);
+    on = std::max(on, jobBench(1, true, kJobCount));
+  }
+  enableTimeline(wasEnabled);
+
+  Log::logf("[job_timeline_bench] per job: %s without timeline, %s with, recording costs %s",
+            beautifySeconds(1.0 / off).c_str(), beautifySeconds(1.0 / on).c_str(),
+            beautifySeconds(std::max(0.0, 1.0 / on - 1.0 / off)).c_str());
+  return true;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// benchmark: parallelFor/parallelReduce over a sweep of range size x grain size, on the engine job center
+
+static float parallelBenchKernel(size_t i) {
+  float x = float(i & 0xffff) * 0.001f;
+  for(uint k = 0; k < 16; k++) {
+    x = x * 0.999f + 0.5f / (1.f + x);
+  }
+  return x;
+}
+
+COMMAND_REG("parallel_bench", "", "sweep range size against grain size for Job::parallelFor and Job::parallelReduce")(Command&) {
+  if(Job::workerCount(CAT_GENERIC) == 0) {
+    Log::logf("[parallel_bench] no CAT_GENERIC worker, everything would run serially");
+    return false;
+  }
+
+  constexpr uint kRepeat = 5;
+  size_t rangeSizes[] = { 1 << 10, 1 << 14, 1 << 18, 1 << 22 };
+  size_t grainSizes[] = { 1, 16, 256, 4096, 65536 };
+  std::vector<float> output(rangeSizes[3]);
+
+  for(size_t rangeSize: rangeSizes) {
+    double serial = 1e30;
+    double expected = 0;
+    for(uint r = 0; r < kRepeat; r++) {
+      u64 start = GetPerformanceCounter();
+      double sum = 0;
+      for(size_t i = 0; i < rangeSize; i++) {
+        output[i] = parallelBenchKernel(i);
+        sum += output[i];
+      }
+      serial = std::min(serial, PerformanceCountToSecond(GetPerformanceCounter() - start));
+      expected = sum;
+    }
+    Log::logf("[parallel_bench] range: %8u, serial: %s", (uint)rangeSize, beautifySeconds(serial).c_str());
+
+    for(size_t grain: grainSizes) {
+      if(grain > rangeSize) break;
+
+      double forTime = 1e30, reduceTime = 1e30;
+      double sum = 0;
+      for(uint r = 0; r < kRepeat; r++) {
+        u64 start = GetPerformanceCounter();
+        Job::parallelFor(0, rangeSize, grain, [&](size_t i) {
+          output[i] = parallelBenchKernel(i);
+        });
+        forTime = std::min(forTime, PerformanceCountToSecond(GetPerformanceCounter() - start));
+
+        start = GetPerformanceCounter();
+        sum = Job::parallelReduce(0, rangeSize, grain, 0.0, [&](size_t b, size_t e, double acc) {
+          for(size_t i = b; i < e; i++) {
+            acc += parallelBenchKernel(i);
+          }
+          return acc;
+        }, [](double a, double b) { return a + b; });
+        reduceTime = std::min(reduceTime, PerformanceCountToSecond(GetPerformanceCounter() - start));
+      }
+
+      Log::logf("[parallel_bench] range: %8u, grain: %6u, for: %s (x%.2lf), reduce: %s (x%.2lf)%s",
+                (uint)rangeSize, (uint)grain,
+                beautifySeconds(forTime).c_str(), serial / forTime,
+                beautifySeconds(reduceTime).c_str(), serial / reduceTime,
+                std::abs(sum - expected) > std::abs(expected) * 1e-6 ? ", REDUCE MISMATCH" : "");
+    }
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+static const char* kPriorityName[NUM_PRIORITY] = { "High", "Normal", "Low" };
+
+static void logQueueStats(const char* tag, const JobCenter& center, uint categoryCount) {
+  for(uint c = 0; c < categoryCount; c++) {
+    for(uint p = 0; p < NUM_PRIORITY; p++) {
+      queue_stats_t stats = center.queueStats(category_t(c), ePriority(p));
+      if(stats.executed == 0 && stats.depth == 0) continue;
+      Log::logf("[%s] %-11s %-6s depth: %5u, executed: %8llu, wait avg: %s, max: %s, deadline missed: %llu",
+                tag, kCategoryName[c], kPriorityName[p], stats.depth, stats.executed,
+                beautifySeconds(stats.waitSeconds).c_str(), beautifySeconds(stats.maxWaitSeconds).c_str(),
+                stats.deadlineMisses);
+    }
+  }
+}
+
+COMMAND_REG("job_queues", "reset: bool", "print queue depth and wait time of each category and priority")(Command& cmd) {
+  logQueueStats("job_queues", gJobCenter, NUM_CATEGORY);
+  bool reset = false;
+  try {
+    reset = cmd.arg<0, bool>();
+  } catch(const ArgumentNotFoundException&) {}
+  if(reset) gJobCenter.resetQueueStats();
+  return true;
+}
+
+// benchmark: a flood of low priority jobs with normal and high ones mixed in, a high job should barely wait
+// while aging still keeps the low ones moving
+
+static std::atomic<uint> gPriorityBenchExecuted = 0;
+
+static void priorityBenchJob(double seconds) {
+  u64 end = GetPerformanceCounter() + u64(seconds / PerformanceCountToSecond(1));
+  while(GetPerformanceCounter() < end) {
+    YieldProcessor();
+  }
+  gPriorityBenchExecuted.fetch_add(1, std::memory_order_relaxed);
+}
+
+COMMAND_REG("job_priority_bench", "", "issue 4000 low, 400 normal and 100 high priority jobs at once, report the wait of each priority")(Command&) {
+  constexpr uint kLowCount = 4000, kNormalCount = 400, kHighCount = 100;
+  constexpr double kJobSeconds = 0.00002;
+  gPriorityBenchExecuted = 0;
+
+  JobCenter center;
+  uint workerCounts[] = { std::max(1u, Job::workerCount(CAT_GENERIC)) };
+  center.startup(1, workerCounts);
+
+  uint issued = 0;
+  auto issue = [&](ePriority priority) {
+    Decl decl([] { priorityBenchJob(kJobSeconds); });
+    decl.priority(priority);
+    center.issueJob(std::move(decl), CAT_GENERIC);
+    issued++;
   };
+  for(uint i = 0; i < kLowCount; i++) {
+    issue(PRIORITY_LOW);
+    if(i % (kLowCount / kNormalCount) == 0) issue(PRIORITY_NORMAL);
+    if(i % (kLowCount / kHighCount) == 0) issue(PRIORITY_HIGH);
+  }
+
+  while(gPriorityBenchExecuted.load(std::memory_order_relaxed) < issued) {
+    CurrentThread::yield();
+  }
+
+  logQueueStats("job_priority_bench", center, 1);
+  center.shutdown();
+  return true;
 }
@@ -5,13 +5,16 @@
 #include "Engine/Async/Thread.hpp"
 #include "Engine/Core/Delegate.hpp"
 #include "Engine/Core/closure.hpp"
+#include "Engine/Core/intrusive_ptr.hpp"
+
+class JobCenter;
+struct JobWorker;
 
 namespace Job {
 
    using job_type_t = uint16_t;
    using counter_id_t = uint32_t;
    using category_t = uint8_t;
-   constexpr uint kMaxDependentJob = 1024;
 
    enum eCategory: category_t {
       CAT_GENERIC = 0,
@@ -21,6 +24,17 @@ namespace Job {
       NUM_CATEGORY,
    };
 
+   /*
+    * inside a category, workers always take the highest priority first.
+    * a lower level that keeps getting passed over earns credits and gets a turn eventually, so nothing starves.
+    */
+   enum ePriority: uint8_t {
+      PRIORITY_HIGH = 0,  // frame critical
+      PRIORITY_NORMAL,
+      PRIORITY_LOW,       // background work
+      NUM_PRIORITY,
+   };
+
    class Counter;
 
    class Decl {
@@ -48,44 +62,96 @@ namespace Job {
       void execute() {
          return mClosure();
       }
+
+      // eg. Decl decl(&decode, resource); Job::dispatch(decl.priority(PRIORITY_LOW), CAT_GENERIC_SLOW);
+      Decl& priority(ePriority p) { mPriority = p; return *this; }
+      // latest time the job should start, it is issued as high priority when the deadline is close
+      Decl& deadline(double secondsFromNow);
+      // shown in the job timeline, has to outlive the job
+      Decl& name(const char* name) { mName = name; return *this; }
+
+      ePriority priority() const { return mPriority; }
+      u64 deadlineHpc() const { return mDeadlineHpc; }
+      const char* name() const { return mName; }
    protected:
       closure mClosure;
+      const char* mName = nullptr;
+      ePriority mPriority = PRIORITY_NORMAL;
+      u64 mDeadlineHpc = 0; // 0 for no deadline
    };
 
+   using counter_ref_t = intrusive_ptr<Counter>;
+
+   /*
+    * Counters live in a pooled allocator and carry their own reference count, so dispatching a job never touches the global heap.
+    * The job closure is stored inline, blockees are kept in a small inline array which spills into pooled overflow blocks.
+    */
    class Counter {
    friend class Consumer;
-   friend void chain(const S<Counter>& prerequisite, const S<Counter>& afterFinish);
+   friend class ::JobCenter;
+   friend struct ::JobWorker;
+   friend class Graph;
+   friend void chain(const counter_ref_t& prerequisite, const counter_ref_t& afterFinish);
    public:
+      static constexpr uint kInlineBlockeeCount = 6;
+
       uint counter() const { return mDispatchCounter; }
 
-   void terminate() { mIsDone = true; };
+      void terminate() { mIsDone = true; };
 
-   Counter(S<Decl> decl, category_t cat)
-         : mDecl(std::move(decl))
-         , mCategory(cat) {
-         mBlockees.fill(nullptr);
-      }
-      void decrementCounter() { --mDispatchCounter; }
+      // return the counter after decrement
+      uint decrementCounter() { return --mDispatchCounter; }
       category_t category() const { return mCategory; }
+      // the priority it got issued with, a close deadline may have raised it above the one in the decl
+      ePriority priority() const { return mPriority; }
 
-      void dispatchBlockees() const;
+      void dispatchBlockees();
 
       bool done() const { return mIsDone; }
+      uint blockeeCount() const { return mBlockeeCount; }
+
+      void retain() { mRefCount.fetch_add(1, std::memory_order_relaxed); }
+      void release();
 
-   ~Counter();
+      static counter_ref_t create(Decl&& decl, category_t cat);
    protected:
+      struct blockee_block_t;
+
+      Counter(Decl&& decl, category_t cat);
+      ~Counter();
+
       void invoke();
-      void reset();
-      void addBlockee(const S<Counter>& counter);
+      // return false if the blockees are already dispatched, the counter is not held back in that case
+      bool addBlockee(const counter_ref_t& counter);
+      void lockBlockees();
+      void unlockBlockees();
+      // the blockees added so far stay across rearm, eg. the edges of a graph
+      void keepBlockees() { mKeptBlockeeCount = mBlockeeCount; }
+      // make a finished counter runnable again, keeps the closure and the kept blockees; the ones added since,
+      // eg. a job waiting on it or chained to it, got dispatched by the run they waited for and are released
+      void rearm(uint prerequisiteCount);
+
+      template<typename Func>
+      void foreachBlockee(Func&& func) const;
+
       static std::atomic<counter_id_t> sNextId;
 
-      S<Decl> mDecl = nullptr;
+      Decl mDecl;
       category_t mCategory = CAT_GENERIC;
+      ePriority mPriority = PRIORITY_NORMAL;
+      u64 mIssueHpc = 0;
+      u64 mClaimHpc = 0;
       std::atomic_uint mDispatchCounter = 1;
-      std::array<S<Counter>, kMaxDependentJob> mBlockees; // I am blocking them
-      std::atomic_size_t mBlockeeCount = 0;
+      std::atomic_uint mRefCount = 0;
+      uint mBlockeeCount = 0;
+      uint mKeptBlockeeCount = 0;
+      Counter* mBlockees[kInlineBlockeeCount]; // I am blocking them, each holds a reference
+      blockee_block_t* mBlockeeOverflow = nullptr;
+      std::atomic_flag mBlockeeLock = ATOMIC_FLAG_INIT; // blockees can be added while the job is running, eg. by a waiting job
+      bool mBlockeesDispatched = false;
       counter_id_t mId = sNextId++;
-      bool mIsDone = false;
+      std::atomic<bool> mIsDone = false;
+      bool mExecuted = false;
    };
 
    class Consumer {
@@ -105,13 +171,91 @@ namespace Job {
     * this api is thread specific
     */
    Counter* currentJob();
-   S<Counter> create(Decl& decl, category_t cat);
-   S<Counter> create(Decl&& decl, category_t cat);
-   void dispatch(const S<Counter>& counter);
-   W<Counter> dispatch(Decl& decl, category_t cat);
-   W<Counter> dispatch(Decl&& decl, category_t cat);
-   void chain(const S<Counter>& prerequisite, const S<Counter>& afterFinish);
+   counter_ref_t create(Decl& decl, category_t cat);
+   counter_ref_t create(Decl&& decl, category_t cat);
+   void dispatch(const counter_ref_t& counter);
+   counter_ref_t dispatch(Decl& decl, category_t cat);
+   counter_ref_t dispatch(Decl&& decl, category_t cat);
+   void chain(const counter_ref_t& prerequisite, const counter_ref_t& afterFinish);
    
-   void wait(W<Counter> counter, float maxTimeSecond);
+   /*
+    * inside a job running on a job worker, the job is suspended and the worker goes on with other jobs, the job resumes
+    * on the same worker once the counter is done, `maxTimeSecond` does not apply.
+    * anywhere else, the thread yields until the counter is done or the time is up.
+    */
+   void wait(const counter_ref_t& counter, float maxTimeSecond);
    bool ready();
+
+   /*
+    * building blocks for helping schedulers, see Parallel.hpp
+    */
+   uint workerCount(category_t cat);
+   // claim one job of the category and run it on the calling thread, return false if there was nothing to run
+   bool executeOne(category_t cat);
+   // true if nothing is queued where the calling thread dispatches jobs of the category, so idle workers have nothing to take
+   bool starving(category_t cat);
+
+   /*
+    * what an idle worker does before it goes to sleep, every round is one attempt to claim a job.
+    */
+   struct idle_policy_t {
+      uint spinCount = 64;  // rounds with a cpu pause in between
+      uint yieldCount = 4;  // rounds with a thread yield in between, after spinning
+      bool park = true;     // sleep until a job is issued, otherwise keep yielding
+   };
+   void setIdlePolicy(category_t cat, const idle_policy_t& policy);
+
+   /*
+    * how the worker pool is laid out, `kAuto` worker counts are derived from std::thread::hardware_concurrency().
+    * can be loaded from xml, every attribute is optional:
+    *   <JobSystem pinWorkers="true" reserveMainThreadCore="true">
+    *     <Category name="Generic" workers="auto" spin="64" yield="4" park="true"/>
+    *     <Category name="IO" workers="2"/>
+    *   </JobSystem>
+    */
+   struct pool_config_t {
+      static constexpr uint kAuto = uint(-1);
+
+      uint workerCount[NUM_CATEGORY] = { kAuto, kAuto, 0, kAuto };
+      // generic jobs come in bursts, stay hot for a little while; io jobs are rare and slow anyway, go to sleep right away
+      idle_policy_t idlePolicy[NUM_CATEGORY] = {
+         { 64, 4, true },
+         { 16, 4, true },
+         { 0,  0, true },
+         { 0,  1, true },
+      };
+      bool pinWorkers = true;            // one logical processor per worker, spread over physical cores first
+      bool reserveMainThreadCore = true; // keep the physical core of the thread calling startup free of workers
+
+      // copy with every kAuto resolved for this machine
+      pool_config_t resolved() const;
+      static pool_config_t load(const char* path);
+   };
+   void startup(const pool_config_t& config);
+
+   struct idle_stats_t {
+      uint   workerCount = 0;
+      uint   parkedWorkers = 0;  // sleeping right now
+      u64    wakeups = 0;        // times a parked worker was woken
+      u64    emptyWakeups = 0;   // wake-ups that found nothing to run, high means the spin phase is too short
+      double parkedSeconds = 0;  // total, over all workers of the category
+   };
+   idle_stats_t idleStats(category_t cat);
+
+   struct queue_stats_t {
+      uint   depth = 0;            // jobs waiting right now
+      u64    executed = 0;         // jobs claimed since the last reset
+      double waitSeconds = 0;      // average time from issue to start
+      double maxWaitSeconds = 0;
+      u64    deadlineMisses = 0;   // jobs started after their deadline
+   };
+   queue_stats_t queueStats(category_t cat, ePriority priority);
+   void resetQueueStats();
+
+   struct mem_stats_t {
+      size_t reservedBytes = 0; // bytes the counter pool took from the system
+      size_t liveBlocks = 0;    // counters and blockee overflow blocks in use
+      u64    totalCounters = 0; // counters ever created
+   };
+   mem_stats_t memoryStats();
 }
@@ -0,0 +1,237 @@
+﻿#include "JobGraph.hpp"
+#include "Engine/Core/Time/Time.hpp"
+#include "Engine/Debug/Log.hpp"
+#include "Engine/Debug/Console/Command.hpp"
+#include "Engine/Debug/Console/Console.hpp"
+using namespace Job;
+
+Graph::Graph() {
+  mFinal = Counter::create(Decl([this] { mDoneHpc = GetPerformanceCounter(); }), CAT_GENERIC);
+}
+
+Graph::~Graph() {
+  // a running graph still refers to this
+  EXPECTS(!mDispatched || done());
+}
+
+Graph::node_t Graph::addNode(Decl&& decl, category_t cat, const char* name) {
+  EXPECTS(!mCompiled);
+  mNodes.emplace_back(std::move(decl), cat, name);
+  return node_t(mNodes.size() - 1);
+}
+
+void Graph::addEdge(node_t from, node_t to) {
+  EXPECTS(!mCompiled);
+  EXPECTS(from < mNodes.size() && to < mNodes.size() && from != to);
+  mNodes[from].successors.push_back(to);
+  mNodes[to].inDegree++;
+}
+
+bool Graph::compile() {
+  EXPECTS(!mCompiled);
+
+  // Kahn's algorithm, whatever is left unvisited sits on a cycle
+  std::vector<uint> degree(mNodes.size());
+  std::vector<uint> depth(mNodes.size(), 1);
+  mTopologicalOrder.clear();
+  mRoots.clear();
+  for(node_t i = 0; i < (node_t)mNodes.size(); i++) {
+    degree[i] = mNodes[i].inDegree;
+    if(degree[i] == 0) {
+      mRoots.push_back(i);
+      mTopologicalOrder.push_back(i);
+    }
+  }
+
+  for(size_t i = 0; i < mTopologicalOrder.size(); i++) {
+    node_t node = mTopologicalOrder[i];
+    for(node_t next: mNodes[node].successors) {
+      depth[next] = std::max(depth[next], depth[node] + 1);
+      if(--degree[next] == 0) mTopologicalOrder.push_back(next);
+    }
+  }
+
+  if(mTopologicalOrder.size() != mNodes.size()) {
+    std::string cycle;
+    for(node_t i = 0; i < (node_t)mNodes.size(); i++) {
+      if(degree[i] != 0) cycle += Stringf(" %s(%u)", mNodes[i].name, i);
+    }
+    Log::warnf("[job graph] cycle among:%s", cycle.c_str());
+    mTopologicalOrder.clear();
+    mRoots.clear();
+    return false;
+  }
+
+  mCriticalPathLength = 0;
+  for(uint d: depth) {
+    mCriticalPathLength = std::max(mCriticalPathLength, d);
+  }
+
+  // counters live as long as the graph, edges become blockee links once and for all
+  for(node_t i = 0; i < (node_t)mNodes.size(); i++) {
+    Decl decl([this, i] { runNode(i); });
+    decl.name(mNodes[i].name).priority(mNodes[i].decl.priority());
+    mNodes[i].counter = Counter::create(std::move(decl), mNodes[i].category);
+  }
+
+  mSinkCount = 0;
+  for(node_info_t& node: mNodes) {
+    for(node_t next: node.successors) {
+      node.counter->addBlockee(mNodes[next].counter);
+    }
+    if(node.successors.empty()) {
+      node.counter->addBlockee(mFinal);
+      mSinkCount++;
+    }
+    node.counter->keepBlockees();
+  }
+
+  mCompiled = true;
+  return true;
+}
+
+void Graph::dispatch() {
+  EXPECTS(mCompiled);
+  EXPECTS(!mDispatched || done());
+
+  // arm everything before the first root runs, roots keep one extra count that Job::dispatch takes away
+  for(node_info_t& node: mNodes) {
+    node.counter->rearm(node.inDegree == 0 ? 1 : node.inDegree);
+  }
+  mFinal->rearm(mSinkCount == 0 ? 1 : mSinkCount);
+
+  mDispatched = true;
+  mDispatchHpc = GetPerformanceCounter();
+
+  if(mNodes.empty()) {
+    Job::dispatch(mFinal);
+    return;
+  }
+
+  for(node_t root: mRoots) {
+    Job::dispatch(mNodes[root].counter);
+  }
+}
+
+bool Graph::done() const {
+  return mFinal->done();
+}
+
+void Graph::wait(float maxTimeSecond) {
+  Job::wait(mFinal, maxTimeSecond);
+}
+
+void Graph::runNode(node_t index) {
+  node_info_t& node = mNodes[index];
+  node.startHpc = GetPerformanceCounter();
+  node.decl.execute();
+  node.endHpc = GetPerformanceCounter();
+}
+
+double Graph::criticalPathSeconds() const {
+  if(!mDispatched || !done()) return 0;
+
+  // longest path weighted by the node time of the last run
+  std::vector<u64> reach(mNodes.size(), 0);
+  u64 longest = 0;
+  for(node_t index: mTopologicalOrder) {
+    const node_info_t& node = mNodes[index];
+    u64 cost = reach[index] + (node.endHpc - node.startHpc);
+    longest = std::max(longest, cost);
+    for(node_t next: node.successors) {
+      reach[next] = std::max(reach[next], cost);
+    }
+  }
+  return PerformanceCountToSecond(longest);
+}
+
+double Graph::lastRunSeconds() const {
+  if(!mDispatched || !done()) return 0;
+  return PerformanceCountToSecond(mDoneHpc - mDispatchHpc);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// a frame shaped graph: input -> simulation -> (network sync, culling) -> render list, plus a few physics islands
+
+static void graphBenchWork(uint iterations) {
+  volatile float x = 1.f;
+  for(uint i = 0; i < iterations; i++) {
+    x = x * 0.999f + 0.001f;
+  }
+}
+
+COMMAND_REG("job_graph_bench", "frames: int", "dispatch a frame shaped job graph repeatedly, report critical path and pool growth")(Command& cmd) {
+  uint frameCount = 1000;
+  try {
+    frameCount = cmd.arg<0, int>();
+  } catch(const ArgumentNotFoundException&) {}
+
+  Graph frame;
+  Graph::node_t input   = frame.addNode({ &graphBenchWork, 2000u }, CAT_GENERIC, "input");
+  Graph::node_t sim     = frame.addNode({ &graphBenchWork, 8000u }, CAT_GENERIC, "simulation");
+  Graph::node_t net     = frame.addNode({ &graphBenchWork, 3000u }, CAT_GENERIC, "network sync");
+  Graph::node_t cull    = frame.addNode({ &graphBenchWork, 4000u }, CAT_GENERIC, "culling");
+  Graph::node_t render  = frame.addNode({ &graphBenchWork, 6000u }, CAT_GENERIC, "render list");
+  frame.addEdge(input, sim);
+  frame.addEdge(sim, net);
+  frame.addEdge(sim, cull);
+  frame.addEdge(cull, render);
+  for(uint i = 0; i < 8; i++) {
+    Graph::node_t island = frame.addNode({ &graphBenchWork, 1000u }, CAT_GENERIC, "physics island");
+    frame.addEdge(input, island);
+    frame.addEdge(island, sim);
+  }
+
+  if(!frame.compile()) return false;
+
+  // one warm up run, so the pools are as big as they get
+  frame.dispatch();
+  frame.wait();
+  mem_stats_t before = Job::memoryStats();
+
+  double dispatchTime = 0, runTime = 0, criticalPath = 0;
+  for(uint i = 0; i < frameCount; i++) {
+    u64 start = GetPerformanceCounter();
+    frame.dispatch();
+    dispatchTime += PerformanceCountToSecond(GetPerformanceCounter() - start);
+    frame.wait();
+    runTime += frame.lastRunSeconds();
+    criticalPath += frame.criticalPathSeconds();
+  }
+
+  mem_stats_t after = Job::memoryStats();
+
+  // waited on and chained to from a job every frame, nothing may pile up on the graph;
+  // the waiter and the chained job of the last run stay on it until the next dispatch
+  auto waitFromJob = [&frame](uint runCount) {
+    counter_ref_t waiter = Job::dispatch({ [&frame, runCount] {
+      for(uint i = 0; i < runCount; i++) {
+        frame.dispatch();
+        counter_ref_t after = Job::create({ [] {} }, CAT_GENERIC);
+        Job::chain(frame.counter(), after);
+        Job::dispatch(after);
+        frame.wait();
+      }
+    } }, CAT_GENERIC);
+    Job::wait(waiter, 60.f);
+  };
+  waitFromJob(1);
+  uint blockeeCount = frame.counter()->blockeeCount();
+  size_t liveBlocks = Job::memoryStats().liveBlocks;
+  waitFromJob(frameCount);
+  if(frame.counter()->blockeeCount() != blockeeCount || Job::memoryStats().liveBlocks > liveBlocks) {
+    Log::warnf("[job_graph_bench] waiting from a job leaks: %u -> %u blockees, %llu -> %llu live blocks",
+               blockeeCount, frame.counter()->blockeeCount(),
+               (u64)liveBlocks, (u64)Job::memoryStats().liveBlocks);
+  }
+
+  Log::logf("[job_graph_bench] %u nodes, critical path: %u nodes, %u frames", frame.nodeCount(), frame.criticalPathLength(), frameCount);
+  Log::logf("[job_graph_bench] dispatch: %s, run: %s, critical path: %s (per frame)",
+            beautifySeconds(dispatchTime / frameCount).c_str(),
+            beautifySeconds(runTime / frameCount).c_str(),
+            beautifySeconds(criticalPath / frameCount).c_str());
+  Log::logf("[job_graph_bench] counter pool growth: %lld bytes, counters created: %llu",
+            (long long)after.reservedBytes - (long long)before.reservedBytes,
+            after.totalCounters - before.totalCounters);
+  return true;
+}
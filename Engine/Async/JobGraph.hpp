@@ -0,0 +1,80 @@
+﻿#pragma once
+#include "Engine/Core/common.hpp"
+#include "Engine/Async/Job.hpp"
+#include <vector>
+
+namespace Job {
+
+  /*
+   * a fixed DAG of jobs, declared and compiled once, then dispatched as often as needed.
+   * Each node keeps one pooled counter for the whole life of the graph, edges are blockee links between them,
+   * dispatching re-arms the counters with their in-degree and issues the roots, nothing is allocated per run.
+   *   Graph frame;
+   *   auto input = frame.addNode({ &Game::input, game }, CAT_GENERIC, "input");
+   *   auto sim = frame.addNode({ &Game::simulate, game }, CAT_GENERIC, "simulate");
+   *   frame.addEdge(input, sim);
+   *   frame.compile();
+   *   ... every frame:
+   *   frame.dispatch(); ...; frame.wait();
+   */
+  class Graph {
+  public:
+    using node_t = uint;
+
+    Graph();
+    ~Graph();
+    Graph(const Graph&) = delete;
+    Graph& operator=(const Graph&) = delete;
+
+    node_t addNode(Decl&& decl, category_t cat, const char* name = "");
+    // `to` runs after `from` is done
+    void addEdge(node_t from, node_t to);
+
+    // check for cycles and link the counters, return false if there is a cycle, the graph cannot be dispatched then
+    bool compile();
+    bool compiled() const { return mCompiled; }
+
+    // the previous run has to be done
+    void dispatch();
+    bool done() const;
+    void wait(float maxTimeSecond = 10.f);
+    // done once every node is done, can be chained like any other counter
+    const counter_ref_t& counter() const { return mFinal; }
+
+    uint nodeCount() const { return (uint)mNodes.size(); }
+    // number of nodes on the longest dependency chain
+    uint criticalPathLength() const { return mCriticalPathLength; }
+    // of the last finished run: node time summed over the slowest chain, and dispatch to done
+    double criticalPathSeconds() const;
+    double lastRunSeconds() const;
+
+  protected:
+    struct node_info_t {
+      node_info_t(Decl&& decl, category_t cat, const char* name)
+        : decl(std::move(decl)), category(cat), name(name) {}
+
+      Decl decl;
+      category_t category;
+      const char* name;
+      std::vector<node_t> successors;
+      uint inDegree = 0;
+      counter_ref_t counter;
+      u64 startHpc = 0;
+      u64 endHpc = 0;
+    };
+
+    void runNode(node_t index);
+
+    std::vector<node_info_t> mNodes;
+    std::vector<node_t> mRoots;
+    std::vector<node_t> mTopologicalOrder;
+    counter_ref_t mFinal;
+    uint mSinkCount = 0;
+    uint mCriticalPathLength = 0;
+    u64 mDispatchHpc = 0;
+    u64 mDoneHpc = 0;
+    bool mCompiled = false;
+    bool mDispatched = false;
+  };
+
+}
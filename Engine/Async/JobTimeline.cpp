@@ -0,0 +1,247 @@
+﻿#include "JobTimeline.hpp"
+#include "Engine/Core/Time/Time.hpp"
+#include "Engine/Debug/ChromeTrace.hpp"
+#include "Engine/Debug/Log.hpp"
+#include "Engine/Debug/Console/Command.hpp"
+#include "Engine/Debug/Console/Console.hpp"
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <vector>
+using namespace Job;
+
+/*
+ * single writer ring of records, the owner thread writes without any lock,
+ * the exporter copies what it can see and drops what got overwritten meanwhile.
+ */
+struct TimelineBuffer {
+  std::atomic<u64> written = 0; // records ever written, the next one goes to slot `written % kTimelineRecordPerThread`
+  job_record_t records[kTimelineRecordPerThread];
+
+  // guarded by gTimelineLock
+  uint lane = 0;
+  std::string laneName;
+  int sortIndex = -1;
+  bool retired = false; // the owner thread is gone, the next new thread takes the buffer over
+};
+
+struct timeline_lane_t {
+  uint lane;
+  std::string name;
+  int sortIndex;
+};
+
+struct timeline_export_t {
+  fs::path file;
+  uint firstFrame;
+  u64 originHpc;
+  std::vector<u64> frameHpc;
+  std::vector<timeline_lane_t> lanes;
+  std::vector<std::pair<uint, job_record_t>> records; // lane, record
+};
+
+static std::mutex gTimelineLock;
+static std::vector<U<TimelineBuffer>> gTimelineBuffers;
+static std::atomic<bool> gTimelineEnabled = false;
+static std::atomic<uint> gTimelineFrame = 0;
+static std::atomic<u64> gTimelineFrameHpc[kTimelineFrameRecorded] = {};
+
+static const char* kTimelineCategoryName[NUM_CATEGORY] = { "Generic", "GenericSlow", "MainThread", "IO" };
+static const char* kTimelinePriorityName[NUM_PRIORITY] = { "High", "Normal", "Low" };
+
+/*
+ * the buffer is only created when the thread records its first job, threads naming their lane early do not pay for it.
+ */
+struct thread_timeline_t {
+  TimelineBuffer* buffer = nullptr;
+  std::string laneName;
+  int sortIndex = -1;
+
+  ~thread_timeline_t() {
+    if(buffer == nullptr) return;
+    std::scoped_lock lock(gTimelineLock);
+    buffer->retired = true;
+  }
+
+  TimelineBuffer& acquire() {
+    if(buffer != nullptr) return *buffer;
+
+    std::scoped_lock lock(gTimelineLock);
+    for(U<TimelineBuffer>& b: gTimelineBuffers) {
+      if(b->retired) {
+        buffer = b.get();
+        break;
+      }
+    }
+    if(buffer == nullptr) {
+      gTimelineBuffers.emplace_back(new TimelineBuffer());
+      buffer = gTimelineBuffers.back().get();
+      buffer->lane = (uint)gTimelineBuffers.size();
+    }
+
+    buffer->written.store(0, std::memory_order_relaxed);
+    buffer->retired = false;
+    buffer->laneName = laneName.empty() ? Stringf("Thread %u", buffer->lane) : laneName;
+    buffer->sortIndex = sortIndex;
+    return *buffer;
+  }
+};
+
+static thread_local thread_timeline_t sTimeline;
+
+void Job::enableTimeline(bool enabled) {
+  gTimelineEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool Job::timelineEnabled() {
+  return gTimelineEnabled.load(std::memory_order_relaxed);
+}
+
+void Job::markFrame() {
+  uint frame = gTimelineFrame.load(std::memory_order_relaxed) + 1;
+  gTimelineFrameHpc[frame % kTimelineFrameRecorded].store(GetPerformanceCounter(), std::memory_order_relaxed);
+  gTimelineFrame.store(frame, std::memory_order_release);
+}
+
+uint Job::currentFrame() {
+  return gTimelineFrame.load(std::memory_order_acquire);
+}
+
+void Job::nameTimelineLane(const char* name, int sortIndex) {
+  sTimeline.laneName = name;
+  sTimeline.sortIndex = sortIndex;
+  if(sTimeline.buffer == nullptr) return;
+
+  std::scoped_lock lock(gTimelineLock);
+  sTimeline.buffer->laneName = name;
+  sTimeline.buffer->sortIndex = sortIndex;
+}
+
+void Job::recordJob(const job_record_t& record) {
+  TimelineBuffer& buffer = sTimeline.acquire();
+  u64 index = buffer.written.load(std::memory_order_relaxed);
+  buffer.records[index % kTimelineRecordPerThread] = record;
+  buffer.written.store(index + 1, std::memory_order_release);
+}
+
+static void writeTimeline(S<timeline_export_t> data) {
+  u64 start = GetPerformanceCounter();
+
+  ChromeTrace trace(data->originHpc);
+  trace.processName(0, "Job System");
+  for(const timeline_lane_t& lane: data->lanes) {
+    trace.threadName(0, lane.lane, lane.name.c_str(), lane.sortIndex);
+  }
+  for(size_t i = 0; i < data->frameHpc.size(); i++) {
+    trace.instant(0, Stringf("Frame %u", data->firstFrame + (uint)i).c_str(), data->frameHpc[i]);
+  }
+
+  char args[128];
+  for(const auto& [lane, record]: data->records) {
+    snprintf(args, sizeof(args), "\"id\":%u,\"priority\":\"%s\",\"wait_us\":%.3lf",
+             record.id, kTimelinePriorityName[record.priority],
+             record.startHpc > record.issueHpc ? PerformanceCountToSecond(record.startHpc - record.issueHpc) * 1e6 : 0.0);
+    const char* name = record.name != nullptr && record.name[0] != 0 ? record.name : "job";
+    const char* category = record.category < NUM_CATEGORY ? kTimelineCategoryName[record.category] : "Job";
+    trace.complete(0, lane, name, category, record.startHpc, record.endHpc, args);
+  }
+
+  if(trace.save(data->file)) {
+    Log::tagf("job", "timeline: %u jobs written to %s in %s",
+              (uint)data->records.size(), data->file.generic_string().c_str(),
+              beautifySeconds(PerformanceCountToSecond(GetPerformanceCounter() - start)).c_str());
+  } else {
+    Log::warnf("[job] timeline: fail to write %s", data->file.generic_string().c_str());
+  }
+}
+
+counter_ref_t Job::exportTimeline(const fs::path& file, uint firstFrame, uint lastFrame) {
+  uint current = currentFrame();
+  if(firstFrame > lastFrame || lastFrame > current || current - firstFrame >= kTimelineFrameRecorded) {
+    return nullptr;
+  }
+
+  S<timeline_export_t> data(new timeline_export_t());
+  data->file = file;
+  data->firstFrame = firstFrame;
+  for(uint frame = firstFrame; frame <= lastFrame; frame++) {
+    data->frameHpc.push_back(gTimelineFrameHpc[frame % kTimelineFrameRecorded].load(std::memory_order_relaxed));
+  }
+  u64 rangeStart = data->frameHpc.front();
+  u64 rangeEnd = lastFrame == current
+                   ? GetPerformanceCounter()
+                   : gTimelineFrameHpc[(lastFrame + 1) % kTimelineFrameRecorded].load(std::memory_order_relaxed);
+  data->originHpc = rangeStart;
+
+  std::vector<u64> copied; // record index of what got copied from the current buffer
+  {
+    std::scoped_lock lock(gTimelineLock);
+    for(U<TimelineBuffer>& buffer: gTimelineBuffers) {
+      size_t first = data->records.size();
+      u64 end = buffer->written.load(std::memory_order_acquire);
+      u64 begin = end > kTimelineRecordPerThread ? end - kTimelineRecordPerThread : 0;
+      for(u64 i = begin; i < end; i++) {
+        const job_record_t& record = buffer->records[i % kTimelineRecordPerThread];
+        if(record.endHpc < rangeStart || record.startHpc > rangeEnd) continue;
+        data->records.emplace_back(buffer->lane, record);
+        copied.push_back(i);
+      }
+
+      // the owner kept writing while copying, the slots it wrapped over may be torn,
+      // and so may the one it is filling now: record `after` goes in the slot of `after - N`
+      u64 after = buffer->written.load(std::memory_order_acquire);
+      if(after + 1 - begin > kTimelineRecordPerThread) {
+        u64 safeBegin = after + 1 - kTimelineRecordPerThread;
+        size_t kept = first;
+        for(size_t i = first; i < data->records.size(); i++) {
+          if(copied[i - first] >= safeBegin) data->records[kept++] = data->records[i];
+        }
+        data->records.resize(kept);
+      }
+      copied.clear();
+
+      if(data->records.size() > first || !buffer->retired) {
+        data->lanes.push_back({ buffer->lane, buffer->laneName, buffer->sortIndex });
+      }
+    }
+  }
+
+  if(data->originHpc == 0 && !data->records.empty()) {
+    // frame 0 starts whenever the process did
+    data->originHpc = data->records.front().second.startHpc;
+    for(auto& [lane, record]: data->records) {
+      data->originHpc = std::min(data->originHpc, record.startHpc);
+    }
+  }
+
+  return Job::dispatch({ &writeTimeline, data }, CAT_IO);
+}
+
+COMMAND_REG("job_timeline", "enabled: bool", "start/stop recording the job timeline")(Command& cmd) {
+  bool enabled = cmd.arg<0, bool>();
+  enableTimeline(enabled);
+  Log::logf("[job] timeline recording %s", enabled ? "on" : "off");
+  return true;
+}
+
+COMMAND_REG("job_timeline_export", "[frames: uint][file: string]", "write the job timeline of the last few frames as Chrome trace json")(Command& cmd) {
+  uint frameCount = 1;
+  std::string file = "job.trace.json";
+  try {
+    frameCount = std::max(1u, cmd.arg<0, uint>());
+    file = cmd.arg<1>();
+  } catch(const ArgumentNotFoundException&) {}
+
+  if(!timelineEnabled()) {
+    Log::warnf("[job] timeline is not recording, try `job_timeline true` first");
+  }
+
+  uint current = currentFrame();
+  uint first = current >= frameCount ? current - frameCount : 0;
+  counter_ref_t job = exportTimeline(file, first, current);
+  if(job == nullptr) {
+    Log::warnf("[job] timeline: frames %u-%u are not available", first, current);
+    return false;
+  }
+  return true;
+}
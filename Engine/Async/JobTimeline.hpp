@@ -0,0 +1,47 @@
+﻿#pragma once
+#include "Engine/Core/common.hpp"
+#include "Engine/Async/Job.hpp"
+#include "Engine/File/Path.hpp"
+
+namespace Job {
+
+   /*
+    * job timeline: when enabled, every executed job leaves one record in a ring buffer owned by the thread running it,
+    * old records are overwritten once a buffer is full. Recording takes no lock and costs two counter reads per job.
+    * A frame range can be exported as Chrome trace json, one lane per thread:
+    *   Job::enableTimeline(true);
+    *   ...
+    *   uint frame = Job::currentFrame();
+    *   Job::exportTimeline("jobs.trace.json", frame - 4, frame);
+    */
+   struct job_record_t {
+      u64 issueHpc = 0;
+      u64 startHpc = 0;
+      u64 endHpc = 0;             // a job suspended in a wait includes the time it was suspended
+      const char* name = nullptr; // Decl::name, nullptr if the job was not named
+      counter_id_t id = 0;
+      category_t category = CAT_GENERIC;
+      ePriority priority = PRIORITY_NORMAL;
+   };
+
+   static constexpr uint kTimelineRecordPerThread = 16384;
+   static constexpr uint kTimelineFrameRecorded = 256;
+
+   void enableTimeline(bool enabled);
+   bool timelineEnabled();
+
+   // frame boundary for the timeline, the application calls it once at the beginning of every frame
+   void markFrame();
+   uint currentFrame();
+
+   /*
+    * copies the records of frames [firstFrame, lastFrame] right away, then builds and writes the json on CAT_IO.
+    * lastFrame == currentFrame() includes the frame in progress. Frames older than kTimelineFrameRecorded are gone.
+    * return the write job, nullptr if the frame range is not available
+    */
+   counter_ref_t exportTimeline(const fs::path& file, uint firstFrame, uint lastFrame);
+
+   // used by the job center
+   void nameTimelineLane(const char* name, int sortIndex);
+   void recordJob(const job_record_t& record);
+}
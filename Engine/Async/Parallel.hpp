@@ -0,0 +1,162 @@
+﻿#pragma once
+#include "Engine/Core/common.hpp"
+#include "Engine/Async/Job.hpp"
+#include <mutex>
+
+/*
+ * data parallel loops on top of the job system.
+ * A range is split eagerly into about two pieces per CAT_GENERIC worker. After that, a piece works through its range in
+ * grain-sized chunks and gives away half of what it has left whenever the queue idle workers steal from runs dry
+ * (lazy binary splitting). Busy workers stop splitting, and a worker that runs out of work creates demand right away.
+ * The calling thread processes a piece itself and helps run queued jobs until the whole range is done.
+ */
+namespace Job {
+
+  namespace detail {
+    template<typename Fn>
+    void invokeRange(Fn& fn, size_t begin, size_t end) {
+      if constexpr(std::is_invocable_v<Fn&, size_t, size_t>) {
+        fn(begin, end);
+      } else {
+        for(size_t i = begin; i < end; ++i) {
+          fn(i);
+        }
+      }
+    }
+
+    template<typename Fn>
+    struct for_task_t {
+      struct partial_t {};
+
+      Fn& fn;
+
+      partial_t start() const { return {}; }
+      void run(partial_t&, size_t begin, size_t end) { invokeRange(fn, begin, end); }
+      void finish(partial_t&&) {}
+    };
+
+    template<typename T, typename Map, typename Reduce>
+    struct reduce_task_t {
+      using partial_t = T;
+
+      reduce_task_t(const T& identity, Map& map, Reduce& reduce)
+        : identity(identity), map(map), reduce(reduce), result(identity) {}
+
+      T start() const { return identity; }
+      void run(T& acc, size_t begin, size_t end) { acc = map(begin, end, std::move(acc)); }
+      void finish(T&& acc) {
+        std::scoped_lock lock(resultLock);
+        result = reduce(result, acc);
+      }
+
+      const T& identity;
+      Map& map;
+      Reduce& reduce;
+      T result;
+      std::mutex resultLock;
+    };
+
+    /*
+     * shared by every piece of one call, lives on the caller's stack.
+     * a piece only touches it while it still holds unprocessed elements, so once `remaining` hits 0 nobody refers to it anymore.
+     */
+    template<typename Task>
+    struct parallel_state_t {
+      parallel_state_t(Task& task, size_t grain, size_t count)
+        : task(task), grain(grain), remaining(count) {}
+
+      Task& task;
+      const size_t grain;
+      std::atomic<size_t> remaining;
+    };
+
+    template<typename Task>
+    void runPiece(parallel_state_t<Task>* state, size_t begin, size_t end, uint depth);
+
+    template<typename Task>
+    void spawnPiece(parallel_state_t<Task>* state, size_t begin, size_t end, uint depth) {
+      Job::dispatch({ [=]() { runPiece(state, begin, end, depth); } }, CAT_GENERIC);
+    }
+
+    template<typename Task>
+    void runPiece(parallel_state_t<Task>* state, size_t begin, size_t end, uint depth) {
+      const size_t grain = state->grain;
+
+      // eager split, every level halves the range
+      while(depth > 0 && end - begin > grain) {
+        size_t mid = begin + (end - begin) / 2;
+        --depth;
+        spawnPiece(state, mid, end, depth);
+        end = mid;
+      }
+
+      typename Task::partial_t partial = state->task.start();
+      size_t processed = 0;
+      while(begin < end) {
+        if((end - begin) / 2 >= grain && Job::starving(CAT_GENERIC)) {
+          size_t mid = begin + (end - begin) / 2;
+          spawnPiece(state, mid, end, 0u);
+          end = mid;
+        }
+
+        size_t chunkEnd = end - begin > grain ? begin + grain : end;
+        state->task.run(partial, begin, chunkEnd);
+        processed += chunkEnd - begin;
+        begin = chunkEnd;
+      }
+
+      state->task.finish(std::move(partial));
+      state->remaining.fetch_sub(processed, std::memory_order_acq_rel);
+    }
+
+    template<typename Task>
+    void runParallel(Task& task, size_t begin, size_t end, size_t grain) {
+      EXPECTS(grain > 0);
+      if(begin >= end) return;
+
+      uint workerCount = Job::workerCount(CAT_GENERIC);
+      if(workerCount == 0 || end - begin <= grain) {
+        typename Task::partial_t partial = task.start();
+        task.run(partial, begin, end);
+        task.finish(std::move(partial));
+        return;
+      }
+
+      // about two pieces per thread taking part, the caller included
+      uint depth = 1;
+      while((1u << depth) < (workerCount + 1) * 2) ++depth;
+
+      parallel_state_t<Task> state(task, grain, end - begin);
+      runPiece(&state, begin, end, depth);
+
+      while(state.remaining.load(std::memory_order_acquire) != 0) {
+        if(!Job::executeOne(CAT_GENERIC)) {
+          CurrentThread::yield();
+        }
+      }
+    }
+  }
+
+  /*
+   * run `fn` over [begin, end) on the CAT_GENERIC workers, returns once every element is processed.
+   * `fn` is either `void(size_t i)` or `void(size_t begin, size_t end)`; grain is the smallest sub range it gets called on,
+   * apart from the tail of a range.
+   * while waiting, the calling thread runs other CAT_GENERIC jobs as well, not just pieces of this loop.
+   */
+  template<typename Fn>
+  void parallelFor(size_t begin, size_t end, size_t grain, Fn&& fn) {
+    detail::for_task_t<std::remove_reference_t<Fn>> task{ fn };
+    detail::runParallel(task, begin, end, grain);
+  }
+
+  /*
+   * `map`: T(size_t begin, size_t end, T acc), folds a sub range into acc, every piece starts from `identity`.
+   * `reduce`: T(const T& a, const T& b), combines piece results. Pieces finish in any order, so it has to be associative and commutative.
+   */
+  template<typename T, typename Map, typename Reduce>
+  T parallelReduce(size_t begin, size_t end, size_t grain, T identity, Map&& map, Reduce&& reduce) {
+    detail::reduce_task_t<T, std::remove_reference_t<Map>, std::remove_reference_t<Reduce>> task(identity, map, reduce);
+    detail::runParallel(task, begin, end, grain);
+    return std::move(task.result);
+  }
+}
@@ -7,6 +7,7 @@
 #include "Engine/Debug/Console/Console.hpp"
 #include "Engine/Math/MathUtils.hpp"
 #include "Engine/Core/StringUtils.hpp"
+#include "Engine/Debug/Profile/Profiler.hpp"
 
 using thread_handle_t = Thread::thread_handle_t;
 using thread_id_t = Thread::thread_id_t;
@@ -14,6 +15,7 @@ using thread_id_t = Thread::thread_id_t;
 
 static DWORD WINAPI threadEntryPoint(void* arg) {
   detail::Launch* launch = static_cast<detail::Launch*>(arg);
+  if(launch->name[0] != 0) CurrentThread::setName(launch->name);
   launch->run();
 
   SAFE_DELETE(launch);
@@ -117,6 +119,7 @@ Thread::~Thread() {
 }
 
 void Thread::launch(detail::Launch* launcher) {
+  launcher->name = mName;
   mHandle = threadCreate(launcher, mName);
 }
 
@@ -136,6 +139,45 @@ void CurrentThread::setName(const char* name) {
   auto wstr = make_wstring(std::string(name));
   thread_handle_t handle = GetCurrentThread();
   SetThreadDescription(handle, wstr.c_str());
+  Profile::nameThread(name);
+}
+
+bool CurrentThread::setAffinity(u64 mask) {
+  return ::SetThreadAffinityMask(::GetCurrentThread(), (DWORD_PTR)mask) != 0;
+}
+
+uint CurrentThread::processor() {
+  return (uint)::GetCurrentProcessorNumber();
+}
+
+cpu_topology_t queryCpuTopology() {
+  cpu_topology_t topology;
+
+  DWORD size = 0;
+  ::GetLogicalProcessorInformation(nullptr, &size);
+  std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> infos(size / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+
+  if(size == 0 || !::GetLogicalProcessorInformation(infos.data(), &size)) {
+    // no topology, treat every logical processor as a core of its own
+    SYSTEM_INFO sysInfo;
+    ::GetSystemInfo(&sysInfo);
+    for(uint i = 0; i < (uint)sysInfo.dwNumberOfProcessors && i < 64; i++) {
+      topology.cores.push_back({ i });
+    }
+    topology.logicalCount = (uint)topology.cores.size();
+    return topology;
+  }
+
+  for(const SYSTEM_LOGICAL_PROCESSOR_INFORMATION& info: infos) {
+    if(info.Relationship != RelationProcessorCore) continue;
+
+    std::vector<uint>& core = topology.cores.emplace_back();
+    for(uint i = 0; i < 64; i++) {
+      if((u64)info.ProcessorMask & (1ull << i)) core.push_back(i);
+    }
+    topology.logicalCount += (uint)core.size();
+  }
+  return topology;
 }
 
 void ThreadTest() {
@@ -1,6 +1,7 @@
 ﻿#pragma once
 #include "Engine/Core/common.hpp"
 #include <forward_list>
+#include <vector>
 
 
 #define DEFAULT_THREAD_STACK_SIZE 65536
@@ -9,6 +10,7 @@ namespace detail {
   struct Launch {
     virtual void run() = 0;
     virtual ~Launch() {}
+    const char* name = "";
   };
   template<typename ...Pack>
   struct Launcher final: public Launch {
@@ -84,4 +86,16 @@ namespace CurrentThread {
   void sleep(uint ms);
   Thread::thread_id_t id();
   void setName(const char* name);
-}
\ No newline at end of file
+
+  // bit i stands for logical processor i, only the first 64 are addressable
+  bool setAffinity(u64 mask);
+  // the logical processor the thread is running on right now
+  uint processor();
+}
+
+struct cpu_topology_t {
+  uint logicalCount = 0;
+  std::vector<std::vector<uint>> cores; // logical processors of every physical core, hyper-threads share a core
+};
+
+cpu_topology_t queryCpuTopology();
\ No newline at end of file
@@ -0,0 +1,131 @@
+#pragma once
+#include "Engine/Core/common.hpp"
+#include "Engine/Debug/ErrorWarningAssert.hpp"
+#include <atomic>
+#include <vector>
+
+/**
+ * \brief Chase-Lev work stealing deque.
+ *        The owner thread pushes and pops at the bottom, any other thread steals from the top.
+ *        Memory ordering follows Le, Pop, Cohen, Nardelli: "Correct and Efficient Work-Stealing for Weak Memory Models" (PPoPP'13).
+ *        The backing array grows when full; retired arrays are kept until the queue dies,
+ *        so a thief holding an old array never reads freed memory.
+ * \tparam T has to be a pointer type, nullptr is reserved as `empty`.
+ */
+template<typename T>
+class WorkStealingQueue {
+  static_assert(std::is_pointer_v<T>, "WorkStealingQueue only holds pointers");
+public:
+  static constexpr size_t kDefaultCapacity = 1024;
+
+  explicit WorkStealingQueue(size_t capacity = kDefaultCapacity) {
+    EXPECTS((capacity & (capacity - 1)) == 0);
+    mArray.store(new Array(capacity), std::memory_order_relaxed);
+  }
+
+  WorkStealingQueue(const WorkStealingQueue&) = delete;
+  WorkStealingQueue& operator=(const WorkStealingQueue&) = delete;
+
+  ~WorkStealingQueue() {
+    delete mArray.load(std::memory_order_relaxed);
+    for(Array* a: mRetired) {
+      delete a;
+    }
+  }
+
+  // owner thread only
+  void push(T item) {
+    int64 b = mBottom.load(std::memory_order_relaxed);
+    int64 t = mTop.load(std::memory_order_acquire);
+    Array* a = mArray.load(std::memory_order_relaxed);
+
+    if(b - t > (int64)a->capacity - 1) {
+      Array* grown = a->grow(t, b);
+      mRetired.push_back(a);
+      mArray.store(grown, std::memory_order_release);
+      a = grown;
+    }
+
+    a->put(b, item);
+    std::atomic_thread_fence(std::memory_order_release);
+    mBottom.store(b + 1, std::memory_order_relaxed);
+  }
+
+  // owner thread only, return nullptr if the queue is empty
+  T pop() {
+    int64 b = mBottom.load(std::memory_order_relaxed) - 1;
+    Array* a = mArray.load(std::memory_order_relaxed);
+    mBottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64 t = mTop.load(std::memory_order_relaxed);
+
+    if(t > b) {
+      // empty
+      mBottom.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+
+    T item = a->get(b);
+    if(t == b) {
+      // last one, race with thieves
+      if(!mTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        item = nullptr;
+      }
+      mBottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return item;
+  }
+
+  // any thread, return nullptr if the queue is empty or lost the race to another thief/owner
+  T steal() {
+    int64 t = mTop.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64 b = mBottom.load(std::memory_order_acquire);
+
+    if(t >= b) return nullptr;
+
+    Array* a = mArray.load(std::memory_order_acquire);
+    T item = a->get(t);
+    if(!mTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return item;
+  }
+
+  size_t sizeApprox() const {
+    int64 b = mBottom.load(std::memory_order_relaxed);
+    int64 t = mTop.load(std::memory_order_relaxed);
+    return b > t ? size_t(b - t) : 0;
+  }
+
+  bool empty() const { return sizeApprox() == 0; }
+
+protected:
+  struct Array {
+    explicit Array(size_t cap)
+      : capacity(cap)
+      , mask(cap - 1)
+      , items(new std::atomic<T>[cap]) {}
+    ~Array() { delete[] items; }
+
+    T get(int64 i) const { return items[i & mask].load(std::memory_order_relaxed); }
+    void put(int64 i, T item) { items[i & mask].store(item, std::memory_order_relaxed); }
+
+    Array* grow(int64 top, int64 bottom) const {
+      Array* a = new Array(capacity * 2);
+      for(int64 i = top; i < bottom; ++i) {
+        a->put(i, get(i));
+      }
+      return a;
+    }
+
+    const size_t capacity;
+    const size_t mask;
+    std::atomic<T>* items;
+  };
+
+  alignas(64) std::atomic<int64> mTop = 0;
+  alignas(64) std::atomic<int64> mBottom = 0;
+  alignas(64) std::atomic<Array*> mArray = nullptr;
+  std::vector<Array*> mRetired;
+};
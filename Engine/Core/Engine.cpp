@@ -12,6 +12,7 @@
 #include "Engine/Debug/Console/Console.hpp"
 #include "Engine/Graphics/Font.hpp"
 #include "Engine/Debug/Draw.hpp"
+#include "Engine/Debug/Profile/Overlay.hpp"
 
 Engine* gEngine = nullptr;
 
@@ -84,6 +85,7 @@ void Engine::init() {
   Console::Get()->init();
   Net::startup();
   Debug::drawInit();
+  Profile::initOverlay();
   // RemoteConsole::startup();
   //
   // RemoteConsole::get().onReceive([](uint index, const RemoteConsole::Instr& instr) {
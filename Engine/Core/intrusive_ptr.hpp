@@ -0,0 +1,68 @@
+﻿#pragma once
+#include "Engine/Core/common.hpp"
+
+/**
+ * \brief smart pointer for objects carrying their own reference count.
+ *        T has to provide `void retain()` and `void release()`, `release()` is responsible to destroy the object when the count hits zero.
+ *        Unlike S<T>, there is no control block, so the object can live in any allocator.
+ */
+template<typename T>
+class intrusive_ptr {
+public:
+  intrusive_ptr() = default;
+  intrusive_ptr(std::nullptr_t) {}
+
+  /**
+   * \param addRef false to adopt a reference the caller already owns
+   */
+  explicit intrusive_ptr(T* ptr, bool addRef = true): mPtr(ptr) {
+    if(mPtr != nullptr && addRef) mPtr->retain();
+  }
+
+  intrusive_ptr(const intrusive_ptr& from): mPtr(from.mPtr) {
+    if(mPtr != nullptr) mPtr->retain();
+  }
+
+  intrusive_ptr(intrusive_ptr&& from) noexcept: mPtr(from.mPtr) {
+    from.mPtr = nullptr;
+  }
+
+  ~intrusive_ptr() {
+    if(mPtr != nullptr) mPtr->release();
+  }
+
+  intrusive_ptr& operator=(const intrusive_ptr& rhs) {
+    intrusive_ptr(rhs).swap(*this);
+    return *this;
+  }
+
+  intrusive_ptr& operator=(intrusive_ptr&& rhs) noexcept {
+    intrusive_ptr(std::move(rhs)).swap(*this);
+    return *this;
+  }
+
+  intrusive_ptr& operator=(std::nullptr_t) {
+    intrusive_ptr().swap(*this);
+    return *this;
+  }
+
+  void swap(intrusive_ptr& other) noexcept { std::swap(mPtr, other.mPtr); }
+
+  /**
+   * \brief give up the ownership without touching the reference count.
+   */
+  T* detach() { T* ptr = mPtr; mPtr = nullptr; return ptr; }
+
+  T* get() const { return mPtr; }
+  T* operator->() const { return mPtr; }
+  T& operator*() const { return *mPtr; }
+  explicit operator bool() const { return mPtr != nullptr; }
+
+  bool operator==(const intrusive_ptr& rhs) const { return mPtr == rhs.mPtr; }
+  bool operator!=(const intrusive_ptr& rhs) const { return mPtr != rhs.mPtr; }
+  bool operator==(std::nullptr_t) const { return mPtr == nullptr; }
+  bool operator!=(std::nullptr_t) const { return mPtr != nullptr; }
+
+protected:
+  T* mPtr = nullptr;
+};
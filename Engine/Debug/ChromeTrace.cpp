@@ -0,0 +1,122 @@
+﻿#include "ChromeTrace.hpp"
+#include "Engine/Core/Time/Time.hpp"
+#include "Engine/File/Utils.hpp"
+#include "Engine/Debug/ErrorWarningAssert.hpp"
+#include <cmath>
+#include <cstdio>
+
+ChromeTrace::ChromeTrace(u64 originHpc): mOriginHpc(originHpc) {
+  mJson.reserve(64 KB);
+  mJson += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+}
+
+void ChromeTrace::processName(uint pid, const char* name) {
+  beginEvent();
+  char buf[64];
+  snprintf(buf, sizeof(buf), "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%u,\"args\":{\"name\":", pid);
+  mJson += buf;
+  appendString(name);
+  mJson += "}}";
+}
+
+void ChromeTrace::threadName(uint pid, uint tid, const char* name, int sortIndex) {
+  beginEvent();
+  char buf[96];
+  snprintf(buf, sizeof(buf), "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":", pid, tid);
+  mJson += buf;
+  appendString(name);
+  mJson += "}}";
+
+  if(sortIndex < 0) return;
+  beginEvent();
+  snprintf(buf, sizeof(buf), "{\"ph\":\"M\",\"name\":\"thread_sort_index\",\"pid\":%u,\"tid\":%u,\"args\":{\"sort_index\":%d}}",
+           pid, tid, sortIndex);
+  mJson += buf;
+}
+
+void ChromeTrace::complete(uint pid, uint tid, const char* name, const char* category, u64 startHpc, u64 endHpc, const char* args) {
+  beginEvent();
+  mJson += "{\"ph\":\"X\",\"name\":";
+  appendString(name);
+  mJson += ",\"cat\":";
+  appendString(category);
+
+  char buf[128];
+  snprintf(buf, sizeof(buf), ",\"pid\":%u,\"tid\":%u,\"ts\":%.3lf,\"dur\":%.3lf",
+           pid, tid, microsecond(startHpc), endHpc > startHpc ? PerformanceCountToSecond(endHpc - startHpc) * 1e6 : 0.0);
+  mJson += buf;
+
+  if(args != nullptr) {
+    mJson += ",\"args\":{";
+    mJson += args;
+    mJson += "}";
+  }
+  mJson += "}";
+}
+
+void ChromeTrace::instant(uint pid, const char* name, u64 hpc) {
+  beginEvent();
+  mJson += "{\"ph\":\"i\",\"s\":\"p\",\"name\":";
+  appendString(name);
+
+  char buf[64];
+  snprintf(buf, sizeof(buf), ",\"pid\":%u,\"tid\":0,\"ts\":%.3lf}", pid, microsecond(hpc));
+  mJson += buf;
+}
+
+void ChromeTrace::counter(uint pid, const char* name, u64 hpc, double value) {
+  beginEvent();
+  mJson += "{\"ph\":\"C\",\"name\":";
+  appendString(name);
+
+  char buf[96];
+  snprintf(buf, sizeof(buf), ",\"pid\":%u,\"ts\":%.3lf,\"args\":{\"value\":%.17g}}", pid, microsecond(hpc),
+           std::isfinite(value) ? value : 0.0); // json has no nan
+  mJson += buf;
+}
+
+const std::string& ChromeTrace::finish() {
+  if(!mFinished) {
+    mJson += "\n]}\n";
+    mFinished = true;
+  }
+  return mJson;
+}
+
+bool ChromeTrace::save(const fs::path& file) {
+  const std::string& json = finish();
+  fs::write(file, json.data(), json.size());
+  return fs::exists(file) && (size_t)fs::sizeOf(file) == json.size();
+}
+
+void ChromeTrace::beginEvent() {
+  EXPECTS(!mFinished);
+  if(mEventCount > 0) mJson += ",\n";
+  mEventCount++;
+}
+
+void ChromeTrace::appendString(const char* str) {
+  mJson += '"';
+  for(const char* c = str == nullptr ? "" : str; *c != 0; c++) {
+    switch(*c) {
+      case '"':  mJson += "\\\""; break;
+      case '\\': mJson += "\\\\"; break;
+      case '\n': mJson += "\\n"; break;
+      case '\t': mJson += "\\t"; break;
+      default:
+        if((unsigned char)*c < 0x20) {
+          char buf[8];
+          snprintf(buf, sizeof(buf), "\\u%04x", *c);
+          mJson += buf;
+        } else {
+          mJson += *c;
+        }
+    }
+  }
+  mJson += '"';
+}
+
+double ChromeTrace::microsecond(u64 hpc) const {
+  if(hpc >= mOriginHpc) return PerformanceCountToSecond(hpc - mOriginHpc) * 1e6;
+  return -PerformanceCountToSecond(mOriginHpc - hpc) * 1e6;
+}
@@ -0,0 +1,44 @@
+﻿#pragma once
+#include "Engine/Core/common.hpp"
+#include "Engine/File/Path.hpp"
+#include <string>
+
+/*
+ * writes Chrome trace event json, which chrome://tracing and ui.perfetto.dev both open.
+ * Timestamps are performance counter values, written in microseconds from `originHpc`.
+ *   ChromeTrace trace(start);
+ *   trace.threadName(0, 1, "Generic 0");
+ *   trace.complete(0, 1, "culling", "Generic", startHpc, endHpc);
+ *   trace.save("job.trace.json");
+ */
+class ChromeTrace {
+public:
+  explicit ChromeTrace(u64 originHpc);
+
+  void processName(uint pid, const char* name);
+  // `sortIndex` orders the lanes in the viewer, lower goes on top
+  void threadName(uint pid, uint tid, const char* name, int sortIndex = -1);
+
+  // a slice from `startHpc` to `endHpc`, `args` is the content of a json object, eg. "\"wait_us\": 12.5", or nullptr
+  void complete(uint pid, uint tid, const char* name, const char* category, u64 startHpc, u64 endHpc, const char* args = nullptr);
+  // a marker across every lane of the process, eg. frame boundaries
+  void instant(uint pid, const char* name, u64 hpc);
+  // the value of the counter track `name` of the process from `hpc` on
+  void counter(uint pid, const char* name, u64 hpc, double value);
+
+  size_t eventCount() const { return mEventCount; }
+
+  // closes the json, nothing can be added after
+  const std::string& finish();
+  bool save(const fs::path& file);
+
+protected:
+  void beginEvent();
+  void appendString(const char* str);
+  double microsecond(u64 hpc) const;
+
+  std::string mJson;
+  u64 mOriginHpc = 0;
+  size_t mEventCount = 0;
+  bool mFinished = false;
+};
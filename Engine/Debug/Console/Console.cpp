@@ -483,7 +483,7 @@ void Console::render() const {
 
   Mesh* layout = ms.createMesh<vertex_pcu_t>();
   renderer.drawMesh(*layout);
-  delete layout;
+  Mesher::destroyMesh<vertex_pcu_t>(layout);
 
   // ###### render text
   Mesher printer;
@@ -599,7 +599,7 @@ void Console::render() const {
     renderer.setTexture(TEXTURE_DIFFUSE, *mFont->texture(0)->srv());
     Mesh* text = printer.createMesh<vertex_pcu_t>();
     renderer.drawMesh(*text);
-    delete text;
+    Mesher::destroyMesh<vertex_pcu_t>(text);
   }
 
 }
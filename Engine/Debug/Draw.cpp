@@ -15,6 +15,7 @@
 #include "Engine/Graphics/Camera.hpp"
 #include "Engine/Application/Window.hpp"
 #include "Engine/Graphics/RHI/PipelineState.hpp"
+#include "Engine/Memory/FrameAllocator.hpp"
 ImmediateRenderer* gRenderer = nullptr;
 
 float gDefaultDuration = Debug::INF;
@@ -23,7 +24,6 @@ U<Camera> gUICamera = nullptr;
 const Clock* gDefaultClock = nullptr;
 Debug::eDebugDrawDepthMode gDefaultDepthMode = Debug::DEBUG_DEPTH_ENABLE;
 
-Mesher gDebugMesher;
 S<const Program> gDebugProgram;
 S<const Program> gDebugProgramDepthAlways;
 // RHIBuffer::sptr_t gTintBuffer;
@@ -251,7 +251,7 @@ template<typename F>
 Debug::DrawHandle* drawMetaShape(Debug::DrawOption options, F&& f) {
   static_assert(std::is_invocable_v<F, Mesher&, Debug::DebugDrawMetaData&>);
 
-  // Mesher& mesher = gDebugMesher;
+  // Mesher mesher(FrameAllocator::resource());
   // mesher.clear();
   // mesher.color(Rgba::white);
   // f(mesher);
@@ -372,14 +372,14 @@ void Debug::drawNow() {
 
   gRenderer->setRenderRegion(*RHIDevice::get()->backBuffer());
 
-  gDebugMesher.clear();
+  Mesher mesher(FrameAllocator::resource());
 
   for(uint i = 0; i < gDebugDrawCalls.size(); ++i) {
     DebugDrawMetaData*& comp = gDebugDrawCalls[i];
-    comp->appendSubMesh(gDebugMesher);
+    comp->appendSubMesh(mesher);
   }
 
-  Mesh* immediateMesh = gDebugMesher.createMesh<vertex_pcu_t>();
+  Mesh* immediateMesh = mesher.createMesh<vertex_pcu_t>();
 
   for(uint i = 0; i < gDebugDrawCalls.size(); i++) {
     DebugDrawMetaData*& comp = gDebugDrawCalls[i];
@@ -390,6 +390,7 @@ void Debug::drawNow() {
     gRenderer->drawSubMesh(*immediateMesh, i);
 
   }
+  Mesher::destroyMesh<vertex_pcu_t>(immediateMesh);
 
   for(uint i = 0; i < gDebugDrawCalls.size(); i++) {
     DebugDrawMetaData*& comp = gDebugDrawCalls[i];
@@ -403,8 +404,6 @@ void Debug::drawNow() {
     }
   }
 
-  SAFE_DELETE(immediateMesh);
-
   debugDrawGpuMesh();
   gEnableGpuRecord = false;
 }
@@ -1,7 +1,9 @@
 ﻿#include "Log.hpp"
 #include "Engine/Debug/Draw.hpp"
 #include "Engine/Debug/Console/Console.hpp"
-#include <queue>
+#include "Engine/Memory/RingBuffer.hpp"
+#include <algorithm>
+#include <cstring>
 #include <mutex>
 #include "Engine/Async/Thread.hpp"
 #include <cstdarg>
@@ -14,6 +16,7 @@
 #include <atomic>
 #include "Engine/Core/Time/Time.hpp"
 #include "Engine/Async/Job.hpp"
+#include "Engine/Memory/MemTrack.hpp"
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
@@ -66,36 +69,393 @@ protected:
 static LogFileOutput* gFileOutput;
 
 namespace Log {
-  class LogBuffer {
-  public:
-    void enqueue(const log_t& log) {
+  /*
+   * a log call does not format: its thread writes a binary record into its own queue, the tag and format pointers
+   * followed by the raw arguments the format asks for, and the logger thread formats it. Strings are copied,
+   * every other argument takes 8 bytes. A record is cut in chunks so a queue is a plain SpscRingBuffer,
+   * the whole record goes in with one tryPushAll. Tags and formats are kept by pointer: string literals only.
+   */
+  struct log_chunk_t {
+    alignas(8) char bytes[64];
+  };
+
+  struct record_header_t {
+    u64 hpc;          // orders the records of different threads
+    const char* tag;
+    const char* format;
+    u32 argBytes;
+    u32 chunkCount;
+  };
+
+  static constexpr uint kRecordChunkCount = 32;  // 2 KB, the Stringf limit, strings which do not fit are cut
+  static constexpr uint kQueueChunkCount = 1024; // power of two, 64 KB per thread which logs
+  static constexpr size_t kMaxArgBytes = kRecordChunkCount * sizeof(log_chunk_t) - sizeof(record_header_t);
+  static constexpr size_t kMaxLogLength = 2047;
+
+  struct thread_queue_t {
+    SpscRingBuffer<log_chunk_t, kQueueChunkCount> chunks;
+    std::atomic<bool> owned = true;
+    thread_queue_t* next = nullptr; // queues are never freed, a thread which exits leaves its queue to the next one
+  };
 
-      std::scoped_lock lock(mLock);
-      mPendingList.push(log);
+  static std::atomic<thread_queue_t*> gQueues = nullptr;
+  static std::atomic<u64> gDroppedRecords = 0;
+  static thread_local thread_queue_t* tQueue = nullptr;
+  static thread_local bool tExited = false;
+
+  struct queue_owner_t {
+    thread_queue_t* queue = nullptr;
+    ~queue_owner_t() {
+      tExited = true;
+      tQueue = nullptr;
+      if(queue != nullptr) queue->owned.store(false, std::memory_order_release);
     }
+  };
+  static thread_local queue_owner_t tQueueOwner;
+
+  enum eArgKind {
+    ARG_INVALID,     // not a conversion, printed as it is
+    ARG_PERCENT,
+    ARG_INT,
+    ARG_UINT,
+    ARG_DOUBLE,
+    ARG_STRING,
+    ARG_POINTER,
+    ARG_UNSUPPORTED, // wide strings and %n: the argument is skipped, the conversion printed as it is
+  };
+
+  enum eArgLength {
+    LENGTH_DEFAULT,
+    LENGTH_CHAR,
+    LENGTH_SHORT,
+    LENGTH_LONG,
+    LENGTH_LONG_LONG,
+    LENGTH_SIZE,
+    LENGTH_LONG_DOUBLE,
+  };
 
-    bool empty() const {
+  struct format_spec_t {
+    const char* begin = nullptr;       // the '%'
+    const char* lengthBegin = nullptr; // where the length modifier starts, the flags, width and precision are before
+    const char* end = nullptr;         // past the conversion
+    uint starCount = 0;                // width and precision given as int arguments
+    int precision = -1;                // when written in the format
+    bool precisionStar = false;
+    eArgLength length = LENGTH_DEFAULT;
+    eArgKind kind = ARG_INVALID;
+    char conversion = 0;
+  };
 
-      std::scoped_lock lock(mLock);
-      return mPendingList.empty();
+  // `cursor` is at a '%'
+  static format_spec_t parseSpec(const char* cursor) {
+    format_spec_t spec;
+    spec.begin = cursor++;
+
+    while(*cursor != 0 && strchr("-+ #0", *cursor) != nullptr) cursor++;
+    if(*cursor == '*') {
+      spec.starCount++;
+      cursor++;
+    } else {
+      while(*cursor >= '0' && *cursor <= '9') cursor++;
+    }
+    if(*cursor == '.') {
+      cursor++;
+      if(*cursor == '*') {
+        spec.starCount++;
+        spec.precisionStar = true;
+        cursor++;
+      } else {
+        spec.precision = 0;
+        while(*cursor >= '0' && *cursor <= '9') spec.precision = spec.precision * 10 + (*cursor++ - '0');
+      }
+    }
+
+    spec.lengthBegin = cursor;
+    switch(*cursor) {
+      case 'h': spec.length = cursor[1] == 'h' ? LENGTH_CHAR : LENGTH_SHORT; cursor += cursor[1] == 'h' ? 2 : 1; break;
+      case 'l': spec.length = cursor[1] == 'l' ? LENGTH_LONG_LONG : LENGTH_LONG; cursor += cursor[1] == 'l' ? 2 : 1; break;
+      case 'j': spec.length = LENGTH_LONG_LONG; cursor++; break;
+      case 'z': case 't': spec.length = LENGTH_SIZE; cursor++; break;
+      case 'L': spec.length = LENGTH_LONG_DOUBLE; cursor++; break;
+      case 'I':
+        // msvc: I64, I32, I
+        if(cursor[1] == '6' && cursor[2] == '4') { spec.length = LENGTH_LONG_LONG; cursor += 3; }
+        else if(cursor[1] == '3' && cursor[2] == '2') { cursor += 3; }
+        else { spec.length = LENGTH_SIZE; cursor++; }
+      break;
+      default: ;
     }
 
-    bool dequeue(log_t& log) {
+    spec.conversion = *cursor;
+    switch(spec.conversion) {
+      case '%': spec.kind = ARG_PERCENT; break;
+      case 'd': case 'i': case 'c': spec.kind = ARG_INT; break;
+      case 'u': case 'o': case 'x': case 'X': spec.kind = ARG_UINT; break;
+      case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A': spec.kind = ARG_DOUBLE; break;
+      case 's': spec.kind = spec.length == LENGTH_LONG ? ARG_UNSUPPORTED : ARG_STRING; break;
+      case 'p': spec.kind = ARG_POINTER; break;
+      case 'S': case 'n': spec.kind = ARG_UNSUPPORTED; break;
+      case 'C': spec.kind = ARG_INT; break;
+      default: spec.kind = ARG_INVALID;
+    }
+    spec.end = spec.conversion == 0 ? cursor : cursor + 1;
+    return spec;
+  }
+
+  static bool writeValue(char*& cursor, const char* end, const void* value) {
+    if(end - cursor < 8) return false;
+    memcpy(cursor, value, 8);
+    cursor += 8;
+    return true;
+  }
+
+  // u32 length, the bytes, then a 0; cut when it does not fit
+  static bool writeString(char*& cursor, const char* end, const char* str, size_t length) {
+    if(end - cursor < ptrdiff_t(sizeof(u32) + 1)) return false;
+    length = std::min(length, size_t(end - cursor) - sizeof(u32) - 1);
+    u32 size = u32(length);
+    memcpy(cursor, &size, sizeof(u32));
+    memcpy(cursor + sizeof(u32), str, length);
+    cursor[sizeof(u32) + length] = 0;
+    cursor += sizeof(u32) + length + 1;
+    return true;
+  }
+
+  // the arguments `format` asks for, out of `args`; stops at the first one which does not fit
+  static size_t encodeArgs(const char* format, va_list args, char* out, size_t capacity) {
+    char* cursor = out;
+    const char* end = out + capacity;
+
+    for(const char* c = format; *c != 0; c++) {
+      if(*c != '%') continue;
+      format_spec_t spec = parseSpec(c);
+      c = spec.end - 1;
+      if(spec.kind == ARG_INVALID || spec.kind == ARG_PERCENT) continue;
+
+      int precision = spec.precision;
+      for(uint i = 0; i < spec.starCount; i++) {
+        int64 star = va_arg(args, int);
+        if(spec.precisionStar && i == spec.starCount - 1) precision = int(star);
+        if(!writeValue(cursor, end, &star)) return cursor - out;
+      }
 
-      std::scoped_lock lock(mLock);
+      bool written = true;
+      switch(spec.kind) {
+        case ARG_INT: {
+          int64 value;
+          switch(spec.length) {
+            case LENGTH_CHAR: value = (signed char)va_arg(args, int); break;
+            case LENGTH_SHORT: value = (short)va_arg(args, int); break;
+            case LENGTH_LONG: value = va_arg(args, long); break;
+            case LENGTH_LONG_LONG: value = va_arg(args, long long); break;
+            case LENGTH_SIZE: value = va_arg(args, ptrdiff_t); break;
+            default: value = va_arg(args, int);
+          }
+          written = writeValue(cursor, end, &value);
+        } break;
+        case ARG_UINT: {
+          u64 value;
+          switch(spec.length) {
+            case LENGTH_CHAR: value = (unsigned char)va_arg(args, unsigned int); break;
+            case LENGTH_SHORT: value = (unsigned short)va_arg(args, unsigned int); break;
+            case LENGTH_LONG: value = va_arg(args, unsigned long); break;
+            case LENGTH_LONG_LONG: value = va_arg(args, unsigned long long); break;
+            case LENGTH_SIZE: value = va_arg(args, size_t); break;
+            default: value = va_arg(args, unsigned int);
+          }
+          written = writeValue(cursor, end, &value);
+        } break;
+        case ARG_DOUBLE: {
+          double value = spec.length == LENGTH_LONG_DOUBLE ? double(va_arg(args, long double)) : va_arg(args, double);
+          written = writeValue(cursor, end, &value);
+        } break;
+        case ARG_STRING: {
+          const char* str = va_arg(args, const char*);
+          if(str == nullptr) str = "(null)";
+          // with a precision the string does not have to end with a 0, eg. a string_view
+          size_t length = precision < 0 ? strlen(str) : strnlen(str, size_t(precision));
+          written = writeString(cursor, end, str, length);
+        } break;
+        case ARG_POINTER: {
+          const void* value = va_arg(args, const void*);
+          written = writeValue(cursor, end, &value);
+        } break;
+        case ARG_UNSUPPORTED: {
+          if(spec.conversion == 'S' || spec.conversion == 's' || spec.conversion == 'n') va_arg(args, void*);
+        } break;
+        default: ;
+      }
+      if(!written) break;
+    }
+    return cursor - out;
+  }
 
-      if (mPendingList.empty()) return false;
+  template<typename T>
+  static int formatOne(char* buffer, size_t size, const char* spec, const int64* stars, uint starCount, T value) {
+    switch(starCount) {
+      case 0: return snprintf(buffer, size, spec, value);
+      case 1: return snprintf(buffer, size, spec, int(stars[0]), value);
+      default: return snprintf(buffer, size, spec, int(stars[0]), int(stars[1]), value);
+    }
+  }
 
-      log = mPendingList.front();
-      mPendingList.pop();
-      
+  // the other end of encodeArgs, on the logger thread; a record cut short ends with "..."
+  static std::string formatArgs(const char* format, const char* args, size_t argBytes) {
+    std::string out;
+    const char* cursor = args;
+    const char* end = args + argBytes;
+    auto readValue = [&cursor, end](void* value) {
+      if(end - cursor < 8) return false;
+      memcpy(value, cursor, 8);
+      cursor += 8;
       return true;
+    };
+
+    for(const char* c = format; *c != 0 && out.size() < kMaxLogLength; c++) {
+      if(*c != '%') {
+        out += *c;
+        continue;
+      }
+      format_spec_t spec = parseSpec(c);
+      c = spec.end - 1;
+      if(spec.kind == ARG_PERCENT) {
+        out += '%';
+        continue;
+      }
+      // the spec without its length modifier, integers all go as 64 bits
+      char specText[64];
+      size_t prefixLength = spec.lengthBegin - spec.begin;
+      if(spec.kind == ARG_INVALID || spec.kind == ARG_UNSUPPORTED || prefixLength + 4 > sizeof(specText)) {
+        out.append(spec.begin, spec.end);
+        continue;
+      }
+      memcpy(specText, spec.begin, prefixLength);
+      char* specEnd = specText + prefixLength;
+      if((spec.kind == ARG_INT || spec.kind == ARG_UINT) && spec.conversion != 'c' && spec.conversion != 'C') {
+        *specEnd++ = 'l';
+        *specEnd++ = 'l';
+      }
+      *specEnd++ = spec.conversion == 'C' ? 'c' : spec.conversion;
+      *specEnd = 0;
+
+      int64 stars[2] = {};
+      bool complete = true;
+      for(uint i = 0; i < spec.starCount; i++) complete = complete && readValue(&stars[i]);
+
+      char buffer[kMaxLogLength + 1];
+      int length = -1;
+      if(complete) {
+        switch(spec.kind) {
+          case ARG_INT: {
+            int64 value;
+            if(!(complete = readValue(&value))) break;
+            length = spec.conversion == 'c' || spec.conversion == 'C'
+              ? formatOne(buffer, sizeof(buffer), specText, stars, spec.starCount, int(value))
+              : formatOne(buffer, sizeof(buffer), specText, stars, spec.starCount, (long long)value);
+          } break;
+          case ARG_UINT: {
+            u64 value;
+            if(!(complete = readValue(&value))) break;
+            length = formatOne(buffer, sizeof(buffer), specText, stars, spec.starCount, (unsigned long long)value);
+          } break;
+          case ARG_DOUBLE: {
+            double value;
+            if(!(complete = readValue(&value))) break;
+            length = formatOne(buffer, sizeof(buffer), specText, stars, spec.starCount, value);
+          } break;
+          case ARG_POINTER: {
+            void* value;
+            if(!(complete = readValue(&value))) break;
+            length = formatOne(buffer, sizeof(buffer), specText, stars, spec.starCount, value);
+          } break;
+          case ARG_STRING: {
+            u32 size;
+            if(!(complete = end - cursor >= ptrdiff_t(sizeof(u32) + 1))) break;
+            memcpy(&size, cursor, sizeof(u32));
+            const char* str = cursor + sizeof(u32);
+            cursor += sizeof(u32) + size + 1;
+            length = formatOne(buffer, sizeof(buffer), specText, stars, spec.starCount, str);
+          } break;
+          default: ;
+        }
+      }
+      if(!complete) {
+        out += "...";
+        break;
+      }
+      if(length > 0) out.append(buffer, std::min(size_t(length), sizeof(buffer) - 1));
     }
 
-  protected:
-    std::queue<log_t> mPendingList;
-    mutable std::mutex mLock;
-  };
+    if(out.size() > kMaxLogLength) out.resize(kMaxLogLength);
+    return out;
+  }
+
+  static thread_queue_t* acquireQueue() {
+    for(thread_queue_t* queue = gQueues.load(std::memory_order_acquire); queue != nullptr; queue = queue->next) {
+      bool owned = false;
+      if(!queue->owned.load(std::memory_order_relaxed)
+         && queue->owned.compare_exchange_strong(owned, true, std::memory_order_acquire)) {
+        return queue;
+      }
+    }
+
+    thread_queue_t* queue = new thread_queue_t();
+    Mem::onAlloc(MEMTAG_LOG, sizeof(thread_queue_t));
+    queue->next = gQueues.load(std::memory_order_relaxed);
+    while(!gQueues.compare_exchange_weak(queue->next, queue, std::memory_order_release, std::memory_order_relaxed));
+    return queue;
+  }
+
+  class Logger;
+  static Logger* gLogger = nullptr;
+  static bool loggerRunning();
+
+  static void enqueue(log_chunk_t* record, size_t argBytes) {
+    record_header_t header;
+    memcpy(&header, record->bytes, sizeof(header));
+    header.argBytes = u32(argBytes);
+    header.chunkCount = u32((sizeof(record_header_t) + argBytes + sizeof(log_chunk_t) - 1) / sizeof(log_chunk_t));
+    memcpy(record->bytes, &header, sizeof(header));
+
+    thread_queue_t* queue = tQueue;
+    bool borrowed = false;
+    if(queue == nullptr) {
+      if(tExited) {
+        // thread locals are going away, the record goes through a queue borrowed for it alone
+        queue = acquireQueue();
+        borrowed = true;
+      } else {
+        queue = tQueue = tQueueOwner.queue = acquireQueue();
+      }
+    }
+
+    // full: the logger thread is behind, wait for it instead of losing the record
+    while(!queue->chunks.tryPushAll(record, header.chunkCount)) {
+      if(!loggerRunning()) {
+        gDroppedRecords.fetch_add(1, std::memory_order_relaxed);
+        break;
+      }
+      CurrentThread::yield();
+    }
+    if(borrowed) queue->owned.store(false, std::memory_order_release);
+  }
+
+  static void push(const char* tag, const char* format, va_list args) {
+    log_chunk_t record[kRecordChunkCount];
+    record_header_t header{ GetPerformanceCounter(), tag, format, 0, 0 };
+    memcpy(record->bytes, &header, sizeof(header));
+    size_t argBytes = encodeArgs(format, args, record->bytes + sizeof(header), kMaxArgBytes);
+    enqueue(record, argBytes);
+  }
+
+  static void pushText(const char* tag, std::string_view text) {
+    log_chunk_t record[kRecordChunkCount];
+    record_header_t header{ GetPerformanceCounter(), tag, "%s", 0, 0 };
+    memcpy(record->bytes, &header, sizeof(header));
+    char* cursor = record->bytes + sizeof(header);
+    writeString(cursor, cursor + kMaxArgBytes, text.data(), text.size());
+    enqueue(record, cursor - (record->bytes + sizeof(header)));
+  }
 
   class Logger {
   public:
@@ -103,31 +463,34 @@ namespace Log {
     bool isRunning() { return mIsRunning; };
     void stop();
     void defineTag(tag_t tag);
-    void tagv(const char* tag, const char* format, va_list args);
-    void tagf(const char* tag, const char* format, ...);
-    void logf(const char* format, ...);
     void showAll();
     void hideAll();
     void show(const char* tag);
     void hide(const char* tag);
+    bool hidden(const char* tag);
 
     log_handle_t hook(log_cb_t cb);
     void unhook(log_handle_t cb);
 
+    // callable from any thread, the callbacks run on the calling thread then
     void flush();
-    bool isFlushing() { return mIsFlushing; }
-    void setFlushFlag() { mIsFlushing = true; }
     Thread* workingThread;
   protected:
+    struct pending_t {
+      u64 hpc;
+      const char* tag;
+      std::string content;
+    };
+
     tag_t searchTag(const char* tag);
-    LogBuffer mBuffer;
+    void drain();
+    std::mutex mDrainLock; // a queue takes one reader at a time, and callbacks one record at a time
+    std::vector<pending_t> mPending;
     std::vector<log_cb_t> mLogCallbacks;
     bool mIsRunning = true;
     std::unordered_map<std::string, bool> mHiddenTags;
     std::unordered_map<std::string, tag_t> mTags;
     bool mHiddenAll = false;
-    bool mIsFlushing = false;
-    // mainly for flush, where it's possible to pull out thing from the buffer, but still have not go through the cb, while another thread call flush
   };
 
   Logger::Logger() {
@@ -144,34 +507,9 @@ namespace Log {
     mTags[tag.name] = std::move(tag);
   }
 
-  void Logger::tagv(const char* tag, const char* format, va_list args) {
-    log_t log;
-
-    if(mHiddenTags.find(tag) == mHiddenTags.end()) {
-      mHiddenTags[tag] = mHiddenAll;
-    }
-
-    log.tag = searchTag(tag);
-    log.content = Stringv(format, args);
-
-    mBuffer.enqueue(log);
-  }
-
-  void Logger::tagf(const char* tag, const char* format, ...) {
-    va_list args;
-    va_start(args, format);
-    tagv(tag, format, args);
-    va_end(args);
-  }
-
-  void Logger::logf(const char* format, ...) {
-    va_list args;
-    va_start(args, format);
-    tagv("log", format, args);
-    va_end(args);
-  }
-
+  // the hidden tags are read by drain, which runs on any thread flushing
   void Logger::showAll() {
+    std::scoped_lock lock(mDrainLock);
     mHiddenAll = false;
     for(auto& tag: mHiddenTags) {
       tag.second = false;
@@ -179,6 +517,7 @@ namespace Log {
   }
 
   void Logger::hideAll() {
+    std::scoped_lock lock(mDrainLock);
     mHiddenAll = true;
     for (auto& tag : mHiddenTags) {
       tag.second = true;
@@ -186,13 +525,21 @@ namespace Log {
   }
 
   void Logger::show(const char* tag) {
+    std::scoped_lock lock(mDrainLock);
     mHiddenTags[tag] = false;
   }
 
   void Logger::hide(const char* tag) {
+    std::scoped_lock lock(mDrainLock);
     mHiddenTags[tag] = true;
   }
 
+  bool Logger::hidden(const char* tag) {
+    std::scoped_lock lock(mDrainLock);
+    auto iter = mHiddenTags.find(tag);
+    return iter == mHiddenTags.end() ? mHiddenAll : iter->second;
+  }
+
   log_handle_t Logger::hook(log_cb_t cb) {
     mLogCallbacks.emplace_back(std::move(cb));
     return &mLogCallbacks.back();
@@ -209,20 +556,49 @@ namespace Log {
     }
   }
 
-  void Logger::flush() {
-    mIsFlushing = true;
-    log_t log;
-    while(mBuffer.dequeue(log)) {
-      auto iter = mHiddenTags.find(log.tag.name);
-      EXPECTS(iter != mHiddenTags.end());
-      if(!iter->second) {
-        for(auto& cb: mLogCallbacks) {
-          cb(log);
-        }
+  void Logger::drain() {
+    // what is in the queues now, a thread logging non stop does not keep the logger here
+    for(thread_queue_t* queue = gQueues.load(std::memory_order_acquire); queue != nullptr; queue = queue->next) {
+      log_chunk_t record[kRecordChunkCount];
+      for(size_t popped = 0; popped < kQueueChunkCount && queue->chunks.tryPop(record[0]); ) {
+        record_header_t header;
+        memcpy(&header, record->bytes, sizeof(header));
+        // the rest of the record went in with its first chunk
+        size_t rest = queue->chunks.popBatch(record + 1, header.chunkCount - 1);
+        ENSURES(rest == header.chunkCount - 1);
+        popped += header.chunkCount;
+
+        mPending.push_back({ header.hpc, header.tag, formatArgs(header.format, record->bytes + sizeof(header), header.argBytes) });
       }
     }
+
+    u64 dropped = gDroppedRecords.exchange(0, std::memory_order_relaxed);
+    if(dropped > 0) {
+      mPending.push_back({ GetPerformanceCounter(), "warning", Stringf("%llu log records dropped, the logger was not running", dropped) });
+    }
+
+    // threads drain one after the other, put them back in the order they logged
+    std::stable_sort(mPending.begin(), mPending.end(), [](const pending_t& a, const pending_t& b) { return a.hpc < b.hpc; });
+    for(pending_t& pending: mPending) {
+      auto iter = mHiddenTags.try_emplace(pending.tag, mHiddenAll).first;
+      if(iter->second) continue;
+
+      log_t log;
+      log.tag = searchTag(pending.tag);
+      log.content = std::move(pending.content);
+      for(auto& cb: mLogCallbacks) {
+        cb(log);
+      }
+    }
+    mPending.clear();
+  }
+
+  void Logger::flush() {
+    {
+      std::scoped_lock lock(mDrainLock);
+      drain();
+    }
     gFileOutput->flush();
-    mIsFlushing = false;
   }
 
   tag_t Logger::searchTag(const char* tag) {
@@ -232,7 +608,9 @@ namespace Log {
     return { tag, Rgba::white };
   }
 
-  static Log::Logger* gLogger = nullptr;
+  static bool loggerRunning() {
+    return gLogger != nullptr && gLogger->isRunning();
+  }
 
   void worker() {
     while(gLogger->isRunning()) {
@@ -248,7 +626,8 @@ namespace Log {
   }
 
   void log(std::string_view text, const Rgba& /*color*/) {
-    gLogger->logf(text.data());
+    // the text is no format, and does not outlive the call
+    pushText("log", text);
   }
 
   //void log(std::string_view text, const Rgba& color, float duration, bool toView, bool toConsole, bool toMessage) {
@@ -260,34 +639,34 @@ namespace Log {
   }
 
   void tagv(const char* tag, const char* format, va_list args) {
-    gLogger->tagv(tag, format, args);
+    push(tag, format, args);
   }
 
   void tagf(const char* tag, const char* format, ...) {
     va_list args;
     va_start(args, format);
-    gLogger->tagv(tag, format, args);
+    push(tag, format, args);
     va_end(args);
   }
 
   void logf(const char* format, ...) {
     va_list args;
     va_start(args, format);
-    gLogger->tagv("log", format, args);
+    push("log", format, args);
     va_end(args);
   }
 
   void warnf(const char* format, ...) {
     va_list args;
     va_start(args, format);
-    gLogger->tagv("warning", format, args);
+    push("warning", format, args);
     va_end(args);
   }
 
   void errorf(const char* format, ...) {
     va_list args;
     va_start(args, format);
-    gLogger->tagv("error", format, args);
+    push("error", format, args);
     va_end(args);
   }
 
@@ -307,9 +686,13 @@ namespace Log {
     gLogger->hide(tag);
   }
 
+  bool hidden(const char* tag) {
+    return gLogger->hidden(tag);
+  }
+
   void flush() {
-    gLogger->setFlushFlag();
-    while (gLogger->isFlushing());
+    // everything logged before the call is out once it returns
+    gLogger->flush();
   }
 
   log_handle_t hook(log_cb_t cb) {
@@ -329,7 +712,7 @@ namespace Log {
     if (gLogger != nullptr) return;
     gLogger = new Logger();
     gFileOutput = new LogFileOutput();
-    gLogger->workingThread = new Thread(worker);
+    gLogger->workingThread = new Thread("Logger", worker);
   }
 
   void shutDown() {
@@ -490,4 +873,65 @@ COMMAND_REG("enable_log", "tag: string", "display log with tag") (Command& cmd)
 COMMAND_REG("log_flush_test", "", "") (Command&) {
   logFlushTest();
   return true;
+}
+
+// benchmark: the cost on the calling thread. Every thread flushes between batches, a batch fits its queue,
+// so a call never waits for the logger to catch up
+
+static constexpr const char* kLogBenchTag = "log_bench";
+static constexpr uint kLogBenchBatch = 256;
+static constexpr uint kLogBenchRound = 64;
+static const char* kLogBenchMix[] = { "tagf, no argument", "tagf, int", "tagf, int float", "tagf, string int float", "logf, string int float" };
+
+static void logBenchThread(uint mix, uint seed, double* seconds) {
+  u64 spent = 0;
+  for(uint round = 0; round < kLogBenchRound; round++) {
+    u64 start = GetPerformanceCounter();
+    for(uint i = 0; i < kLogBenchBatch; i++) {
+      switch(mix) {
+        case 0: Log::tagf(kLogBenchTag, "frame begin"); break;
+        case 1: Log::tagf(kLogBenchTag, "entity %u spawned", seed + i); break;
+        case 2: Log::tagf(kLogBenchTag, "entity %u at %.3f", seed + i, float(i) * .5f); break;
+        case 3: Log::tagf(kLogBenchTag, "%s: entity %u took %.2f ms", "Physics::step", seed + i, double(i) * .01); break;
+        default: Log::logf("%s: entity %u took %.2f ms", "Physics::step", seed + i, double(i) * .01);
+      }
+    }
+    spent += GetPerformanceCounter() - start;
+    Log::flush();
+  }
+  *seconds = PerformanceCountToSecond(spent);
+}
+
+COMMAND_REG("log_bench", "", "time Log::tagf/logf calls with typical arguments on the calling thread, 1 to 16 threads")(Command&) {
+  // tags are filtered when the logger drains, hidden records cost the caller all the same
+  bool benchHidden = Log::hidden(kLogBenchTag);
+  bool logHidden = Log::hidden("log");
+  Log::hide(kLogBenchTag);
+  Log::hide("log");
+
+  std::vector<std::string> results;
+  for(uint mix = 0; mix < std::size(kLogBenchMix); mix++) {
+    for(uint threadCount = 1; threadCount <= 16; threadCount *= 2) {
+      std::vector<double> seconds(threadCount, 0.0);
+      std::vector<Thread> threads;
+      threads.reserve(threadCount);
+      for(uint i = 0; i < threadCount; i++) {
+        threads.emplace_back("log bench", &logBenchThread, mix, i * kLogBenchBatch, &seconds[i]);
+      }
+      for(Thread& thread: threads) thread.join();
+
+      double total = 0;
+      for(double s: seconds) total += s;
+      double callCount = double(threadCount) * kLogBenchBatch * kLogBenchRound;
+      results.push_back(Stringf("[log_bench] %-24s %2u threads: %.1f ns per call", kLogBenchMix[mix], threadCount, total * 1e9 / callCount));
+    }
+  }
+
+  Log::flush();
+  if(!benchHidden) Log::show(kLogBenchTag);
+  if(!logHidden) Log::show("log");
+  for(const std::string& result: results) {
+    Log::logf("%s", result.c_str());
+  }
+  return true;
 }
\ No newline at end of file
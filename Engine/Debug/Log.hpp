@@ -32,6 +32,7 @@ namespace Log {
   void hideAll();
   void show(const char* tag);
   void hide(const char* tag);
+  bool hidden(const char* tag);
   void flush();
   log_handle_t hook(log_cb_t cb);
   void unhook(log_handle_t cb);
@@ -0,0 +1,387 @@
+﻿#include "Capture.hpp"
+#include "Engine/Debug/Profile/Profiler.hpp"
+#include "Engine/Debug/Profile/Report.hpp"
+#include "Engine/Debug/Console/Console.hpp"
+#include "Engine/Debug/Console/Command.hpp"
+#include "Engine/Persistence/json.hpp"
+#include "Engine/File/Utils.hpp"
+#include "Engine/File/Blob.hpp"
+#include "Engine/Async/Job.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+
+using namespace Profile;
+
+struct capture_thread_t {
+  uint lane;
+  std::string name;
+  U<Report> flat{ new Report() };
+  U<Report> tree{ new Report() };
+};
+
+// a counter or gauge over the captured frames
+struct capture_value_t {
+  std::string name;
+  eValueKind kind;
+  uint frameCount = 0;
+  double total = 0;
+  double min = 0;
+  double max = 0;
+  double last = 0;
+};
+
+struct capture_t {
+  fs::path jsonFile;
+  fs::path csvFile;
+  fs::path valuesCsvFile;
+  uint frameCount = 0;
+  Histogram frameTimes;
+  std::vector<capture_thread_t> threads;
+  std::vector<capture_value_t> values;
+};
+
+// only touched by the main thread
+static fs::path gCapturePrefix;
+static uint gCaptureInterval = 0; // 0 when not capturing
+static uint gCaptureFrames = 0;   // frames since the last write
+static uint gCaptureIndex = 0;
+static S<capture_t> gCapture;     // the frames since the last write, folded so far
+static u64 gCaptureLastHpc = 0;   // start of the last frame folded, a paused profiler keeps handing it out
+static std::vector<Job::counter_ref_t> gCaptureWrites;
+
+static double toMs(double seconds) {
+  return seconds * 1000.0;
+}
+
+static double countToMs(u64 performanceCount) {
+  return toMs(PerformanceCountToSecond(performanceCount));
+}
+
+static json entryJson(const Report::Entry& entry, uint frameCount) {
+  return {
+    { "name", std::string(entry.name) },
+    { "calls", entry.callCount },
+    { "total_ms", toMs(entry.totalTime) },
+    { "self_ms", toMs(entry.selfTime) },
+    { "self_ms_per_frame", toMs(entry.selfTime) / frameCount },
+    { "p50_ms", toMs(entry.p50Time) },
+    { "p90_ms", toMs(entry.p90Time) },
+    { "p99_ms", toMs(entry.p99Time) },
+    { "max_ms", toMs(entry.maxTime) },
+  };
+}
+
+static json treeJson(const Report::Entry& entry, uint frameCount) {
+  json node = entryJson(entry, frameCount);
+  json children = json::array();
+  for(const auto& [_, child]: entry.children()) {
+    children.push_back(treeJson(*child, frameCount));
+  }
+  node["children"] = std::move(children);
+  return node;
+}
+
+// scope names come from __FUNCTION__ as well, template arguments bring commas
+static std::string csvField(std::string_view str) {
+  if(str.find_first_of(",\"\n") == std::string_view::npos) return std::string(str);
+  std::string quoted = "\"";
+  for(char c: str) {
+    if(c == '"') quoted += '"';
+    quoted += c;
+  }
+  return quoted + '"';
+}
+
+static void csvRow(std::string& csv, const std::string& thread, const char* view, std::string_view scope,
+                   const Report::Entry& entry, uint frameCount) {
+  csv += csvField(thread);
+  csv += ',';
+  csv += view;
+  csv += ',';
+  csv += csvField(scope);
+  csv += Stringf(",%u,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n",
+                 entry.callCount, toMs(entry.totalTime), toMs(entry.selfTime), toMs(entry.selfTime) / frameCount,
+                 toMs(entry.p50Time), toMs(entry.p90Time), toMs(entry.p99Time), toMs(entry.maxTime));
+}
+
+// tree rows are named by their path under the frame, eg. `Game::update/Physics::step`
+static void csvTree(std::string& csv, const std::string& thread, const std::string& path,
+                    const Report::Entry& entry, uint frameCount) {
+  for(const auto& [_, child]: entry.children()) {
+    std::string childPath = path.empty() ? std::string(child->name) : path + '/' + std::string(child->name);
+    csvRow(csv, thread, "tree", childPath, *child, frameCount);
+    csvTree(csv, thread, childPath, *child, frameCount);
+  }
+}
+
+static const char* kindName(eValueKind kind) {
+  return kind == VALUE_COUNTER ? "counter" : "gauge";
+}
+
+static bool save(const fs::path& file, const std::string& content) {
+  fs::write(file, content.data(), content.size());
+  return fs::exists(file) && (size_t)fs::sizeOf(file) == content.size();
+}
+
+static void writeCapture(S<capture_t> data) {
+  u64 start = GetPerformanceCounter();
+  uint frameCount = data->frameCount;
+
+  json threads = json::array();
+  std::string csv = "thread,view,scope,calls,total_ms,self_ms,self_ms_per_frame,p50_ms,p90_ms,p99_ms,max_ms\n";
+  for(const capture_thread_t& thread: data->threads) {
+    json flat = json::array();
+    for(const auto& [_, entry]: thread.flat->self().children()) {
+      flat.push_back(entryJson(*entry, frameCount));
+      csvRow(csv, thread.name, "flat", entry->name, *entry, frameCount);
+    }
+    csvTree(csv, thread.name, "", thread.tree->self(), frameCount);
+
+    threads.push_back({
+      { "name", thread.name },
+      { "flat", std::move(flat) },
+      { "tree", treeJson(thread.tree->self(), frameCount) },
+    });
+  }
+
+  json values = json::array();
+  std::string valuesCsv = "name,kind,frames,total,mean,min,max,last\n";
+  for(const capture_value_t& value: data->values) {
+    double mean = value.total / value.frameCount;
+    values.push_back({
+      { "name", value.name },
+      { "kind", kindName(value.kind) },
+      { "frames", value.frameCount },
+      { "total", value.total },
+      { "mean", mean },
+      { "min", value.min },
+      { "max", value.max },
+      { "last", value.last },
+    });
+    valuesCsv += csvField(value.name);
+    valuesCsv += Stringf(",%s,%u,%.17g,%.17g,%.17g,%.17g,%.17g\n",
+                         kindName(value.kind), value.frameCount, value.total, mean, value.min, value.max, value.last);
+  }
+
+  const Histogram& frames = data->frameTimes;
+  json root = {
+    { "frames", frameCount },
+    { "frame_time", {
+      { "p50_ms", countToMs(frames.percentile(50.0)) },
+      { "p90_ms", countToMs(frames.percentile(90.0)) },
+      { "p99_ms", countToMs(frames.percentile(99.0)) },
+      { "max_ms", countToMs(frames.max()) },
+    } },
+    { "threads", std::move(threads) },
+    { "values", std::move(values) },
+  };
+
+  if(save(data->jsonFile, root.dump(2)) && save(data->csvFile, csv)
+     && (data->values.empty() || save(data->valuesCsvFile, valuesCsv))) {
+    Log::tagf("profiler", "capture: %u frames written to %s in %s",
+              frameCount, data->jsonFile.generic_string().c_str(),
+              beautifySeconds(PerformanceCountToSecond(GetPerformanceCounter() - start)).c_str());
+  } else {
+    Log::warnf("[profiler] capture: fail to write %s", data->jsonFile.generic_string().c_str());
+  }
+}
+
+// folds the frame which just ended, every thread of it, into the capture; on the main thread since frames are only
+// valid until the profiler records over them
+static void accumulateFrame(capture_t& data) {
+  u64 startHpc, endHpc;
+  if(!frameRange(1, 1, startHpc, endHpc) || startHpc == gCaptureLastHpc) return;
+  if(dump(1) == nullptr) return;
+  gCaptureLastHpc = startHpc;
+  data.frameCount++;
+  data.frameTimes.record(endHpc - startHpc);
+
+  for(const thread_info_t& info: threads()) {
+    Frame* frame = dump(1, info.lane);
+    if(frame == nullptr) continue;
+    auto thread = std::find_if(data.threads.begin(), data.threads.end(),
+                               [&info](const capture_thread_t& t) { return t.lane == info.lane; });
+    if(thread == data.threads.end()) {
+      thread = data.threads.insert(data.threads.end(), capture_thread_t{ info.lane, info.name });
+    }
+    thread->flat->accumlateSample(frame->root(), Report::VIEW_FLAT);
+    thread->tree->accumlateSample(frame->root(), Report::VIEW_TREE);
+  }
+
+  const std::vector<frame_value_t>* values = Profile::values(1);
+  if(values == nullptr) return;
+  for(const frame_value_t& value: *values) {
+    auto found = std::find_if(data.values.begin(), data.values.end(),
+                              [&value](const capture_value_t& v) { return v.name == value.name; });
+    if(found == data.values.end()) {
+      found = data.values.insert(data.values.end(), { value.name, value.kind, 0, 0, value.value, value.value });
+    }
+    found->frameCount++;
+    found->total += value.value;
+    found->min = std::min(found->min, value.value);
+    found->max = std::max(found->max, value.value);
+    found->last = value.value;
+  }
+}
+
+// hands the frames folded so far to CAT_IO and starts over
+static void capture() {
+  S<capture_t> data = std::move(gCapture);
+  gCapture.reset(new capture_t());
+  if(data == nullptr || data->frameCount == 0) return;
+
+  for(capture_thread_t& thread: data->threads) {
+    thread.flat->computePercentiles();
+    thread.tree->computePercentiles();
+  }
+
+  std::string name = gCapturePrefix.generic_string() + Stringf("_%u", gCaptureIndex++);
+  data->jsonFile = name + ".json";
+  data->csvFile = name + ".csv";
+  data->valuesCsvFile = name + "_values.csv";
+
+  gCaptureWrites.push_back(Job::dispatch({ &writeCapture, data }, Job::CAT_IO));
+}
+
+void Profile::startCapture(const fs::path& pathPrefix, uint frameInterval) {
+  if(capturing()) stopCapture();
+
+  fs::path dir = pathPrefix.parent_path();
+  if(!dir.empty() && !fs::exists(dir)) fs::createDir(dir);
+
+  gCapturePrefix = pathPrefix;
+  gCaptureInterval = std::max(frameInterval, 1u);
+  gCaptureFrames = 0;
+  gCaptureIndex = 0;
+  gCapture.reset(new capture_t());
+  // the frame in the history is older than the capture
+  u64 endHpc;
+  if(!frameRange(1, 1, gCaptureLastHpc, endHpc)) gCaptureLastHpc = 0;
+  Log::tagf("profiler", "capture: every %u frames to %s_<n>.json", gCaptureInterval, pathPrefix.generic_string().c_str());
+}
+
+void Profile::stopCapture() {
+  if(!capturing()) return;
+
+  capture();
+  gCapture.reset();
+  gCaptureInterval = 0;
+  gCaptureFrames = 0;
+
+  for(const Job::counter_ref_t& write: gCaptureWrites) {
+    Job::wait(write, 5);
+  }
+  gCaptureWrites.clear();
+}
+
+bool Profile::capturing() {
+  return gCaptureInterval != 0;
+}
+
+void Profile::detail::tickCapture() {
+  if(!capturing()) return;
+
+  gCaptureWrites.erase(
+    std::remove_if(gCaptureWrites.begin(), gCaptureWrites.end(), [](const Job::counter_ref_t& write) { return write->done(); }),
+    gCaptureWrites.end());
+
+  accumulateFrame(*gCapture);
+  if(++gCaptureFrames < gCaptureInterval) return;
+  capture();
+  gCaptureFrames = 0;
+}
+
+// (thread, scope) -> self time per frame, false if the file is not a capture
+static bool loadCapture(const fs::path& file, std::map<std::pair<std::string, std::string>, double>& selfTimes) {
+  Blob blob = fs::read(file);
+  if(!blob) {
+    Log::warnf("[profiler] diff: fail to read %s", file.generic_string().c_str());
+    return false;
+  }
+
+  std::string_view str(blob.as<const char*>(), blob.size());
+  json capture = json::parse(str.begin(), str.end(), nullptr, false);
+  if(capture.is_discarded() || !capture.is_object() || !capture["threads"].is_array()) {
+    Log::warnf("[profiler] diff: %s is not a profile capture", file.generic_string().c_str());
+    return false;
+  }
+
+  for(const json& thread: capture["threads"]) {
+    std::string name = thread.value("name", "");
+    if(!thread.count("flat")) continue;
+    for(const json& scope: thread["flat"]) {
+      selfTimes[{ name, scope.value("name", "") }] += scope.value("self_ms_per_frame", 0.0);
+    }
+  }
+  return true;
+}
+
+std::vector<capture_diff_t> Profile::diffCaptures(const fs::path& base, const fs::path& current, double thresholdPercent) {
+  std::map<std::pair<std::string, std::string>, double> baseTimes, currentTimes;
+  if(!loadCapture(base, baseTimes) || !loadCapture(current, currentTimes)) return {};
+
+  std::vector<capture_diff_t> regressions;
+  for(const auto& [key, currentMs]: currentTimes) {
+    auto found = baseTimes.find(key);
+    double baseMs = found == baseTimes.end() ? 0 : found->second;
+    if(baseMs < kDiffMinSelfMs && currentMs < kDiffMinSelfMs) continue;
+
+    // a scope the base never ran is infinitely slower
+    double change = baseMs > 0
+      ? (currentMs - baseMs) / baseMs * 100.0
+      : std::numeric_limits<double>::infinity();
+    if(change <= thresholdPercent) continue;
+
+    regressions.push_back({ key.first, key.second, baseMs, currentMs, change });
+  }
+
+  std::sort(regressions.begin(), regressions.end(), [](const capture_diff_t& a, const capture_diff_t& b) {
+    return a.changePercent > b.changePercent;
+  });
+  return regressions;
+}
+
+COMMAND_REG("profiler_capture", "path: string [interval: uint]", "write flat and tree reports of every thread to <path>_<n>.json/csv every few frames")(Command& cmd) {
+  std::string path = cmd.arg<0>();
+  uint interval = 600;
+  try {
+    interval = cmd.arg<1, uint>();
+  } catch(const ArgumentNotFoundException&) {}
+
+  startCapture(path, interval);
+  return true;
+}
+
+COMMAND_REG("profiler_capture_stop", "", "write the frames captured so far and stop capturing")(Command&) {
+  if(!capturing()) {
+    Log::warnf("[profiler] not capturing");
+    return false;
+  }
+  stopCapture();
+  return true;
+}
+
+COMMAND_REG("profiler_diff", "base: string current: string [threshold: float]", "print the scopes whose self time per frame regressed by more than threshold percent")(Command& cmd) {
+  std::string base = cmd.arg<0>();
+  std::string current = cmd.arg<1>();
+  float threshold = 10.f;
+  try {
+    threshold = cmd.arg<2, float>();
+  } catch(const ArgumentNotFoundException&) {}
+
+  std::vector<capture_diff_t> regressions = diffCaptures(base, current, threshold);
+  if(regressions.empty()) {
+    Log::logf("[profiler] diff: no scope regressed by more than %.1f%%", threshold);
+    return true;
+  }
+
+  Log::logf("%-24s%-48s%-14s%-14s%-10s", "Thread", "Scope", "Base(ms)", "Current(ms)", "Change");
+  for(const capture_diff_t& diff: regressions) {
+    std::string change = std::isinf(diff.changePercent) ? "new" : Stringf("+%.1f%%", diff.changePercent);
+    Log::warnf("%-24s%-48s%-14.4f%-14.4f%-10s",
+               diff.thread.c_str(), diff.scope.c_str(), diff.baseSelfMs, diff.currentSelfMs, change.c_str());
+  }
+  return true;
+}
@@ -0,0 +1,43 @@
+﻿#pragma once
+#include "Engine/Core/common.hpp"
+#include "Engine/File/Path.hpp"
+#include <string>
+#include <vector>
+
+/*
+ * headless profile capture, for runs nobody watches, eg. soak tests. Every `frameInterval` frames, and once more
+ * when the capture stops, the frames since the previous write fold into a flat and a tree report per thread,
+ * written as `<prefix>_<n>.json` and `<prefix>_<n>.csv`. Times are in milliseconds; self times are also given per frame
+ * so captures of different lengths compare. Counters and gauges go to the json and `<prefix>_<n>_values.csv`.
+ * Every frame folds into the reports on the main thread as it ends, so a write costs no more than the frames before it;
+ * formatting and writing run on CAT_IO.
+ *   Profile::startCapture("Log/profile/soak", 600);
+ *   ...
+ *   Profile::stopCapture();
+ *   for(auto& d: Profile::diffCaptures("base/soak_3.json", "Log/profile/soak_3.json", 10.0)) ...
+ */
+namespace Profile {
+  static constexpr double kDiffMinSelfMs = 0.01; // scopes below this self time per frame in both captures are noise
+
+  void startCapture(const fs::path& pathPrefix, uint frameInterval = 600);
+  // writes the frames captured since the last write, waits for every pending write
+  void stopCapture();
+  bool capturing();
+
+  struct capture_diff_t {
+    std::string thread;
+    std::string scope;
+    double baseSelfMs;    // self time per frame
+    double currentSelfMs;
+    double changePercent;
+  };
+
+  // flat scopes whose self time per frame grew by more than `thresholdPercent`, the worst first;
+  // empty as well when either file cannot be read, which is logged
+  std::vector<capture_diff_t> diffCaptures(const fs::path& base, const fs::path& current, double thresholdPercent);
+
+  namespace detail {
+    // frame boundary, Profile::markFrame calls it
+    void tickCapture();
+  }
+}
@@ -0,0 +1,68 @@
+﻿#include "Histogram.hpp"
+#include <algorithm>
+#include <cmath>
+
+using namespace Profile;
+
+// highest set bit, value != 0
+static uint log2Floor(u64 value) {
+  uint bit = 0;
+  while(value >>= 1) bit++;
+  return bit;
+}
+
+uint Histogram::bucketOf(u64 value) {
+  if(value < kSubBucketCount) return uint(value);
+  // the kSubBucketBits bits under the highest one pick the sub bucket
+  uint shift = log2Floor(value) - kSubBucketBits;
+  return kSubBucketCount * (shift + 1) + uint((value >> shift) & (kSubBucketCount - 1));
+}
+
+u64 Histogram::bucketMax(uint bucket) {
+  if(bucket < kSubBucketCount) return bucket;
+  uint shift = bucket / kSubBucketCount - 1;
+  u64 lowest = u64(kSubBucketCount + bucket % kSubBucketCount) << shift;
+  return lowest + ((u64(1) << shift) - 1);
+}
+
+void Histogram::record(u64 value, u64 count) {
+  if(count == 0) return;
+  uint bucket = bucketOf(value);
+  if(bucket >= mCounts.size()) mCounts.resize(bucket + 1, 0);
+  mCounts[bucket] += count;
+  mCount += count;
+  mMin = std::min(mMin, value);
+  mMax = std::max(mMax, value);
+}
+
+void Histogram::merge(const Histogram& other) {
+  if(other.mCount == 0) return;
+  if(other.mCounts.size() > mCounts.size()) mCounts.resize(other.mCounts.size(), 0);
+  for(size_t i = 0; i < other.mCounts.size(); i++) {
+    mCounts[i] += other.mCounts[i];
+  }
+  mCount += other.mCount;
+  mMin = std::min(mMin, other.mMin);
+  mMax = std::max(mMax, other.mMax);
+}
+
+void Histogram::clear() {
+  mCounts.clear();
+  mCount = 0;
+  mMin = ~u64(0);
+  mMax = 0;
+}
+
+u64 Histogram::percentile(double percent) const {
+  if(mCount == 0) return 0;
+
+  u64 rank = u64(std::ceil(std::clamp(percent, 0.0, 100.0) / 100.0 * double(mCount)));
+  rank = std::max<u64>(rank, 1);
+
+  u64 seen = 0;
+  for(uint bucket = 0; bucket < mCounts.size(); bucket++) {
+    seen += mCounts[bucket];
+    if(seen >= rank) return std::clamp(bucketMax(bucket), mMin, mMax);
+  }
+  return mMax;
+}
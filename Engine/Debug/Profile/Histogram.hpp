@@ -0,0 +1,41 @@
+﻿#pragma once
+#include "Engine/Core/common.hpp"
+#include <vector>
+
+namespace Profile {
+
+  /*
+   * log bucketed histogram of u64 values, HDR histogram style: a value goes to the bucket of its power of two,
+   * split into kSubBucketCount linear sub buckets, so a percentile is off by at most 1/kSubBucketCount of its value.
+   * Values below kSubBucketCount are exact. Counters only grow up to the biggest bucket recorded,
+   * frame times in performance counts need a few hundred of them.
+   *   Histogram frameTimes;
+   *   frameTimes.record(endHpc - startHpc);
+   *   u64 p99 = frameTimes.percentile(99.0);
+   */
+  class Histogram {
+  public:
+    static constexpr uint kSubBucketBits = 4;
+    static constexpr uint kSubBucketCount = 1u << kSubBucketBits;
+
+    void record(u64 value, u64 count = 1);
+    void merge(const Histogram& other);
+    void clear();
+
+    // the value `percent`% of the recorded values are less or equal to, rounded up to its bucket; 0 if empty
+    u64 percentile(double percent) const;
+    u64 count() const { return mCount; }
+    u64 min() const { return mCount == 0 ? 0 : mMin; }
+    u64 max() const { return mMax; }
+
+  protected:
+    static uint bucketOf(u64 value);
+    static u64 bucketMax(uint bucket);
+
+    std::vector<u64> mCounts;
+    u64 mCount = 0;
+    u64 mMin = ~u64(0);
+    u64 mMax = 0;
+  };
+
+}
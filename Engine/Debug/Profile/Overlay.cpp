@@ -1,147 +1,173 @@
 ﻿#include "Overlay.hpp"
 #include "Engine/Debug/Profile/Report.hpp"
 #include "Engine/Debug/Profile/Profiler.hpp"
-#include "Engine/Renderer/Geometry/Mesher.hpp"
-#include "Engine/Renderer/Renderer.hpp"
-#include "Engine/Application/Window.hpp"
-#include "Engine/Math/Primitives/AABB2.hpp"
-#include "Engine/Renderer/Font.hpp"
 #include "Engine/Debug/Console/Command.hpp"
+#include "Engine/Debug/Console/Console.hpp"
+#include "Engine/Gui/ImGui.hpp"
 #include "Engine/Input/Input.hpp"
-#include "Engine/Math/MathUtils.hpp"
+#include "Engine/Async/Job.hpp"
+#include "Engine/Memory/FrameAllocator.hpp"
+#include "Engine/Memory/MemTrack.hpp"
+#include <algorithm>
+#include <array>
 #include <stack>
-#define WM_CHAR                 0x0102
-#define WM_KEYDOWN              0x0100
-#define WM_KEYUP                0x0101
-#define JUST_KEYDOWN_STATE      0x80000000
-
-
-
-static const Rgba kBoundColor;
-static const Rgba kBackgroundColor;
-
 
 namespace Profile {
   class Overlay {
   public:
-    Overlay(aabb2 bound);
-
-    void onInput();
-
     Report::eViewOption viewType = Report::VIEW_TREE;
     Report::eSortOption sortType = Report::SORT_SELF_TIME;
+    std::string chartValue; // counter or gauge on the chart instead of the frame time, empty for the frame time
+
+    void onInput();
     void update();
-    void render() const;
-    void toggle() { mVisible = !mVisible; };
-    void toggle(bool visible) {
-      static bool mouseLocked = true;
-      if(visible) {
-        mouseLocked = Input::Get().isMouseLocked();
-        Input::Get().mouseLockCursor(false);
-      } else {
-        Input::Get().mouseLockCursor(mouseLocked);
-      }
-      mVisible = visible;
-    };
+    void toggle(bool visible);
     bool visible() const { return mVisible; }
-    static const float kFontSize;
-    static const Rgba  kFontColor;
-    static const Rgba  kFontHighlightColor;
-  protected:
 
+  protected:
     struct Chart {
-
-      //----------- Config ---------------
-      static const Rgba kBoundColor;
-      static const Rgba kBackgroundColor;
-
-      static const Gradient kChartFillColor;
-      static const Rgba kChartBorderColor;
-      static const Rgba kChartSelectedBlendColor;
-      static const Rgba kChartSelectedBorderColor;
-
       enum eSelectState {
         SELECT_CLEAR,
         SELECT_SELECTING,
         SELECT_SELECTED,
       };
-      //---------------------------------
-
-      Chart(Overlay& o) : overlay(o) {}
-
-      void onInput();
-      void update();
-      void render() const;
-      aabb2 bound;
-      Transform transform;
-      Range<float> xDataRange{ 0.f };
-      Range<float> yDataRange{ 0.f, (float)MAX_FRAME_RECORDED };
-      std::array<vec2, MAX_FRAME_RECORDED> data;
-      Overlay& overlay;
-      Mesh* graph = nullptr;
-      eSelectState selectState = SELECT_CLEAR;
-      Range<float> mSelectedRange{ 0 };
-      Range<uint> frameRange{ 0,0 };
-      vec2 PADDING{ 10.f };
 
+      void update(const std::string& value);
+      void draw(const std::string& label);
+      // frame offset of a bar, see Profile::dump
+      static uint frameOffset(uint index) { return MAX_FRAME_RECORDED - index; }
+
+      std::array<float, MAX_FRAME_RECORDED> data = {}; // the oldest frame first
+      float yMax = 0.f;
+      eSelectState selectState = SELECT_CLEAR;
+      uint selectBegin = 0; // bar indices
+      uint selectEnd = 0;
     };
 
-    aabb2 mBound;
+    void drawSummary();
+    void drawLanes();
+    void drawReport();
+
     Chart mChart;
-    Mesh* mText = nullptr;
-    Camera* mCamera = nullptr;
-    Transform mTransform;
     bool mVisible = false;
-    vec2 PADDING{ 10.f };
+    bool mMouseLocked = true;
   };
 
 }
 
 Profile::Overlay* gOverlay = nullptr;
 
-void Profile::initOverlay() {
-  EXPECTS(gOverlay == nullptr);
+// share of time the job workers spent parked, and how often they got woken, since the last call
+static std::string jobIdleSummary() {
+  static const char* kCategoryName[Job::NUM_CATEGORY] = { "Generic", "GenericSlow", "MainThread", "IO" };
+  static Job::idle_stats_t prevStats[Job::NUM_CATEGORY];
+  static u64 prevHpc = GetPerformanceCounter();
+
+  u64 now = GetPerformanceCounter();
+  double elapsed = PerformanceCountToSecond(now - prevHpc);
+  prevHpc = now;
+
+  std::string summary = "Job workers parked:";
+  for(Job::category_t cat = 0; cat < Job::NUM_CATEGORY; cat++) {
+    Job::idle_stats_t stats = Job::idleStats(cat);
+    if(stats.workerCount == 0) continue;
+
+    Job::idle_stats_t& prev = prevStats[cat];
+    double parked = elapsed > 0 ? (stats.parkedSeconds - prev.parkedSeconds) / (elapsed * stats.workerCount) : 0;
+    summary += Stringf("    %s %.0f%% (%llu wake-ups)", kCategoryName[cat], std::clamp(parked, 0.0, 1.0) * 100.0, stats.wakeups - prev.wakeups);
+    prev = stats;
+  }
+  return summary;
+}
 
-  gOverlay = new Profile::Overlay(Window::Get()->bounds());
+static std::string memoryTagSummary() {
+  std::string summary = "Memory:";
+  for(uint i = 0; i < NUM_MEMTAG; i++) {
+    Mem::tag_stats_t stats = Mem::stats(eMemTag(i));
+    summary += Stringf("    %s %.1f KB", Mem::tagName(eMemTag(i)), double(stats.liveBytes) / 1024.0);
+    if(stats.budget != 0) summary += Stringf(" / %.0f KB%s", double(stats.budget) / 1024.0, stats.liveBytes > int64(stats.budget) ? " (over)" : "");
+  }
+  return summary;
 }
 
-const Rgba     Profile::Overlay::Chart::kBoundColor = Rgba(255, 255, 255, 255);
-const Rgba     Profile::Overlay::Chart::kBackgroundColor = Rgba(0, 0, 0, 128);
-const Gradient Profile::Overlay::Chart::kChartFillColor = { Rgba(0, 255, 0, 255), Rgba(255, 0, 0, 255) };
-const Rgba     Profile::Overlay::Chart::kChartBorderColor = Rgba::white;
-const Rgba     Profile::Overlay::Chart::kChartSelectedBlendColor = Rgba(0, 0, 200, 50);
-const Rgba     Profile::Overlay::Chart::kChartSelectedBorderColor = Rgba(0, 0, 255, 200);
+// stable color of a scope name, names are recorded by pointer so the pointer is enough
+static ImU32 laneColor(const char* id) {
+  u64 hash = u64(uintptr_t(id)) * 0x9E3779B97F4A7C15ull;
+  return IM_COL32(96 + (hash >> 56) % 160, 96 + (hash >> 48) % 160, 96 + (hash >> 40) % 160, 220);
+}
 
-const float Profile::Overlay::kFontSize = 16.f;
-const Rgba  Profile::Overlay::kFontColor = Rgba(180, 180, 180, 255);
-const Rgba  Profile::Overlay::kFontHighlightColor = Rgba(255, 255, 255, 255);
+// counters and gauges of the last frame, the charted one in brackets
+static std::string frameValueSummary(const std::string& charted) {
+  std::string summary = charted.empty() ? "Values ('C' to chart):" : "Values:";
+  const std::vector<Profile::frame_value_t>* values = Profile::values(1);
+  if(values == nullptr) return summary;
+  for(const Profile::frame_value_t& value: *values) {
+    summary += Stringf(charted == value.name ? "    [%s %.6g]" : "    %s %.6g", value.name, value.value);
+  }
+  return summary;
+}
 
-Profile::Overlay::Overlay(aabb2 bound): mBound(bound), mChart(*this) {
+static std::string frameMemorySummary() {
+  FrameAllocator::stats_t stats = FrameAllocator::get().stats();
+  return Stringf("Frame memory: last %.1f KB    peak %.1f KB    reserved %.1f KB",
+                 double(stats.lastFrameBytes) / 1024.0, double(stats.peakFrameBytes) / 1024.0, double(stats.reservedBytes) / 1024.0);
+}
 
-  mBound.maxs -= 2 * PADDING;
-  vec2 containerSize = mBound.size();
+void Profile::initOverlay() {
+  EXPECTS(gOverlay == nullptr);
 
-  mTransform.localTranslate(vec3(PADDING, 0.f));
-  mChart.transform.parent() = &mTransform;
-  mChart.transform.localTranslate({ vec2(0, containerSize.y * 0.8f), 0.f });
+  gOverlay = new Profile::Overlay();
+}
 
-  mChart.bound = aabb2{ {0, 0}, { containerSize.x, containerSize.y*.2f } };
-  aabb2 bounds = Window::Get()->bounds();
-  mCamera = new Camera();
-  mCamera->setProjection(mat44::ortho(0, bounds.width(), 0, bounds.height(), -1.f, 1.f));
-  mCamera->setColorTarget(Renderer::Get()->getDefaultColorTarget());
+void Profile::Overlay::toggle(bool visible) {
+  if(visible == mVisible) return;
+  if(visible) {
+    mMouseLocked = Input::Get().isMouseLocked();
+    Input::Get().mouseLockCursor(false);
+  } else {
+    Input::Get().mouseLockCursor(mMouseLocked);
+  }
+  mVisible = visible;
 }
 
 void Profile::Overlay::onInput() {
   if (!mVisible) return;
   if (Input::Get().isKeyJustDown('V')) {
-    gOverlay->viewType = gOverlay->viewType ==
-      Profile::Report::VIEW_TREE ? Profile::Report::VIEW_FLAT : Profile::Report::VIEW_TREE;
+    viewType = viewType == Report::VIEW_TREE ? Report::VIEW_FLAT : Report::VIEW_TREE;
   }
 
   if (Input::Get().isKeyJustDown('L')) {
-    gOverlay->sortType = gOverlay->sortType ==
-      Profile::Report::SORT_TOTAL_TIME ? Profile::Report::SORT_SELF_TIME : Profile::Report::SORT_TOTAL_TIME;
+    // total -> self -> p99 -> cycles per call, when the counters are on
+    switch(sortType) {
+      case Report::SORT_TOTAL_TIME:
+        sortType = Report::SORT_SELF_TIME;
+      break;
+      case Report::SORT_SELF_TIME:
+        sortType = Report::SORT_P99_TIME;
+      break;
+      case Report::SORT_P99_TIME:
+        sortType = countersEnabled() ? Report::SORT_CYCLES_PER_CALL : Report::SORT_TOTAL_TIME;
+      break;
+      default:
+        sortType = Report::SORT_TOTAL_TIME;
+    }
+  }
+
+  if (Input::Get().isKeyJustDown('C')) {
+    // frame time -> every counter and gauge of the last frame, by name -> frame time
+    const std::vector<frame_value_t>* frameValues = values(1);
+    std::string next;
+    if(frameValues != nullptr && !frameValues->empty()) {
+      auto current = std::find_if(frameValues->begin(), frameValues->end(), [this](const frame_value_t& value) {
+        return chartValue == value.name;
+      });
+      if(chartValue.empty()) {
+        next = frameValues->front().name;
+      } else if(current != frameValues->end() && current + 1 != frameValues->end()) {
+        next = (current + 1)->name;
+      }
+    }
+    chartValue = next;
   }
 
   if (Input::Get().isKeyJustDown('M')) {
@@ -151,59 +177,105 @@ void Profile::Overlay::onInput() {
       Input::Get().mouseLockCursor(!locked);
     }
   }
-
-  mChart.onInput();
 }
 
 void Profile::Overlay::update() {
   if (!mVisible) return;
 
-  std::array<Report*, MAX_FRAME_RECORDED> reports{ nullptr };
-
-  mChart.yDataRange.mins = 0;
-  mChart.yDataRange.maxs = 0;
-  for(uint i = 1; i<= MAX_FRAME_RECORDED; i++) {
-    prof_sample_t* sample = dump(i);
-
-    uint drawIndex = MAX_FRAME_RECORDED - i;
-    Report*& report = reports[drawIndex];
-    report = (sample == nullptr) ? nullptr : &sample->dump(viewType);
+  mChart.update(chartValue);
 
-    mChart.data[drawIndex].y = (report==nullptr)
-                        ? 0.f
-                        : (float)report->totalFrameTime();
+  ImGui::SetNextWindowSize({ 1280.f, 720.f }, ImGuiCond_FirstUseEver);
+  ImGui::SetNextWindowBgAlpha(.85f);
+  bool open = true;
+  if(ImGui::Begin("Profiler", &open)) {
+    drawSummary();
+    mChart.draw(chartValue.empty() ? "frame time" : chartValue);
+    drawLanes();
+    drawReport();
+  }
+  ImGui::End();
 
-    mChart.data[drawIndex].x = (float)drawIndex;
-    mChart.yDataRange.grow(mChart.data[drawIndex].y);
+  if(!open) toggle(false);
+}
 
+void Profile::Overlay::drawSummary() {
+  // averages hide stutters, the percentiles of the recorded frames do not
+  if(Frame* frame = dump(1)) {
+    Histogram frameTimes = frameHistogram();
+    ImGui::Text("FPS: %.2lf    Frame time: %s    p50 %s  p90 %s  p99 %s  max %s",
+      1.0 / frame->elapsedTime(),
+      beautifySeconds(frame->elapsedTime()).c_str(),
+      beautifySeconds(PerformanceCountToSecond(frameTimes.percentile(50.0))).c_str(),
+      beautifySeconds(PerformanceCountToSecond(frameTimes.percentile(90.0))).c_str(),
+      beautifySeconds(PerformanceCountToSecond(frameTimes.percentile(99.0))).c_str(),
+      beautifySeconds(PerformanceCountToSecond(frameTimes.max())).c_str());
   }
-  // update other params for chart;
-  mChart.update();
-
-  // update the report view
+  ImGui::TextUnformatted(jobIdleSummary().c_str());
+  ImGui::TextUnformatted(frameMemorySummary().c_str());
+  ImGui::TextUnformatted(memoryTagSummary().c_str());
+  ImGui::TextUnformatted(frameValueSummary(chartValue).c_str());
+  ImGui::TextDisabled("'V' tree/flat    'L' sort    'C' chart a value    drag over the chart to pause on frames, right click to go on");
+}
 
-  // sort all report
-  // for(Report* report: reports) {
-  //   if(report) report->sort(sortType);
-  // }
+// a lane per thread with the top level scopes of the last frame, laid across the frame time
+void Profile::Overlay::drawLanes() {
+  constexpr float kLaneNameWidth = 160.f;
+
+  ImDrawList* draw = ImGui::GetWindowDrawList();
+  float laneHeight = ImGui::GetTextLineHeight();
+  float laneWidth = std::max(ImGui::GetContentRegionAvailWidth() - kLaneNameWidth, 1.f);
+  ImVec2 mouse = ImGui::GetMousePos();
+
+  for(const thread_info_t& thread: threads()) {
+    Frame* frame = dump(1, thread.lane);
+    if(frame == nullptr) continue;
+
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImGui::TextUnformatted(thread.name.c_str());
+    ImVec2 laneMin = { origin.x + kLaneNameWidth, origin.y };
+    ImVec2 laneMax = { laneMin.x + laneWidth, origin.y + laneHeight };
+    draw->AddRectFilled(laneMin, laneMax, IM_COL32(0, 0, 0, 128));
+
+    double frameHpc = double(frame->endHpc() - frame->startHpc());
+    for(const prof_sample_t* sample = frame->root()->children(); sample != nullptr; sample = sample->prev()) {
+      float start = laneMin.x + float(double(sample->starHpc - frame->startHpc()) / frameHpc) * laneWidth;
+      float end = std::max(laneMin.x + float(double(sample->endHpc - frame->startHpc()) / frameHpc) * laneWidth, start + 1.f);
+      draw->AddRectFilled({ start, laneMin.y }, { end, laneMax.y }, laneColor(sample->id));
+      if(mouse.x >= start && mouse.x < end && mouse.y >= laneMin.y && mouse.y < laneMax.y) {
+        ImGui::SetTooltip("%s    %s", sample->id, beautifySeconds(sample->elapsedTime()).c_str());
+      }
+    }
+  }
+}
 
+void Profile::Overlay::drawReport() {
+  Report selected;
   Report* report = nullptr;
   if(mChart.selectState == Chart::SELECT_CLEAR) {
-    report = reports[MAX_FRAME_RECORDED - 1];
+    Frame* frame = dump(1);
+    report = frame == nullptr ? nullptr : &frame->report(viewType);
   } else {
-    report = (Report*)_alloca(sizeof(Report));
-    report = new(report) Report();
-
-    for(uint i = mChart.frameRange.mins; i <= mChart.frameRange.maxs; i++) {
-      prof_sample_t* sample = dump(MAX_FRAME_RECORDED - i);
-      if(sample != nullptr) report->accumlateSample(sample, viewType);
+    uint first = std::min(mChart.selectBegin, mChart.selectEnd);
+    uint last = std::max(mChart.selectBegin, mChart.selectEnd);
+    for(uint i = first; i <= last; i++) {
+      Frame* frame = dump(Chart::frameOffset(i));
+      if(frame != nullptr) selected.accumlateSample(frame->root(), viewType);
     }
+    selected.computePercentiles();
+    report = &selected;
   }
+  if(report == nullptr) return;
+  report->sort(sortType);
 
-  if (report) report->sort(sortType);
-
-  Mesher ms;
-  ms.begin(DRAW_TRIANGES);
+  ImGui::Separator();
+  ImGui::TextUnformatted(Stringf(
+    "[ ]%-*s%-10s%-25s%-25s%-25s%-25s%-25s%-25s",
+    57, "Function Name", "Call",
+    sortType == Report::SORT_TOTAL_TIME ? "--Total(Time)--" : "Total(Time)",
+    sortType == Report::SORT_SELF_TIME ? "--Self(Time)--" : "Self(Time)",
+    "Average Total Time", "Average Self Time",
+    sortType == Report::SORT_P99_TIME ? "--P99(Time)--" : "P99(Time)",
+    sortType == Report::SORT_CYCLES_PER_CALL ? "--Cycles/Call--" : "Cycles/Call").c_str());
 
   struct Iter {
     const Report::Entry* entry = nullptr;
@@ -211,206 +283,103 @@ void Profile::Overlay::update() {
   };
 
   std::stack<Iter> toProcess;
-  auto font = Font::Default();
-
-  float lingHeight = font->lineHeight(kFontSize);
-  float lineStep = -lingHeight;
-  vec3 position(vec2(mBound.mins.x, mBound.maxs.y * .8f - font->ascender(kFontSize) - PADDING.y), 0.f);
-  
-  if(reports[MAX_FRAME_RECORDED - 1] != nullptr) {
-    toProcess.push({ &report->self(), 0 });
-    ms.text(
-      Stringf("FPS: %.2lf    Frame time: %s ", 
-      1.0 / reports[MAX_FRAME_RECORDED - 1]->self().totalTime, 
-      beautifySeconds(reports[MAX_FRAME_RECORDED - 1]->self().totalTime).c_str()),
-      18, font.get(), vec3(PADDING, 0));
-  }
+  toProcess.push({ &report->self(), 0 });
 
-  ms.color(kFontColor);
-  ms.text(Stringf(
-    "[ ]%-*s%-10s%-25s%-25s%-25s%-25s", 
-    57, "Function Name", "Call", 
-    sortType == Report::SORT_TOTAL_TIME ? "--Total(Time)--" : "Total(Time)",
-    sortType == Report::SORT_SELF_TIME ? "--Self(Time)--" : "Self(Time)",
-    "Average Total Time", "Average Self Time"),
-    kFontSize, font.get(), position);
-  position.y += lineStep;
+  ImGui::BeginChild("report");
   while(!toProcess.empty()) {
-    Iter& top = toProcess.top();
-    uint currentDepth = top.depth;
-
-    // char str[1000];
-    // sprintf_s(str, 1000, "%s", top.entry->name.data());
-
-    // vec3 indentedPosition = position;
-    // indentedPosition.x += font->advance(' ', ' ', kFontSize) * float(top.depth) ;
+    Iter top = toProcess.top();
+    toProcess.pop();
 
-    std::string text = Stringf(
-      "%-*s%-*s%-10u%-25s%-25s%-25s%-25s", 
-      top.depth+3, top.entry->children().empty() ? "   " : "[-]", 
-      57 - top.depth, top.entry->name.data(), 
-      top.entry->callCount, 
-      beautifySeconds(top.entry->totalTime).c_str(), 
+    ImGui::TextUnformatted(Stringf(
+      "%-*s%-*s%-10u%-25s%-25s%-25s%-25s%-25s%-25.0f",
+      top.depth + 3, top.entry->children().empty() ? "   " : "[-]",
+      57 - top.depth, top.entry->name.data(),
+      top.entry->callCount,
+      beautifySeconds(top.entry->totalTime).c_str(),
       beautifySeconds(top.entry->selfTime).c_str(),
       beautifySeconds(top.entry->totalTimeAveragePerCall).c_str(),
-      beautifySeconds(top.entry->selfTimeAveragePerCall).c_str());
-
-    ms.text(text, kFontSize, font.get(), position);
-
-    position.y += lineStep;
-    toProcess.pop();
+      beautifySeconds(top.entry->selfTimeAveragePerCall).c_str(),
+      beautifySeconds(top.entry->p99Time).c_str(),
+      top.entry->cyclesPerCall).c_str());
 
     for(auto& [_, v]: top.entry->children()) {
       EXPECTS(v != nullptr);
-      toProcess.push({ v, currentDepth + 1 });
+      toProcess.push({ v, top.depth + 1 });
     }
   }
-
-
-  ms.end();
-
-  SAFE_DELETE(mText);
-  mText = ms.createMesh<vertex_pcu_t>();
-  
+  ImGui::EndChild();
 }
 
-void Profile::Overlay::render() const {
-  if (!mVisible) return;
-  // set ui solid material
-  // draw background, container
-
-  Renderer::Get()->setCamera(mCamera);
-  Renderer::Get()->setModelMatrix(mat44::identity);
-
-  Renderer::Get()->setMaterial(Resource<Material>::get("material/ui/default").get());
-  // Renderer::Get()->drawAABB2({ Input::Get().mouseClientPositon(), Input::Get().mouseClientPositon()+ vec2(5.f) }, Rgba::red);
-  Renderer::Get()->drawAABB2(Window::Get()->bounds(), Rgba(0, 0, 128, 128));
-  // Renderer::Get()->drawAABB2(mBound, Rgba::yellow, false);
-  mChart.render();
-
-  // set ui text material
-  Renderer::Get()->setModelMatrix(mTransform.localToWorld());
-  Renderer::Get()->setMaterial(Resource<Material>::get("material/ui/font").get());
-  Renderer::Get()->drawMesh(*mText);
+void Profile::Overlay::Chart::update(const std::string& value) {
+  yMax = 0.f;
+  // oldest first, a frame carries the gauges of the one before
+  for(uint i = 0; i < data.size(); i++) {
+    uint offset = frameOffset(i);
+    data[i] = 0.f;
+    if(value.empty()) {
+      u64 startHpc, endHpc;
+      if(frameRange(offset, offset, startHpc, endHpc)) data[i] = (float)PerformanceCountToSecond(endHpc - startHpc);
+    } else if(const std::vector<frame_value_t>* frameValues = values(offset)) {
+      for(const frame_value_t& frameValue: *frameValues) {
+        if(value == frameValue.name) data[i] = (float)frameValue.value;
+      }
+    }
+    yMax = std::max(yMax, data[i]);
+  }
 }
 
-void Profile::Overlay::Chart::onInput() {
-  vec2 mousePosition = Input::Get().mouseClientPositon();
-  mousePosition.y = Window::Get()->bounds().height() - mousePosition.y;
-  vec2 positionInChart = (transform.worldToLocal() * vec4(mousePosition, 0, 1)).xy();
-
-  switch(selectState) { 
-    case SELECT_CLEAR: {
-      if (bound.contains(positionInChart)) {
-        positionInChart.x = clamp(positionInChart.x, 0.f, bound.width());
-        mSelectedRange.mins = positionInChart.x;
-        mSelectedRange.maxs = positionInChart.x + .1f;
-        if (Input::Get().isKeyJustDown(MOUSE_LBUTTON)) {
-          Profile::pause();
-          selectState = SELECT_SELECTING;
-        }
-      } else {
-        mSelectedRange.mins = mSelectedRange.maxs;
+void Profile::Overlay::Chart::draw(const std::string& label) {
+  ImVec2 size = { ImGui::GetContentRegionAvailWidth(), 120.f };
+  ImVec2 min = ImGui::GetCursorScreenPos();
+  ImVec2 max = { min.x + size.x, min.y + size.y };
+  ImGui::PlotHistogram("##chart", data.data(), int(data.size()), 0, label.c_str(), 0.f, yMax > 0.f ? yMax : 1.f, size);
+
+  // an invisible button over the chart takes the mouse, so dragging selects frames instead of moving the window
+  ImGui::SetCursorScreenPos(min);
+  ImGui::InvisibleButton("##chart_select", size);
+  float x = (ImGui::GetMousePos().x - min.x) / std::max(size.x, 1.f);
+  uint index = std::min(uint(std::clamp(x, 0.f, 1.f) * float(data.size())), uint(data.size() - 1));
+
+  switch(selectState) {
+    case SELECT_CLEAR:
+      if(ImGui::IsItemActive()) {
+        Profile::pause();
+        selectBegin = selectEnd = index;
+        selectState = SELECT_SELECTING;
       }
-    }
     break;
-    case SELECT_SELECTING: {
-      positionInChart.x = clamp(positionInChart.x, 0.f, bound.width());
-      mSelectedRange.maxs = positionInChart.x;
-      if(Input::Get().isKeyJustUp(MOUSE_LBUTTON)) {
-        if (mSelectedRange.size() < .1f && mSelectedRange.size() > -.1f) {
-          mSelectedRange.maxs = mSelectedRange.mins + 1.f;
-        }
-        selectState = SELECT_SELECTED;
-      }
-    }
+    case SELECT_SELECTING:
+      selectEnd = index;
+      if(!ImGui::IsItemActive()) selectState = SELECT_SELECTED;
     break;
-    case SELECT_SELECTED: {
-      if(Input::Get().isKeyJustDown(MOUSE_RBUTTON)) {
+    case SELECT_SELECTED:
+      if(ImGui::IsItemHovered() && ImGui::IsMouseClicked(1)) {
         Profile::resume();
         selectState = SELECT_CLEAR;
       }
-    }
     break;
     default: ;
   }
-  
-}
-
-void Profile::Overlay::Chart::update() {
-  Mesher ms;
-
-  std::array<vec3, MAX_FRAME_RECORDED> dataToDraw;
 
-  float stepSize = bound.width() / MAX_FRAME_RECORDED;
-
-  for(uint i = 0; i<data.size(); i++) {
-    dataToDraw[i].x = data[i].x * stepSize;
-    dataToDraw[i].z = data[i].y / yDataRange.size(); // use z to cache the precent
-    dataToDraw[i].y = data[i].y / yDataRange.size() * bound.height();
-
-    ENSURES(yDataRange.size() == 0 || dataToDraw[i].z <= 1.f);
-  }
-  // ----- draw graph filled color ----- 
-  // bound
-  ms.begin(DRAW_TRIANGES);
-  ms.color(kBackgroundColor);
-  ms.quad2(bound);
-
-  // draw bar
-
-  if(yDataRange.size() != 0.f) {
-    float heightStandard = (1.f / 5.f) / yDataRange.size() * bound.height();
-    for(const vec3& d: dataToDraw) {
-      ms.color(kChartFillColor.evaluate(d.y / heightStandard));
-      ms.quad2({ {d.x, 0}, {d.x + stepSize, d.y} });
-    }
+  if(selectState != SELECT_CLEAR) {
+    float step = size.x / float(data.size());
+    ImVec2 selectMin = { min.x + step * float(std::min(selectBegin, selectEnd)), min.y };
+    ImVec2 selectMax = { min.x + step * float(std::max(selectBegin, selectEnd) + 1), max.y };
+    ImGui::GetWindowDrawList()->AddRectFilled(selectMin, selectMax, IM_COL32(0, 0, 200, 50));
+    ImGui::GetWindowDrawList()->AddRect(selectMin, selectMax, IM_COL32(0, 0, 255, 200));
+  } else if(ImGui::IsItemHovered()) {
+    ImGui::SetTooltip("%u frames ago: %.6g", frameOffset(index), data[index]);
   }
-
-  float min = std::min(mSelectedRange.mins, mSelectedRange.maxs);
-  float max = std::max(mSelectedRange.mins, mSelectedRange.maxs);
-
-  frameRange.mins = uint(min / (bound.width() / (float)MAX_FRAME_RECORDED));
-  frameRange.maxs = uint(max / (bound.width() / (float)MAX_FRAME_RECORDED));
-  if(mSelectedRange.size() != 0) {
-    ms.color(kChartSelectedBlendColor);
-    ms.quad2({ { min, 0 }, { max, bound.height() } });
-  }
-    // ms.quad2()
-  ms.end();
-
-  // ----- draw borders ----- 
-  ms.begin(DRAW_LINES);
-  ms.color(kBoundColor);
-  ms.quad2(bound);
-
-  if (mSelectedRange.size() != 0) {
-    ms.color(kChartSelectedBorderColor);
-    ms.quad2({ { min, 0 },{ max, bound.height() } });
-  }
-  ms.end();
-
-  SAFE_DELETE(graph);
-
-  graph = ms.createMesh<vertex_pcu_t>();
-}
-
-void Profile::Overlay::Chart::render() const {
-  Renderer::Get()->setMaterial(Resource<Material>::get("material/ui/default").get());
-  Renderer::Get()->setModelMatrix(transform.localToWorld());
-  Renderer::Get()->drawMesh(*graph);
 }
 
 void Profile::updateOverlay() {
+  if(gOverlay == nullptr) return;
   gOverlay->onInput();
   gOverlay->update();
 }
 
-void Profile::renderOverlay() {
-  gOverlay->render();
-}
-
 COMMAND_REG("profiler", "bool: 1/0/true/false", "toggle profiler display") (Command& cmd){
+  if(gOverlay == nullptr) return false;
   gOverlay->toggle(cmd.arg<0, bool>());
   return true;
-}
\ No newline at end of file
+}
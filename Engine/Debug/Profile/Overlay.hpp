@@ -1,18 +1,12 @@
 ﻿#pragma once
 #include "Engine/Core/common.hpp"
-#include "Engine/Debug/Profile/Report.hpp"
-#include "Engine/Math/Primitives/AABB2.hpp"
-#include "Engine/Math/Range.hpp"
-#include "Engine/Core/Gradient.hpp"
-#include "Engine/Debug/Profile/Profiler.hpp"
-#include "Engine/Renderer/Renderable/Renderable.hpp"
-#include "Engine/Math/Primitives/mat44.hpp"
-#include "Engine/Math/Transform.hpp"
 
+/*
+ * profiler window, drawn through ImGui: frame time chart, per-thread lanes of the last frame and the scope report.
+ * Toggled by the `profiler` command. Engine::init creates it, Application updates it between
+ * ImGui::beginFrame and ImGui::render.
+ */
 namespace Profile {
-  class Report;
-
-  void updateOverlay();
-  void renderOverlay();
   void initOverlay();
+  void updateOverlay();
 }
@@ -1,73 +1,119 @@
 #include "Profiler.hpp"
-#include "Engine/Core/Time/Clock.hpp"
-#include <stack>
+#include "Engine/Debug/Profile/StackSampler.hpp"
+#include "Engine/Debug/Profile/Capture.hpp"
 #include "Engine/Debug/Console/Console.hpp"
-#include "Engine/Debug/Profile/Overlay.hpp"
 #include "Engine/Debug/Console/Command.hpp"
+#include "Engine/Debug/ChromeTrace.hpp"
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#define WIN32_LEAN_AND_MEAN		// Always #define this before #including <windows.h>
+#include <windows.h>
 
 using namespace Profile;
+using Profile::detail::event_t;
+using Profile::detail::thread_stream_t;
+using Profile::detail::value_event_t;
+
+static std::atomic<bool> gPause = false;
+static std::atomic<bool> gCountersRequested = false;
 
-bool gPause = false;
+thread_local thread_stream_t* Profile::detail::tStream = nullptr;
+std::atomic<bool> Profile::detail::gRecording = false;
+std::atomic<bool> Profile::detail::gCounting = false;
 
 namespace Profile {
+  struct trace_export_t;
 
+  /*
+   * owns the event streams of every thread and the frames built from them.
+   * Streams are never freed: the stream of a thread which exits goes to the next new thread, with its lane.
+   */
   class Profiler {
   public:
-    void push(const char* id);
-    void pop();
-    void begin();
-
-    prof_sample_t* query(uint frameOffsetFromCurrent) {
-      EXPECTS(frameOffsetFromCurrent <= MAX_FRAME_RECORDED);
-      return (frameOffsetFromCurrent > prevStack.size()) 
-        ? nullptr : prevStack[prevStack.size() - frameOffsetFromCurrent];
-    }
+    struct frame_range_t {
+      u64 startHpc = 0;
+      u64 endHpc = 0;
+      bool counted = false; // every event of the frame has its cycle count
+    };
 
-    bool toggle(bool toPause) { toBePaused = toPause; return toBePaused; }
-  protected:
-    static void destorySampleTreeRecursive(prof_sample_t* prevStack);
-
-    struct SampleBuffer {
-      operator prof_sample_t*() const {
-        return buffer[index];
-      };
-
-      void operator=(prof_sample_t* rhs) {
-        index = (index+1) % MAX_FRAME_RECORDED;
-        if (buffer[index]) {
-          destorySampleTreeRecursive(buffer[index]);
-        }
-        buffer[index] = rhs;
-      }
+    struct stream_info_t {
+      thread_stream_t* stream = nullptr;
+      std::string name;
+      bool retired = false;
+    };
 
-      prof_sample_t* operator[](uint idx) const {
-        EXPECTS(index <= size());
-        uint vIndex = size() < MAX_FRAME_RECORDED ? idx : (index + 1 + idx) % MAX_FRAME_RECORDED;
-        return buffer[vIndex];
-      }
+    thread_stream_t& acquireStream(const std::string& name);
+    void retireStream(thread_stream_t* stream);
+    void nameStream(thread_stream_t* stream, const char* name);
+    void allocateCycleBuffers();
+    std::vector<thread_info_t> threads();
 
-      uint size() const {
-        return buffer[(index + 1) % MAX_FRAME_RECORDED] == nullptr ? index : MAX_FRAME_RECORDED;
-      }
+    void markFrame();
+    Frame* query(uint frameOffsetFromCurrent, uint lane);
+    const std::vector<frame_value_t>* queryValues(uint frameOffsetFromCurrent);
+    uint mainLane() const { return mMainStream == nullptr ? 0 : mMainStream->lane; }
+    bool frameRange(uint oldestFrameOffset, uint newestFrameOffset, u64& startHpc, u64& endHpc) const;
+    Histogram frameHistogram(uint frameCount) const;
+    bool collectTrace(trace_export_t& data, uint oldestFrameOffset, uint newestFrameOffset);
 
-      ~SampleBuffer() {
-        for (prof_sample_t* sample : buffer) {
-          destorySampleTreeRecursive(sample);
-        }
-      }
-    protected:
-      uint index = MAX_FRAME_RECORDED - 1;
-      prof_sample_t* buffer[MAX_FRAME_RECORDED] = { nullptr };
-    };
+  protected:
+    bool copyEvents(const thread_stream_t& stream, u64 startHpc, u64 endHpc,
+                    std::vector<event_t>& events, std::vector<u64>* cycles = nullptr) const;
+    static void buildTree(Frame& frame, const frame_range_t& range,
+                          const std::vector<event_t>& events, const std::vector<u64>& cycles);
+    bool copyValues(const thread_stream_t& stream, u64 startHpc, u64 endHpc, bool seedGauges,
+                    std::vector<frame_value_t>& values, std::vector<u64>& setHpc) const;
+
+    std::mutex mStreamLock;
+    std::vector<stream_info_t> mStreams; // indexed by lane
+    bool mCycleBuffers = false;          // counters were turned on once, every stream has its cycle buffer since
+
+    // only touched by the main thread, the one calling markFrame
+    thread_stream_t* mMainStream = nullptr;
+    uint mFrameCount = 0;              // frames completed, the frame in progress is `mFrameCount`
+    // the frame in progress has a slot of its own, so the last MAX_FRAME_RECORDED completed frames all stay whole
+    static constexpr uint kFrameSlot = MAX_FRAME_RECORDED + 1;
+    frame_range_t mFrames[kFrameSlot];
+    std::map<std::pair<uint, uint>, U<Frame>> mBuiltFrames; // by frame, lane
+    std::map<uint, std::vector<frame_value_t>> mBuiltValues; // by frame
+  };
+
+  struct trace_lane_t {
+    uint lane;
+    std::string name;
+    int sortIndex;
+    std::vector<event_t> events;
+  };
 
-    prof_sample_t* stack = nullptr;
-    SampleBuffer prevStack;
-    bool toBePaused = false;
-    bool isPaused = false;
+  struct trace_export_t {
+    fs::path file;
+    uint firstFrame = 0;
+    std::vector<Profiler::frame_range_t> frames;
+    std::vector<std::vector<frame_value_t>> values; // by frame, empty when overwritten
+    std::vector<trace_lane_t> lanes;
   };
 }
 
+static Profiler gProfiler;
 
+// scopes in destructors of other thread locals at thread exit are not recorded
+static thread_local bool tExited = false;
+
+// the stream is only acquired on the first event, a thread named early keeps its name until then
+struct stream_owner_t {
+  thread_stream_t* stream = nullptr;
+  std::string name;
+  ~stream_owner_t() {
+    tExited = true;
+    Profile::detail::tStream = nullptr;
+    if(stream != nullptr) gProfiler.retireStream(stream);
+  }
+};
+
+static thread_local stream_owner_t sOwner;
 
 void prof_sample_t::addChild(prof_sample_t* ps) {
   if(mChildren == nullptr) {
@@ -79,177 +125,509 @@ void prof_sample_t::addChild(prof_sample_t* ps) {
   mChildren = ps;
 }
 
-void prof_sample_t::finish() {
-  endHpc = GetPerformanceCounter();
-}
-
 double prof_sample_t::elapsedTime() const {
   return PerformanceCountToSecond(endHpc - starHpc);
 }
 
-owner<prof_sample_t*> prof_sample_t::create(const char* id) {
-  prof_sample_t* sample = new prof_sample_t;
+Report& Frame::report(Report::eViewOption view) {
+  U<Report>& report = mReports[view];
+  if(!report) {
+    report.reset(new Report());
+    report->fromSample(mSamples.data(), view);
+  }
+  return *report;
+}
+
+thread_stream_t* Profile::detail::acquireStream() {
+  if(tExited) return nullptr;
+  sOwner.stream = &gProfiler.acquireStream(sOwner.name);
+  tStream = sOwner.stream;
+  return tStream;
+}
 
-  strcpy_s(sample->id, id);
-  sample->starHpc = GetPerformanceCounter();
+thread_stream_t& Profiler::acquireStream(const std::string& name) {
+  std::scoped_lock lock(mStreamLock);
+  stream_info_t* info = nullptr;
+  for(stream_info_t& i: mStreams) {
+    if(i.retired) {
+      info = &i;
+      break;
+    }
+  }
+  if(info == nullptr) {
+    info = &mStreams.emplace_back();
+    info->stream = new thread_stream_t();
+    info->stream->lane = uint(mStreams.size() - 1);
+    if(mCycleBuffers) info->stream->cycles.store(new u64[kEventPerThread], std::memory_order_release);
+  }
 
-  return sample;
+  info->stream->openDepth = 0;
+  // `written` and `valuesWritten` go on: the events of the thread before stay in the frames it ran in,
+  // and a reader copying them sees the overwrite by the new thread as it sees any other
+  info->retired = false;
+  info->name = name.empty() ? Stringf("Thread %u", info->stream->lane) : name;
+  return *info->stream;
 }
 
-Report& prof_sample_t::dump(Report::eViewOption view) {
-  if (!mReport) {
-    mReport = Report();
-    mReport->fromSample(this, view);
+void Profiler::retireStream(thread_stream_t* stream) {
+  std::scoped_lock lock(mStreamLock);
+  mStreams[stream->lane].retired = true;
+}
+
+void Profiler::nameStream(thread_stream_t* stream, const char* name) {
+  std::scoped_lock lock(mStreamLock);
+  mStreams[stream->lane].name = name;
+}
+
+void Profiler::allocateCycleBuffers() {
+  std::scoped_lock lock(mStreamLock);
+  mCycleBuffers = true;
+  for(stream_info_t& info: mStreams) {
+    if(info.stream->cycles.load(std::memory_order_relaxed) != nullptr) continue;
+    info.stream->cycles.store(new u64[kEventPerThread], std::memory_order_release);
   }
+}
 
-  return mReport.value();
+std::vector<thread_info_t> Profiler::threads() {
+  std::vector<thread_info_t> threads;
+  std::scoped_lock lock(mStreamLock);
+  for(const stream_info_t& info: mStreams) {
+    if(info.retired) continue;
+    threads.push_back({ info.stream->lane, info.name });
+  }
+  uint mainLane = this->mainLane();
+  std::stable_partition(threads.begin(), threads.end(), [mainLane](const thread_info_t& t) { return t.lane == mainLane; });
+  return threads;
 }
 
-Profiler* gProfiler;
+void Profiler::markFrame() {
+  if(mMainStream == nullptr) {
+    if(sOwner.name.empty()) nameThread("Main");
+    mMainStream = detail::tStream != nullptr ? detail::tStream : detail::acquireStream();
+  }
+  EXPECTS(mMainStream == detail::tStream);
+
+  u64 now = GetPerformanceCounter();
+  if(detail::gRecording.load(std::memory_order_relaxed)) {
+    mFrames[mFrameCount % kFrameSlot].endHpc = now;
+    mFrameCount++;
+    if(mFrameCount > MAX_FRAME_RECORDED) {
+      uint expired = mFrameCount - MAX_FRAME_RECORDED - 1;
+      mBuiltFrames.erase(mBuiltFrames.lower_bound({ expired, 0 }), mBuiltFrames.lower_bound({ expired + 1, 0 }));
+      mBuiltValues.erase(expired);
+    }
+  }
 
-void Profile::startup() {
-#ifdef PROFILER_ENABLED
-  gProfiler = new Profiler();
-  initOverlay();
-#endif
+  bool recording = !gPause.load(std::memory_order_relaxed);
+  bool counting = recording && gCountersRequested.load(std::memory_order_relaxed);
+  if(counting && !detail::gCounting.load(std::memory_order_relaxed)) allocateCycleBuffers();
+  if(recording) {
+    mFrames[mFrameCount % kFrameSlot].startHpc = now;
+    mFrames[mFrameCount % kFrameSlot].counted = counting;
+  }
+  detail::gCounting.store(counting, std::memory_order_relaxed);
+  detail::gRecording.store(recording, std::memory_order_relaxed);
 }
 
-prof_sample_t* Profile::dump(uint frameOffsetFromCurrent) {
-#ifdef PROFILER_ENABLED
+Frame* Profiler::query(uint frameOffsetFromCurrent, uint lane) {
   EXPECTS(frameOffsetFromCurrent <= MAX_FRAME_RECORDED);
+  if(frameOffsetFromCurrent == 0 || frameOffsetFromCurrent > mFrameCount || mMainStream == nullptr) return nullptr;
 
-  return gProfiler->query(frameOffsetFromCurrent);
-#else
-  return nullptr;
-#endif
+  uint index = mFrameCount - frameOffsetFromCurrent;
+  auto built = mBuiltFrames.find({ index, lane });
+  if(built != mBuiltFrames.end()) return built->second.get();
+
+  thread_stream_t* stream;
+  {
+    std::scoped_lock lock(mStreamLock);
+    if(lane >= mStreams.size()) return nullptr;
+    stream = mStreams[lane].stream;
+  }
+
+  const frame_range_t& range = mFrames[index % kFrameSlot];
+  std::vector<event_t> events;
+  std::vector<u64> cycles;
+  if(!copyEvents(*stream, range.startHpc, range.endHpc, events, range.counted ? &cycles : nullptr)) return nullptr;
+
+  Frame* frame = new Frame();
+  frame->mIndex = index;
+  frame->mLane = lane;
+  buildTree(*frame, range, events, cycles);
+  mBuiltFrames[{ index, lane }].reset(frame);
+  return frame;
 }
 
-void Profile::push(const char* id) {
-#ifdef PROFILER_ENABLED
-  gProfiler->push(id);
-#endif
+// counters add up, the gauge set last wins whichever thread set it
+static void addValue(std::vector<frame_value_t>& values, std::vector<u64>& setHpc,
+                     const char* name, eValueKind kind, double value, u64 hpc) {
+  for(size_t i = 0; i < values.size(); i++) {
+    // the same literal can have a different address in every translation unit
+    if(values[i].name != name && strcmp(values[i].name, name) != 0) continue;
+    if(values[i].kind == VALUE_COUNTER) {
+      values[i].value += value;
+    } else if(hpc >= setHpc[i]) {
+      values[i].value = value;
+      setHpc[i] = hpc;
+    }
+    return;
+  }
+  values.push_back({ name, kind, value });
+  setHpc.push_back(hpc);
 }
 
-void Profile::pop() {
-#ifdef PROFILER_ENABLED
-  gProfiler->pop();
-#endif
+const std::vector<frame_value_t>* Profiler::queryValues(uint frameOffsetFromCurrent) {
+  EXPECTS(frameOffsetFromCurrent <= MAX_FRAME_RECORDED);
+  if(frameOffsetFromCurrent == 0 || frameOffsetFromCurrent > mFrameCount || mMainStream == nullptr) return nullptr;
+
+  uint index = mFrameCount - frameOffsetFromCurrent;
+  auto built = mBuiltValues.find(index);
+  if(built != mBuiltValues.end()) return &built->second;
+
+  std::vector<frame_value_t> values;
+  std::vector<u64> setHpc; // when each gauge got its value
+  // what the previous frame knew carries over, counters start from 0 again
+  auto previous = index == 0 ? mBuiltValues.end() : mBuiltValues.find(index - 1);
+  if(previous != mBuiltValues.end()) {
+    for(const frame_value_t& value: previous->second) {
+      values.push_back({ value.name, value.kind, value.kind == VALUE_COUNTER ? 0.0 : value.value });
+      setHpc.push_back(0);
+    }
+  }
+
+  const frame_range_t& range = mFrames[index % kFrameSlot];
+  {
+    std::scoped_lock lock(mStreamLock);
+    for(const stream_info_t& info: mStreams) {
+      // a thread missing values would make the sums lie, no values at all then
+      if(!copyValues(*info.stream, range.startHpc, range.endHpc, previous == mBuiltValues.end(), values, setHpc)) {
+        return nullptr;
+      }
+    }
+  }
+
+  std::sort(values.begin(), values.end(), [](const frame_value_t& a, const frame_value_t& b) {
+    return strcmp(a.name, b.name) < 0;
+  });
+  return &(mBuiltValues[index] = std::move(values));
 }
 
-void Profile::markFrame() {
-#ifdef PROFILER_ENABLED
-  gProfiler->toggle(gPause);
-  gProfiler->begin();
-#endif
+// `seedGauges` also picks the gauges set before the range which are still in the stream
+bool Profiler::copyValues(const thread_stream_t& stream, u64 startHpc, u64 endHpc, bool seedGauges,
+                          std::vector<frame_value_t>& values, std::vector<u64>& setHpc) const {
+  u64 written = stream.valuesWritten.load(std::memory_order_acquire);
+  u64 oldest = written > kValuePerThread ? written - kValuePerThread : 0;
+
+  u64 first = oldest, last = written;
+  while(first < last) {
+    u64 mid = first + (last - first) / 2;
+    if(stream.values[mid & (kValuePerThread - 1)].hpc < startHpc) {
+      first = mid + 1;
+    } else {
+      last = mid;
+    }
+  }
+  if(first == oldest && oldest != 0) return false;
+
+  u64 scanned = first;
+  if(seedGauges) {
+    while(scanned > oldest) {
+      const value_event_t& event = stream.values[--scanned & (kValuePerThread - 1)];
+      if(event.kind == VALUE_GAUGE) addValue(values, setHpc, event.name, event.kind, event.value, event.hpc);
+    }
+  }
+
+  for(u64 i = first; i < written; i++) {
+    const value_event_t& event = stream.values[i & (kValuePerThread - 1)];
+    if(event.hpc >= endHpc) break;
+    addValue(values, setHpc, event.name, event.kind, event.value, event.hpc);
+  }
+
+  // see copyEvents
+  u64 writtenAfter = stream.valuesWritten.load(std::memory_order_acquire);
+  return writtenAfter < scanned + kValuePerThread;
 }
 
-void Profile::pause() {
-  gPause = true;
+bool Profiler::copyEvents(const thread_stream_t& stream, u64 startHpc, u64 endHpc,
+                          std::vector<event_t>& events, std::vector<u64>* cycles) const {
+  const u64* streamCycles = cycles == nullptr ? nullptr : stream.cycles.load(std::memory_order_acquire);
+  u64 written = stream.written.load(std::memory_order_acquire);
+  u64 oldest = written > kEventPerThread ? written - kEventPerThread : 0;
+
+  // events of a thread are in time order, find the first one of the range
+  u64 first = oldest, last = written;
+  while(first < last) {
+    u64 mid = first + (last - first) / 2;
+    if(stream.events[mid & (kEventPerThread - 1)].hpc < startHpc) {
+      first = mid + 1;
+    } else {
+      last = mid;
+    }
+  }
+  // the beginning of the range is overwritten already
+  if(first == oldest && oldest != 0) return false;
+
+  // scopes still open when the range starts, eg. a job running across the frame boundary, begin with the range
+  std::vector<const char*> open;
+  uint depth = 0;
+  u64 scanned = first;
+  while(scanned > oldest && first - scanned < kOpenScopeScan) {
+    const event_t& event = stream.events[--scanned & (kEventPerThread - 1)];
+    if(event.id == nullptr) {
+      depth++;
+    } else if(depth > 0) {
+      depth--;
+    } else {
+      open.push_back(event.id);
+    }
+  }
+  for(auto id = open.rbegin(); id != open.rend(); ++id) {
+    events.push_back({ startHpc, *id });
+  }
+
+  for(u64 i = first; i < written; i++) {
+    const event_t& event = stream.events[i & (kEventPerThread - 1)];
+    if(event.hpc >= endHpc) break;
+    events.push_back(event);
+    if(streamCycles != nullptr) cycles->push_back(streamCycles[i & (kEventPerThread - 1)]);
+  }
+  if(streamCycles != nullptr) {
+    // the count of scopes opened before the range starts with the range's first event
+    cycles->insert(cycles->begin(), open.size(), cycles->empty() ? 0 : cycles->front());
+  }
+
+  // the thread kept writing while we copied, drop the copy if it wrapped over the range;
+  // event `writtenAfter` may be half written already, in the slot of `writtenAfter - kEventPerThread`
+  u64 writtenAfter = stream.written.load(std::memory_order_acquire);
+  return writtenAfter < scanned + kEventPerThread;
 }
 
-void Profile::resume() {
-  gPause = false;
+bool Profiler::frameRange(uint oldestFrameOffset, uint newestFrameOffset, u64& startHpc, u64& endHpc) const {
+  if(newestFrameOffset == 0 || oldestFrameOffset < newestFrameOffset || mMainStream == nullptr
+     || oldestFrameOffset > std::min(mFrameCount, MAX_FRAME_RECORDED)) {
+    return false;
+  }
+  startHpc = mFrames[(mFrameCount - oldestFrameOffset) % kFrameSlot].startHpc;
+  endHpc = mFrames[(mFrameCount - newestFrameOffset) % kFrameSlot].endHpc;
+  return true;
 }
 
-void Profiler::begin() {
+Histogram Profiler::frameHistogram(uint frameCount) const {
+  Histogram histogram;
+  frameCount = std::min({ frameCount, mFrameCount, MAX_FRAME_RECORDED });
+  for(uint offset = 1; offset <= frameCount; offset++) {
+    const frame_range_t& range = mFrames[(mFrameCount - offset) % kFrameSlot];
+    histogram.record(range.endHpc - range.startHpc);
+  }
+  return histogram;
+}
 
-  if (stack != nullptr) {
-    // ...
-    prevStack = stack;
+bool Profiler::collectTrace(trace_export_t& data, uint oldestFrameOffset, uint newestFrameOffset) {
+  u64 startHpc, endHpc;
+  if(!frameRange(oldestFrameOffset, newestFrameOffset, startHpc, endHpc)) return false;
 
-    pop();
+  data.firstFrame = mFrameCount - oldestFrameOffset;
+  for(uint index = data.firstFrame; index <= mFrameCount - newestFrameOffset; index++) {
+    data.frames.push_back(mFrames[index % kFrameSlot]);
+    const std::vector<frame_value_t>* values = queryValues(mFrameCount - index);
+    data.values.push_back(values == nullptr ? std::vector<frame_value_t>() : *values);
+  }
+  // frames are not contiguous across a pause, nothing is recorded in between
+  std::scoped_lock lock(mStreamLock);
+  uint mainLane = this->mainLane();
+  for(const stream_info_t& info: mStreams) {
+    trace_lane_t lane { info.stream->lane, info.name, info.stream->lane == mainLane ? 0 : int(info.stream->lane) + 1 };
+    // a lane overwritten since the range started loses the whole range, a half lane would be misleading
+    if(!copyEvents(*info.stream, startHpc, endHpc, lane.events)) {
+      Log::warnf("[profiler] export: events of %s are overwritten already", info.name.c_str());
+      lane.events.clear();
+    }
+    if(!lane.events.empty() || !info.retired) data.lanes.push_back(std::move(lane));
+  }
+  return true;
+}
 
-    ENSURES(stack == nullptr);
+void Profiler::buildTree(Frame& frame, const frame_range_t& range,
+                         const std::vector<event_t>& events, const std::vector<u64>& cycles) {
+  size_t sampleCount = 1;
+  for(const event_t& event: events) {
+    if(event.id != nullptr) sampleCount++;
+  }
+  // reserved up front, samples link to each other by pointer
+  frame.mSamples.reserve(sampleCount);
+
+  prof_sample_t* current = &frame.mSamples.emplace_back();
+  current->id = "__Frame__";
+  current->starHpc = range.startHpc;
+  current->endHpc = range.endHpc;
+
+  // `cycles` of an open scope holds the count at its begin
+  bool counted = !events.empty() && cycles.size() == events.size();
+  auto elapsedCycles = [](u64 begin, u64 end) { return end > begin ? end - begin : 0; };
+
+  for(size_t i = 0; i < events.size(); i++) {
+    const event_t& event = events[i];
+    if(event.id != nullptr) {
+      prof_sample_t* sample = &frame.mSamples.emplace_back();
+      sample->id = event.id;
+      sample->starHpc = event.hpc;
+      sample->endHpc = range.endHpc; // still open when the frame ends
+      sample->cycles = counted ? cycles[i] : 0;
+      sample->mParent = current;
+      current->addChild(sample);
+      current = sample;
+    } else if(current->mParent != nullptr) {
+      current->endHpc = event.hpc;
+      if(counted) current->cycles = elapsedCycles(current->cycles, cycles[i]);
+      current = current->mParent;
+    }
+    // an end without its begin closes a scope opened before the frame, nothing to link it to
   }
 
-  if (isPaused != toBePaused) {
-    isPaused = toBePaused;
-    if (isPaused) return;
+  if(!counted) return;
+  // scopes still open when the frame ends count up to its last event
+  for(; current->mParent != nullptr; current = current->mParent) {
+    current->cycles = elapsedCycles(current->cycles, cycles.back());
   }
+  current->cycles = elapsedCycles(cycles.front(), cycles.back());
+}
 
-  push("__Frame__");
+bool Profile::frameRange(uint oldestFrameOffset, uint newestFrameOffset, u64& startHpc, u64& endHpc) {
+  return gProfiler.frameRange(oldestFrameOffset, newestFrameOffset, startHpc, endHpc);
 }
 
-void Profiler::pop() {
-  if (isPaused) return;
-  ENSURES(stack != nullptr);
-  stack->finish();
-  stack = stack->mParent;
+Histogram Profile::frameHistogram(uint frameCount) {
+  return gProfiler.frameHistogram(frameCount);
 }
 
-void Profiler::destorySampleTreeRecursive(prof_sample_t* prevStack) {
-  if (prevStack == nullptr) return;
-  std::stack<prof_sample_t*> pending;
+Frame* Profile::dump(uint frameOffsetFromCurrent) {
+  return gProfiler.query(frameOffsetFromCurrent, gProfiler.mainLane());
+}
+
+Frame* Profile::dump(uint frameOffsetFromCurrent, uint lane) {
+  return gProfiler.query(frameOffsetFromCurrent, lane);
+}
 
-  pending.push(prevStack);
+const std::vector<frame_value_t>* Profile::values(uint frameOffsetFromCurrent) {
+  return gProfiler.queryValues(frameOffsetFromCurrent);
+}
+
+std::vector<thread_info_t> Profile::threads() {
+  return gProfiler.threads();
+}
+
+void Profile::nameThread(const char* name) {
+  detail::registerSampledThread(name);
+  sOwner.name = name;
+  if(sOwner.stream != nullptr) gProfiler.nameStream(sOwner.stream, name);
+}
+
+static void writeTrace(S<trace_export_t> data) {
+  u64 start = GetPerformanceCounter();
+  u64 endHpc = data->frames.back().endHpc;
+
+  ChromeTrace trace(data->frames.front().startHpc);
+  trace.processName(0, "Profiler");
+  for(size_t i = 0; i < data->frames.size(); i++) {
+    trace.instant(0, Stringf("Frame %u", data->firstFrame + (uint)i).c_str(), data->frames[i].startHpc);
+    for(const frame_value_t& value: data->values[i]) {
+      trace.counter(0, value.name, data->frames[i].startHpc, value.value);
+    }
+  }
 
-  while(!pending.empty()) {
-    prof_sample_t* top = pending.top();
-    if(top->mChildren) {
-      prof_sample_t* head = top->mChildren;
-      while(head != nullptr) {
-        pending.push(head);
-        head = head->mPrev;
+  // begins and ends pair up like in buildTree, scopes still open at the end of the range are cut there
+  std::vector<const event_t*> open;
+  uint scopeCount = 0;
+  for(const trace_lane_t& lane: data->lanes) {
+    trace.threadName(0, lane.lane, lane.name.c_str(), lane.sortIndex);
+    for(const event_t& event: lane.events) {
+      if(event.id != nullptr) {
+        open.push_back(&event);
+      } else if(!open.empty()) {
+        trace.complete(0, lane.lane, open.back()->id, "Profile", open.back()->hpc, event.hpc);
+        open.pop_back();
+        scopeCount++;
       }
-      top->mChildren = nullptr;
-      continue;
-    } else {
-      delete top;
-      pending.pop();
+    }
+    while(!open.empty()) {
+      trace.complete(0, lane.lane, open.back()->id, "Profile", open.back()->hpc, endHpc);
+      open.pop_back();
+      scopeCount++;
     }
   }
-}
 
-void Profiler::push(const char* id) {
-  if (isPaused) return;
-  prof_sample_t* measure = prof_sample_t::create(id);
-  if (stack == nullptr) {
-    stack = measure;
+  if(trace.save(data->file)) {
+    Log::tagf("profiler", "trace: %u frames, %u scopes written to %s in %s",
+              (uint)data->frames.size(), scopeCount,
+              data->file.generic_string().c_str(),
+              beautifySeconds(PerformanceCountToSecond(GetPerformanceCounter() - start)).c_str());
   } else {
-    measure->mParent = stack;
-    stack->addChild(measure);
-    stack = measure;
+    Log::warnf("[profiler] trace: fail to write %s", data->file.generic_string().c_str());
   }
 }
 
+Job::counter_ref_t Profile::exportTrace(const fs::path& file, uint oldestFrameOffset, uint newestFrameOffset) {
+  S<trace_export_t> data(new trace_export_t());
+  data->file = file;
+  if(!gProfiler.collectTrace(*data, oldestFrameOffset, newestFrameOffset)) return nullptr;
+  return Job::dispatch({ &writeTrace, data }, Job::CAT_IO);
+}
 
-template<typename T>
-class PageAllocator {
-  struct llp_t {
-    // llp_t* prev;
-    llp_t* next;
-  };
-
-public:
-  T* allocate() {
-    llp_t* head = mFreeList;
-    if(head == nullptr) {
-      allocateBlock();
-      head = mFreeList;
-    } else {
-      // LLP_REMOVE(mFreeList, head);
-      mFreeList = mFreeList->next;
-    }
+void Profile::markFrame() {
+#ifdef PROFILER_ENABLED
+  gProfiler.markFrame();
+  detail::tickCapture();
+#endif
+}
 
-    T* obj = new (head) T();
-    return obj;
+open_scopes_t Profile::suspendScopes() {
+  open_scopes_t scopes;
+  thread_stream_t* stream = detail::tStream;
+  if(stream == nullptr || stream->openDepth == 0) return scopes;
+
+  scopes.count = stream->openDepth;
+  uint named = std::min(scopes.count, kMaxOpenScope);
+  std::copy_n(stream->open, named, scopes.ids);
+  // only the scopes whose push was recorded get their end
+  for(uint i = named; i-- > 0;) {
+    if((stream->openRecorded >> i & 1) != 0) detail::record(stream, nullptr);
   }
+  stream->openDepth = 0;
+  return scopes;
+}
 
-  void destroy(T* obj) {
-    obj->~T();
-    llp_t* iter = (llp_t*)obj;
+void Profile::resumeScopes(const open_scopes_t& scopes) {
+  if(scopes.count == 0) return;
+  thread_stream_t* stream = detail::tStream;
+  if(stream == nullptr) return;
 
-    LLP_APPEND(mFreeList, iter);
-    iter->next = mFreeList;
-    mFreeList->next = iter;
+  // the scopes open again as pushed now, recorded if recording is on
+  bool recording = detail::gRecording.load(std::memory_order_relaxed);
+  for(uint i = 0; i < scopes.count; i++) {
+    detail::open(stream, i < kMaxOpenScope ? scopes.ids[i] : nullptr, recording);
   }
+}
 
-  llp_t* createBlock() {
-    return (llp_t*)malloc(sizeof(T));
-  }
-protected:
-  llp_t* mFreeList;
-};
+u64 Profile::detail::threadCycles() {
+  ULONG64 cycles = 0;
+  ::QueryThreadCycleTime(::GetCurrentThread(), &cycles);
+  return cycles;
+}
+
+void Profile::enableCounters(bool enabled) {
+  gCountersRequested = enabled;
+}
+
+bool Profile::countersEnabled() {
+  return gCountersRequested;
+}
+
+void Profile::pause() {
+  gPause = true;
+}
+
+void Profile::resume() {
+  gPause = false;
+}
 
 COMMAND_REG("profiler_pause", "", "pause the profiler")(Command&) {
   Profile::pause();
@@ -261,16 +639,152 @@ COMMAND_REG("profiler_resume", "", "resume the profiler")(Command&) {
   return true;
 }
 
-COMMAND_REG("profiler_report", "eViewOption: flat|tree", "print the last frame report")(Command& cmd) {
+COMMAND_REG("profiler_counters", "enabled: bool", "count the CPU cycles of every profiled scope")(Command& cmd) {
+  bool enabled = cmd.arg<0, bool>();
+  Profile::enableCounters(enabled);
+  Log::logf("[profiler] cycle counters %s from the next frame", enabled ? "on" : "off");
+  return true;
+}
+
+COMMAND_REG("profiler_report", "eViewOption: flat|tree [sort: total|self|p99|cycles]", "print the last frame report, the largest first")(Command& cmd) {
+  Frame* frame = dump(1);
+  if(frame == nullptr) {
+    Log::warnf("[profiler] no frame recorded");
+    return false;
+  }
+
+  Report::eViewOption view;
   if (cmd.arg<0>() == "flat") {
-    dump(1)->dump(Report::VIEW_FLAT).log(Report::VIEW_FLAT);
-    return true;
+    view = Report::VIEW_FLAT;
+  } else if (cmd.arg<0>() == "tree") {
+    view = Report::VIEW_TREE;
+  } else {
+    throw InvalidArgumentException(0);
+  }
+
+  Report::eSortOption sort = Report::SORT_TOTAL_TIME;
+  try {
+    std::string option = cmd.arg<1>();
+    if(option == "total") {
+      sort = Report::SORT_TOTAL_TIME;
+    } else if(option == "self") {
+      sort = Report::SORT_SELF_TIME;
+    } else if(option == "p99") {
+      sort = Report::SORT_P99_TIME;
+    } else if(option == "cycles") {
+      sort = Report::SORT_CYCLES_PER_CALL;
+      if(!countersEnabled()) Log::warnf("[profiler] cycles are 0 until `profiler_counters 1`");
+    } else {
+      throw InvalidArgumentException(1);
+    }
+  } catch(const ArgumentNotFoundException&) {}
+
+  Report& report = frame->report(view);
+  report.sort(sort);
+  report.log(view);
+  return true;
+}
+
+COMMAND_REG("profiler_worst", "[count: uint][frames: uint]", "print the scopes with the worst p99 time over the recorded frames")(Command& cmd) {
+  uint count = 10;
+  uint frameCount = MAX_FRAME_RECORDED;
+  try {
+    count = std::max(1u, cmd.arg<0, uint>());
+    frameCount = std::clamp(cmd.arg<1, uint>(), 1u, MAX_FRAME_RECORDED);
+  } catch(const ArgumentNotFoundException&) {}
+
+  // every thread together, a job scope is the same scope whichever worker ran it
+  Report report;
+  uint frameUsed = 0;
+  for(const thread_info_t& thread: threads()) {
+    for(uint offset = 1; offset <= frameCount; offset++) {
+      Frame* frame = dump(offset, thread.lane);
+      if(frame == nullptr) continue;
+      report.accumlateSample(frame->root(), Report::VIEW_FLAT);
+      frameUsed++;
+    }
+  }
+  if(frameUsed == 0) {
+    Log::warnf("[profiler] no frame recorded");
+    return false;
+  }
+  report.computePercentiles();
+
+  Histogram frames = frameHistogram(frameCount);
+  Log::logf("[profiler] %llu frames: p50 %s  p90 %s  p99 %s  max %s",
+            frames.count(),
+            beautifySeconds(PerformanceCountToSecond(frames.percentile(50.0))).c_str(),
+            beautifySeconds(PerformanceCountToSecond(frames.percentile(90.0))).c_str(),
+            beautifySeconds(PerformanceCountToSecond(frames.percentile(99.0))).c_str(),
+            beautifySeconds(PerformanceCountToSecond(frames.max())).c_str());
+
+  std::vector<const Report::Entry*> entries;
+  for(const auto& [_, entry]: report.self().children()) {
+    entries.push_back(entry);
+  }
+  std::sort(entries.begin(), entries.end(), [](const Report::Entry* a, const Report::Entry* b) {
+    return a->p99Time > b->p99Time;
+  });
+  entries.resize(std::min<size_t>(entries.size(), count));
+
+  Log::logf("%-48s%-10s%-16s%-16s%-16s%-16s", "Scope", "Call", "P50", "P90", "P99", "Max");
+  for(const Report::Entry* entry: entries) {
+    Log::logf("%-48.*s%-10u%-16s%-16s%-16s%-16s",
+              (int)entry->name.size(), entry->name.data(), entry->callCount,
+              beautifySeconds(entry->p50Time).c_str(), beautifySeconds(entry->p90Time).c_str(),
+              beautifySeconds(entry->p99Time).c_str(), beautifySeconds(entry->maxTime).c_str());
+  }
+  return true;
+}
+
+COMMAND_REG("profiler_threads", "", "print the busy time of every profiled thread in the last frame")(Command&) {
+  for(const thread_info_t& thread: threads()) {
+    Frame* frame = dump(1, thread.lane);
+    if(frame == nullptr) {
+      Log::logf("[profiler] %-24s no events for the frame", thread.name.c_str());
+      continue;
+    }
+    double busy = 0;
+    uint scopeCount = 0;
+    for(const prof_sample_t* sample = frame->root()->children(); sample != nullptr; sample = sample->prev()) {
+      busy += sample->elapsedTime();
+      scopeCount++;
+    }
+    Log::logf("[profiler] %-24s busy %s of %s in %u top level scopes",
+              thread.name.c_str(), beautifySeconds(busy).c_str(), beautifySeconds(frame->elapsedTime()).c_str(), scopeCount);
   }
-  if (cmd.arg<0>() == "tree") {
-    dump(1)->dump(Report::VIEW_TREE).log(Report::VIEW_TREE);
-    return true;
+  return true;
+}
+
+COMMAND_REG("profiler_export", "[frames: uint][file: string]", "write the last few frames of every thread as Chrome trace json")(Command& cmd) {
+  uint frameCount = 1;
+  std::string file = "profile.trace.json";
+  try {
+    frameCount = std::max(1u, cmd.arg<0, uint>());
+    file = cmd.arg<1>();
+  } catch(const ArgumentNotFoundException&) {}
+
+  if(exportTrace(file, frameCount, 1) == nullptr) {
+    Log::warnf("[profiler] trace: the last %u frames are not recorded", frameCount);
+    return false;
   }
-  throw InvalidArgumentException(0);
+  return true;
+}
 
-  return false;
-}
\ No newline at end of file
+// benchmark: cost of an empty instrumented scope, recording on; `profiler_counters true` first to time it with counters
+COMMAND_REG("profiler_bench", "", "time 1M empty profiled scopes")(Command&) {
+  constexpr uint kRound = 1000000;
+  bool recording = Profile::detail::gRecording.exchange(true);
+
+  u64 start = GetPerformanceCounter();
+  for(uint i = 0; i < kRound; i++) {
+    PROF_SCOPE("profiler_bench");
+  }
+  double elapsed = PerformanceCountToSecond(GetPerformanceCounter() - start);
+
+  Profile::detail::gRecording.store(recording);
+  Log::logf("[profiler_bench] %u scopes in %s, %.1f ns per scope, counters %s",
+            kRound, beautifySeconds(elapsed).c_str(), elapsed * 1e9 / double(kRound),
+            Profile::detail::gCounting.load() ? "on" : "off");
+  return true;
+}
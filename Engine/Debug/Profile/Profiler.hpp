@@ -1,20 +1,53 @@
 #pragma once
 #include "Engine/Core/common.hpp"
 #include "Engine/Debug/Profile/Report.hpp"
-#include <optional>
+#include "Engine/Debug/Profile/Histogram.hpp"
 #include "Engine/Debug/Draw.hpp"
 #include "Engine/Debug/Log.hpp"
 #include "Engine/Config.hpp"
 #include "Engine/Core/Time/Time.hpp"
+#include "Engine/Async/Job.hpp"
+#include "Engine/File/Path.hpp"
+#include <atomic>
+#include <string>
+#include <vector>
 
+/*
+ * instrumented profiler. A scope records two fixed size events, a begin with its name and an end, into a ring
+ * owned by the thread; recording takes no lock and allocates nothing once the thread has its ring.
+ * Names are kept by pointer: pass string literals or __FUNCTION__, never a temporary string.
+ * A job waiting on another fiber closes its open scopes until it runs again, see Job::wait, so the scopes of a thread
+ * always nest even when jobs interleave on it.
+ * Frame trees and reports are only built from the events when someone reads a frame, eg. the overlay or `profiler_report`.
+ * Every thread has its own tree for a frame, threads are named by CurrentThread::setName.
+ * With counters on, a scope also reads the CPU cycles its thread ran for; that costs a system call per event.
+ * Numbers to plot per frame go through the same stream: PROF_COUNTER adds to the frame total, eg. draw calls,
+ * PROF_GAUGE sets a level kept until set again, eg. live objects. Both take a string literal name.
+ *   PROF_SCOPE("ForwardRendering::pass::light");
+ *   PROF_COUNTER("draw calls", 1);
+ *   Profile::Frame* frame = Profile::dump(1);
+ *   frame->report(Report::VIEW_FLAT).log(Report::VIEW_FLAT);
+ *   for(const Profile::thread_info_t& thread: Profile::threads()) Profile::dump(1, thread.lane);
+ *   Profile::exportTrace("frames.trace.json", 8);
+ */
 namespace Profile {
+  static constexpr uint MAX_FRAME_RECORDED = 1024u;
+  static constexpr uint kEventPerThread = 65536u; // power of two, 1 MB of events per thread
+  static constexpr uint kOpenScopeScan = 4096u;   // how far back a frame looks for scopes still open when it starts
+  static constexpr uint kValuePerThread = 4096u;  // power of two, counter and gauge values kept per thread
+  static constexpr uint kMaxOpenScope = 64u;      // scope names a thread keeps for its open scopes, deeper ones reopen unnamed
+
+  enum eValueKind {
+    VALUE_COUNTER, // summed over the frame and every thread
+    VALUE_GAUGE,   // the last value set by any thread, carried over frames until set again
+  };
+
   struct prof_sample_t {
-    char id[64] = "Invalid";
-    u64 starHpc = uint(-1);
-    u64 endHpc = uint(-1);
+    const char* id = "Invalid";
+    u64 starHpc = 0;
+    u64 endHpc = 0;
+    u64 cycles = 0; // CPU cycles the thread ran in the scope, 0 unless counters are on
 
-    void addChild(prof_sample_t* ps);
-    void finish();
     double elapsedTime() const;
 
     inline const prof_sample_t* children() const { return mChildren; }
@@ -23,30 +56,192 @@ namespace Profile {
     inline const prof_sample_t* next() const { return mNext; }
 
     inline prof_sample_t* childHead() const { return mChildren; };
-    static owner<prof_sample_t*> create(const char* id);
-
-    Report& dump(Report::eViewOption view = Report::VIEW_TREE);
   protected:
+    friend class Frame;
     friend class Profiler;
-    prof_sample_t() = default;
-    prof_sample_t* mChildren = nullptr;
+    friend class StackSampler;
+    void addChild(prof_sample_t* ps);
+
+    prof_sample_t* mChildren = nullptr; // last child, the others through mPrev
     prof_sample_t* mParent = nullptr;
     prof_sample_t  *mPrev = nullptr, *mNext = nullptr; // sublings
-    std::optional<Report> mReport = std::nullopt;
   };
 
-  static constexpr uint MAX_FRAME_RECORDED = 1024u;
+  /*
+   * one recorded frame of one thread: the tree is built from the events the first time the frame is read,
+   * reports the first time they are asked for. The root sample is `__Frame__` and spans the whole frame;
+   * a scope open across a frame boundary, eg. a job, is cut at the boundary on both frames.
+   */
+  class Frame {
+  public:
+    uint index() const { return mIndex; }
+    uint lane() const { return mLane; }
+    u64 startHpc() const { return mSamples.front().starHpc; }
+    u64 endHpc() const { return mSamples.front().endHpc; }
+    const prof_sample_t* root() const { return mSamples.data(); }
+    double elapsedTime() const { return mSamples.front().elapsedTime(); }
+    Report& report(Report::eViewOption view = Report::VIEW_TREE);
+
+  protected:
+    friend class Profiler;
+    uint mIndex = 0;
+    uint mLane = 0;
+    std::vector<prof_sample_t> mSamples;
+    U<Report> mReports[2];
+  };
+
+  namespace detail {
+    // `id` nullptr closes the innermost scope
+    struct event_t {
+      u64 hpc;
+      const char* id;
+    };
+
+    struct value_event_t {
+      u64 hpc;
+      const char* name;
+      double value;
+      eValueKind kind;
+    };
+
+    struct thread_stream_t {
+      std::atomic<u64> written = 0; // events ever written, the next one goes to `events[written % kEventPerThread]`
+      uint lane = 0;
+      std::atomic<u64*> cycles = nullptr; // thread cycle count of every event, allocated once counters are turned on
+      std::atomic<u64> valuesWritten = 0; // same as `written`, for `values`
+      uint openDepth = 0;                 // owner thread only, scopes open on the thread
+      u64 openRecorded = 0;               // owner thread only, bit per depth: the push of the scope was recorded
+      const char* open[kMaxOpenScope];
+      event_t events[kEventPerThread];
+      value_event_t values[kValuePerThread];
+    };
+
+    extern thread_local thread_stream_t* tStream;
+    extern std::atomic<bool> gRecording;
+    extern std::atomic<bool> gCounting;
+    // nullptr once the thread is exiting
+    thread_stream_t* acquireStream();
+    u64 threadCycles();
+
+    inline void record(thread_stream_t* stream, const char* id) {
+      // only the owner thread writes its stream
+      u64 index = stream->written.load(std::memory_order_relaxed);
+      event_t& event = stream->events[index & (kEventPerThread - 1)];
+      event.hpc = GetPerformanceCounter();
+      event.id = id;
+      if(gCounting.load(std::memory_order_relaxed)) {
+        u64* cycles = stream->cycles.load(std::memory_order_acquire);
+        if(cycles != nullptr) cycles[index & (kEventPerThread - 1)] = threadCycles();
+      }
+      stream->written.store(index + 1, std::memory_order_release);
+    }
+
+    // opens a scope on the stack of the thread, recorded if `recording`; scopes deeper than kMaxOpenScope never are
+    inline void open(thread_stream_t* stream, const char* id, bool recording) {
+      uint depth = stream->openDepth++;
+      if(depth >= kMaxOpenScope) return;
+      stream->open[depth] = id;
+      u64 bit = u64(1) << depth;
+      if(recording) {
+        stream->openRecorded |= bit;
+        record(stream, id);
+      } else {
+        stream->openRecorded &= ~bit;
+      }
+    }
 
-  void startup();
-  prof_sample_t* dump(uint frameOffsetFromCurrent = 1);
+    inline void recordValue(const char* name, double value, eValueKind kind) {
+      thread_stream_t* stream = tStream;
+      if(stream == nullptr && (stream = acquireStream()) == nullptr) return;
+      u64 index = stream->valuesWritten.load(std::memory_order_relaxed);
+      value_event_t& event = stream->values[index & (kValuePerThread - 1)];
+      event.hpc = GetPerformanceCounter();
+      event.name = name;
+      event.value = value;
+      event.kind = kind;
+      stream->valuesWritten.store(index + 1, std::memory_order_release);
+    }
+  }
 
-  void push(const char* id);
-  void pop();
+  struct thread_info_t {
+    uint lane;
+    std::string name;
+  };
 
+  // scopes a job had open when it switched fiber, outermost first
+  struct open_scopes_t {
+    const char* ids[kMaxOpenScope];
+    uint count = 0;
+  };
+
+  struct frame_value_t {
+    const char* name;
+    eValueKind kind;
+    double value; // counters seen before but not in the frame are 0
+  };
+
+  // performance counter span of frames [current - oldestFrameOffset, current - newestFrameOffset], false if not recorded
+  bool frameRange(uint oldestFrameOffset, uint newestFrameOffset, u64& startHpc, u64& endHpc);
+  // durations of the last `frameCount` recorded frames, in performance counts
+  Histogram frameHistogram(uint frameCount = MAX_FRAME_RECORDED);
+  // nullptr if the frame is not recorded, or its events got overwritten since
+  Frame* dump(uint frameOffsetFromCurrent = 1);
+  // the tree of the thread recording into `lane`, see threads()
+  Frame* dump(uint frameOffsetFromCurrent, uint lane);
+  // counters and gauges of a frame over every thread, sorted by name; nullptr if the frame is not recorded,
+  // or the values of a thread got overwritten since
+  const std::vector<frame_value_t>* values(uint frameOffsetFromCurrent = 1);
+  // threads which recorded anything, the main thread first
+  std::vector<thread_info_t> threads();
+  // name of the calling thread in reports and overlay lanes, CurrentThread::setName forwards here
+  void nameThread(const char* name);
+
+  /*
+   * writes frames [current - oldestFrameOffset, current - newestFrameOffset] of every thread as Chrome trace json,
+   * which ui.perfetto.dev opens as well: a lane per thread, a marker at every frame start, a counter track per value.
+   * The events are copied right away on the main thread, the json is built and written on CAT_IO.
+   * return the write job, nullptr if the frames are not recorded
+   */
+  Job::counter_ref_t exportTrace(const fs::path& file, uint oldestFrameOffset, uint newestFrameOffset = 1);
+
+  // whether the scope is recorded is decided here, its pop follows even if recording paused or resumed since
+  inline void push(const char* id) {
+    bool recording = detail::gRecording.load(std::memory_order_relaxed);
+    detail::thread_stream_t* stream = detail::tStream;
+    // no stream yet: nothing recorded so far, and neither is this scope
+    if(stream == nullptr && (!recording || (stream = detail::acquireStream()) == nullptr)) return;
+    detail::open(stream, id, recording);
+  }
+
+  inline void pop() {
+    detail::thread_stream_t* stream = detail::tStream;
+    if(stream == nullptr || stream->openDepth == 0) return;
+    uint depth = --stream->openDepth;
+    if(depth < kMaxOpenScope && (stream->openRecorded >> depth & 1) != 0) detail::record(stream, nullptr);
+  }
+
+  inline void count(const char* name, double value) {
+    if(detail::gRecording.load(std::memory_order_relaxed)) detail::recordValue(name, value, VALUE_COUNTER);
+  }
+
+  inline void gauge(const char* name, double value) {
+    if(detail::gRecording.load(std::memory_order_relaxed)) detail::recordValue(name, value, VALUE_GAUGE);
+  }
+
+  // frame boundary, called once per frame by the main thread, which is the thread `dump` reads
   void markFrame();
 
+  // the thread is about to run another fiber: closes its open scopes, innermost first, and hands them back
+  open_scopes_t suspendScopes();
+  // the fiber which suspended `scopes` runs again, they open again on the thread
+  void resumeScopes(const open_scopes_t& scopes);
+
+  // both take effect at the next frame boundary
   void pause();
   void resume();
+  // CPU cycle counters per scope, from the next frame boundary on
+  void enableCounters(bool enabled);
+  bool countersEnabled();
 
   template<bool LOG>
   class Scoped {
@@ -63,9 +258,9 @@ namespace Profile {
         u64 endHps = GetPerformanceCounter();
         double time = PerformanceCountToSecond(endHps - startHps);
 
-        Debug::log(Stringf("[%s]%lf seconds", id, time));
+        Log::logf("[%s]%lf seconds", id, time);
       }
-      
+
     }
 
     u64 startHps;
@@ -79,9 +274,14 @@ namespace Profile {
 #ifdef PROFILER_ENABLED
 #define PROF_SCOPE(tag) Profile::Scoped<false> APPEND(__Scoped_, __LINE__)(tag);
 #define PROF_SCOPE_LOG(tag) Profile::Scoped<true> APPEND(__Log_Scoped_, __LINE__)(tag);
+#define PROF_COUNTER(name, value) Profile::count(name, double(value));
+#define PROF_GAUGE(name, value) Profile::gauge(name, double(value));
 #else
 #define PROF_SCOPE(tag) ;
+#define PROF_SCOPE_LOG(tag) ;
+#define PROF_COUNTER(name, value) ;
+#define PROF_GAUGE(name, value) ;
 #endif
 
 #define PROF_FUNC() PROF_SCOPE(__FUNCTION__)
-#define PROF_FUNC_LOG() PROF_SCOPE_LOG(__FUNCTION__)
\ No newline at end of file
+#define PROF_FUNC_LOG() PROF_SCOPE_LOG(__FUNCTION__)
@@ -2,7 +2,7 @@
 #include "Engine/Debug/Profile/Profiler.hpp"
 #include "Engine/Debug/Console/Console.hpp"
 #include <stack>
-#include "Engine/Renderer/Font.hpp"
+#include <algorithm>
 
 using namespace Profile;
 
@@ -55,6 +55,8 @@ void Report::Entry::clear() {
   callCount = 0;
   totalTime = 0;
   selfTime = 0;
+  cycles = 0;
+  histogram.clear();
 
   for(auto&& [k, v]: mChildren) {
     v->clear();
@@ -76,6 +78,31 @@ void Report::Entry::sort(eSortOption option) {
         return a.second->selfTime < b.second->selfTime;
       });
     break;
+    case SORT_CYCLES_PER_CALL:
+      std::sort(mChildren.begin(), mChildren.end(), [](eleType& a, eleType& b) {
+        return a.second->cyclesPerCall < b.second->cyclesPerCall;
+      });
+    break;
+    case SORT_P50_TIME:
+      std::sort(mChildren.begin(), mChildren.end(), [](eleType& a, eleType& b) {
+        return a.second->p50Time < b.second->p50Time;
+      });
+    break;
+    case SORT_P90_TIME:
+      std::sort(mChildren.begin(), mChildren.end(), [](eleType& a, eleType& b) {
+        return a.second->p90Time < b.second->p90Time;
+      });
+    break;
+    case SORT_P99_TIME:
+      std::sort(mChildren.begin(), mChildren.end(), [](eleType& a, eleType& b) {
+        return a.second->p99Time < b.second->p99Time;
+      });
+    break;
+    case SORT_MAX_TIME:
+      std::sort(mChildren.begin(), mChildren.end(), [](eleType& a, eleType& b) {
+        return a.second->maxTime < b.second->maxTime;
+      });
+    break;
     default:
       ERROR_AND_DIE("INVALID sorting option");
     ;
@@ -103,30 +130,57 @@ void Report::computeSelfTime() {
     Entry* entry = entries.top();
     entries.pop();
 
-    double childTime = 0;
     for(auto& child: entry->mChildren) {
       entries.push(child.second);
-      childTime += child.second->totalTime;
     }
-    entry->childTime = childTime;
-    entry->selfTime = entry->totalTime - entry->selfTime;
+    entry->childTime = entry->totalTime - entry->selfTime;
     entry->selfTimeAveragePerCall = entry->selfTime / (double)entry->callCount;
   }
 }
 
+void Report::computePercentiles() {
+  std::stack<Entry*> entries;
+
+  entries.push(&root);
+
+  while(!entries.empty()) {
+    Entry* entry = entries.top();
+    entries.pop();
+
+    for(auto& child: entry->mChildren) {
+      entries.push(child.second);
+    }
+    entry->p50Time = PerformanceCountToSecond(entry->histogram.percentile(50.0));
+    entry->p90Time = PerformanceCountToSecond(entry->histogram.percentile(90.0));
+    entry->p99Time = PerformanceCountToSecond(entry->histogram.percentile(99.0));
+    entry->maxTime = PerformanceCountToSecond(entry->histogram.max());
+  }
+}
+
 void Report::Entry::accumulate(const prof_sample_t& node) {
-  // handle self
+  // self time comes from the sample's own children, entries of the flat view have none
+  double time = node.elapsedTime();
+  double childTime = 0;
+  for(const prof_sample_t* child = node.children(); child != nullptr; child = child->prev()) {
+    childTime += child->elapsedTime();
+  }
+
   callCount++;
-  totalTime += node.elapsedTime();
+  totalTime += time;
+  selfTime += time - childTime;
+  cycles += node.cycles;
+  histogram.record(node.endHpc - node.starHpc);
   totalTimeAveragePerCall = totalTime / (float)callCount; 
+  cyclesPerCall = double(cycles) / double(callCount);
 }
 
-void Report::fromSample(prof_sample_t* sample, eViewOption view) {
+void Report::fromSample(const prof_sample_t* sample, eViewOption view) {
   root.clear();
   accumlateSample(sample, view);
+  computePercentiles();
 }
 
-void Report::accumlateSample(prof_sample_t* sample, eViewOption view) {
+void Report::accumlateSample(const prof_sample_t* sample, eViewOption view) {
   root.name = sample->id;
   switch (view) {
     case VIEW_FLAT:
@@ -153,13 +207,16 @@ void Report::log(eViewOption option) const {
 
   
   Log::log(Stringf(
-    "[ ]%-*s%-10s%-30s%-30s\n",
+    "[ ]%-*s%-10s%-30s%-30s%-20s%-20s\n",
     57, "Function Name", "Call",
-    option == SORT_TOTAL_TIME ? "--Total(Time)--" : "Total(Time)",
-    option == SORT_SELF_TIME ? "--Self(Time)--" : "Self(Time)"));
+    root.sorting == SORT_TOTAL_TIME ? "--Total(Time)--" : "Total(Time)",
+    root.sorting == SORT_SELF_TIME ? "--Self(Time)--" : "Self(Time)",
+    root.sorting == SORT_P99_TIME ? "--P99(Time)--" : "P99(Time)",
+    root.sorting == SORT_CYCLES_PER_CALL ? "--Cycles/Call--" : "Cycles/Call"));
 
   while (!toProcess.empty()) {
-    Iter& top = toProcess.top();
+    // a copy, the children are pushed after the pop
+    Iter top = toProcess.top();
     uint currentDepth = top.depth;
 
     // char str[1000];
@@ -169,10 +226,11 @@ void Report::log(eViewOption option) const {
     // indentedPosition.x += font->advance(' ', ' ', kFontSize) * float(top.depth) ;
 
     Log::log(Stringf(
-      "%-*s%-*s%-10u%-30s%-30s",
+      "%-*s%-*s%-10u%-30s%-30s%-20s%-20.0f",
       top.depth + 3, top.entry->children().empty() ? "   " : "[-]",
       57 - top.depth, top.entry->name.data(),
-      top.entry->callCount, beautifySeconds(top.entry->totalTime).c_str(), beautifySeconds(top.entry->selfTime).c_str()));
+      top.entry->callCount, beautifySeconds(top.entry->totalTime).c_str(), beautifySeconds(top.entry->selfTime).c_str(),
+      beautifySeconds(top.entry->p99Time).c_str(), top.entry->cyclesPerCall));
     toProcess.pop();
 
     for (auto&[_, v] : top.entry->children()) {
@@ -1,5 +1,6 @@
 ﻿#pragma once
 #include "Engine/Core/common.hpp"
+#include "Engine/Debug/Profile/Histogram.hpp"
 #include <vector>
 #include <map>
 
@@ -17,16 +18,28 @@ namespace Profile {
       SORT_UNKNOWN,
       SORT_TOTAL_TIME,
       SORT_SELF_TIME,
+      SORT_CYCLES_PER_CALL,
+      SORT_P50_TIME,
+      SORT_P90_TIME,
+      SORT_P99_TIME,
+      SORT_MAX_TIME,
     };
     struct Entry {
       friend class Report;
       std::string_view name;
-      uint callCount;
-      double totalTime; // inclusive time
-      double selfTime;  // exclusive time
-      double childTime;
-      double totalTimeAveragePerCall;
-      double selfTimeAveragePerCall;
+      uint callCount = 0;
+      double totalTime = 0; // inclusive time
+      double selfTime = 0;  // exclusive time
+      double childTime = 0;
+      double totalTimeAveragePerCall = 0;
+      double selfTimeAveragePerCall = 0;
+      u64 cycles = 0;       // 0 unless the profiler counters are on
+      double cyclesPerCall = 0;
+      Histogram histogram;  // inclusive time of every call, in performance counts
+      double p50Time = 0;   // percentiles of the inclusive time per call, see computePercentiles
+      double p90Time = 0;
+      double p99Time = 0;
+      double maxTime = 0;
 
       void populateTree(const prof_sample_t& node);
       void populateFlat(const prof_sample_t& node);
@@ -43,10 +56,12 @@ namespace Profile {
       std::vector<std::pair<std::string, Entry*>> mChildren;
       eSortOption sorting = SORT_UNKNOWN;
     };
-    void fromSample(prof_sample_t* sample, eViewOption view);
-    void accumlateSample(prof_sample_t* sample, eViewOption view);
+    void fromSample(const prof_sample_t* sample, eViewOption view);
+    // leaves the percentiles as they were, call computePercentiles once done accumulating
+    void accumlateSample(const prof_sample_t* sample, eViewOption view);
     void sort(eSortOption op) { root.sort(op); }
     void computeSelfTime();
+    void computePercentiles();
 
     void log(eViewOption option) const;
     double totalFrameTime() const;
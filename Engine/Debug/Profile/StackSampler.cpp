@@ -0,0 +1,383 @@
+﻿#include "StackSampler.hpp"
+#include "Engine/Debug/Profile/Profiler.hpp"
+#include "Engine/Async/Thread.hpp"
+#include "Engine/Core/Time/Time.hpp"
+#include "Engine/Debug/Log.hpp"
+#include "Engine/Debug/Console/Command.hpp"
+#include "Engine/Debug/Console/Console.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#define WIN32_LEAN_AND_MEAN		// Always #define this before #including <windows.h>
+#include <windows.h>
+#include <timeapi.h>
+#include <DbgHelp.h>
+#pragma comment(lib, "dbghelp.lib") // SymFromAddr
+#pragma comment(lib, "winmm.lib")   // timeBeginPeriod
+
+using namespace Profile;
+
+namespace Profile {
+  struct stack_sample_t {
+    u64 hpc;
+    u64 weightHpc; // time the sample stands for, the interval since the previous round
+    uint thread;
+    uint depth;
+    u64 frames[kMaxSampleDepth]; // the innermost first
+  };
+
+  /*
+   * the sampler thread neither allocates nor locks while a thread is suspended, the suspended thread may hold the heap lock.
+   * Thread handles are only closed under mThreadLock, which the sampler holds for a whole round.
+   */
+  class StackSampler {
+  public:
+    struct thread_entry_t {
+      uint id;
+      HANDLE handle;
+      std::string name;
+    };
+
+    void registerThread(const char* name);
+    void unregisterThread(uint id);
+    std::vector<sampled_thread_t> threads();
+
+    void start(uint frequency);
+    void stop();
+    bool running() const { return mRunning.load(std::memory_order_relaxed); }
+
+    bool report(Report& report, Report::eViewOption view, u64 startHpc, u64 endHpc, uint threadId);
+
+  protected:
+    void run();
+    void sampleRound(u64 weightHpc);
+    static uint walk(HANDLE thread, u64* frames);
+    const char* symbolName(u64 address);
+
+    std::mutex mThreadLock;
+    std::vector<thread_entry_t> mThreads;
+
+    std::atomic<bool> mRunning = false;
+    std::atomic<uint> mFrequency = 1000;
+    Thread mThread;
+    std::vector<stack_sample_t> mRound; // samples of the round in progress, only touched by the sampler thread
+
+    std::mutex mSampleLock;
+    std::vector<stack_sample_t> mSamples; // ring of kSampleCapacity, allocated when sampling starts
+    u64 mWritten = 0;
+
+    std::mutex mSymbolLock; // DbgHelp is single threaded
+    bool mSymbolInitialized = false;
+    std::unordered_map<u64, const char*> mSymbols; // by address
+    std::unordered_set<std::string> mNames;         // reports keep pointers to the names
+  };
+}
+
+static StackSampler gSampler;
+
+struct sampled_registration_t {
+  bool registered = false;
+  ~sampled_registration_t() {
+    if(registered) gSampler.unregisterThread(::GetCurrentThreadId());
+  }
+};
+
+static thread_local sampled_registration_t tRegistration;
+
+void StackSampler::registerThread(const char* name) {
+  uint id = ::GetCurrentThreadId();
+  std::scoped_lock lock(mThreadLock);
+  for(thread_entry_t& entry: mThreads) {
+    if(entry.id == id) {
+      entry.name = name;
+      return;
+    }
+  }
+
+  // GetCurrentThread is a pseudo handle, only meaningful to the thread itself
+  HANDLE handle = nullptr;
+  if(!::DuplicateHandle(::GetCurrentProcess(), ::GetCurrentThread(), ::GetCurrentProcess(), &handle,
+                        THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT | THREAD_QUERY_INFORMATION, FALSE, 0)) {
+    return;
+  }
+  mThreads.push_back({ id, handle, name });
+}
+
+void StackSampler::unregisterThread(uint id) {
+  std::scoped_lock lock(mThreadLock);
+  auto entry = std::find_if(mThreads.begin(), mThreads.end(), [id](const thread_entry_t& e) { return e.id == id; });
+  if(entry == mThreads.end()) return;
+  ::CloseHandle(entry->handle);
+  mThreads.erase(entry);
+}
+
+std::vector<sampled_thread_t> StackSampler::threads() {
+  std::vector<sampled_thread_t> threads;
+  std::scoped_lock lock(mThreadLock);
+  for(const thread_entry_t& entry: mThreads) {
+    threads.push_back({ entry.id, entry.name });
+  }
+  return threads;
+}
+
+void StackSampler::start(uint frequency) {
+  mFrequency = std::clamp(frequency, 1u, 10000u);
+  if(mRunning.exchange(true)) return;
+
+  {
+    std::scoped_lock lock(mSampleLock);
+    if(mSamples.empty()) mSamples.resize(kSampleCapacity);
+  }
+  mThread = Thread("Profile Sampler", [this]() { run(); });
+}
+
+void StackSampler::stop() {
+  if(!mRunning.exchange(false)) return;
+  mThread.join();
+}
+
+void StackSampler::run() {
+  // the default 15.6 ms timer resolution caps the sleep below at 64 rounds per second
+  ::timeBeginPeriod(1);
+
+  u64 lastHpc = GetPerformanceCounter();
+  auto next = std::chrono::steady_clock::now();
+  while(mRunning.load(std::memory_order_relaxed)) {
+    next += std::chrono::microseconds(1000000 / mFrequency.load(std::memory_order_relaxed));
+    // a round running late does not turn into a burst of rounds
+    next = std::max(next, std::chrono::steady_clock::now());
+    std::this_thread::sleep_until(next);
+
+    u64 now = GetPerformanceCounter();
+    sampleRound(now - lastHpc);
+    lastHpc = now;
+  }
+
+  ::timeEndPeriod(1);
+}
+
+void StackSampler::sampleRound(u64 weightHpc) {
+  uint self = ::GetCurrentThreadId();
+  {
+    std::scoped_lock lock(mThreadLock);
+    mRound.resize(mThreads.size());
+
+    uint count = 0;
+    for(const thread_entry_t& entry: mThreads) {
+      if(entry.id == self) continue;
+      stack_sample_t& sample = mRound[count];
+      if(::SuspendThread(entry.handle) == (DWORD)-1) continue;
+      sample.hpc = GetPerformanceCounter();
+      sample.depth = walk(entry.handle, sample.frames);
+      ::ResumeThread(entry.handle);
+
+      if(sample.depth == 0) continue;
+      sample.weightHpc = weightHpc;
+      sample.thread = entry.id;
+      count++;
+    }
+    mRound.resize(count);
+  }
+
+  std::scoped_lock lock(mSampleLock);
+  for(const stack_sample_t& sample: mRound) {
+    mSamples[mWritten % kSampleCapacity] = sample;
+    mWritten++;
+  }
+}
+
+uint StackSampler::walk(HANDLE thread, u64* frames) {
+  CONTEXT context = {};
+  context.ContextFlags = CONTEXT_FULL;
+  if(!::GetThreadContext(thread, &context)) return 0;
+
+#if defined(_M_X64)
+  uint depth = 0;
+  // the thread can be stopped anywhere, eg. in the middle of a prologue; a bad unwind faults instead of hanging
+  __try {
+    while(depth < kMaxSampleDepth && context.Rip != 0) {
+      frames[depth++] = context.Rip;
+
+      DWORD64 imageBase = 0;
+      PRUNTIME_FUNCTION function = ::RtlLookupFunctionEntry(context.Rip, &imageBase, nullptr);
+      if(function == nullptr) {
+        // leaf function, the return address is on top of the stack
+        context.Rip = *(DWORD64*)context.Rsp;
+        context.Rsp += 8;
+        continue;
+      }
+
+      void* handlerData = nullptr;
+      DWORD64 establisherFrame = 0;
+      ::RtlVirtualUnwind(UNW_FLAG_NHANDLER, imageBase, context.Rip, function,
+                         &context, &handlerData, &establisherFrame, nullptr);
+    }
+  } __except(EXCEPTION_EXECUTE_HANDLER) {}
+  return depth;
+#else
+  // no unwind tables on x86, the sample only knows the function it stopped in
+  frames[0] = context.Eip;
+  return 1;
+#endif
+}
+
+const char* StackSampler::symbolName(u64 address) {
+  auto found = mSymbols.find(address);
+  if(found != mSymbols.end()) return found->second;
+
+  if(!mSymbolInitialized) {
+    mSymbolInitialized = true;
+    ::SymSetOptions(SYMOPT_UNDNAME | SYMOPT_DEFERRED_LOADS);
+    if(!::SymInitialize(::GetCurrentProcess(), nullptr, TRUE)) {
+      Log::warnf("[profiler] fail to load symbols, samples show module names only");
+    }
+  }
+
+  std::string name;
+  alignas(SYMBOL_INFO) char buffer[sizeof(SYMBOL_INFO) + MAX_SYM_NAME];
+  SYMBOL_INFO* symbol = (SYMBOL_INFO*)buffer;
+  symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+  symbol->MaxNameLen = MAX_SYM_NAME;
+  DWORD64 displacement = 0;
+  if(::SymFromAddr(::GetCurrentProcess(), address, &displacement, symbol)) {
+    name = symbol->Name;
+  } else {
+    // no pdb for the module, eg. a driver dll: every address of the module goes to one entry
+    HMODULE module = nullptr;
+    char path[MAX_PATH] = {};
+    if(::GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+                            (LPCSTR)address, &module)
+       && ::GetModuleFileNameA(module, path, MAX_PATH) != 0) {
+      const char* file = std::max(strrchr(path, '\\'), strrchr(path, '/'));
+      name = Stringf("[%s]", file == nullptr ? path : file + 1);
+    } else {
+      name = "[unknown]";
+    }
+  }
+
+  const char* interned = mNames.insert(name).first->c_str();
+  mSymbols[address] = interned;
+  return interned;
+}
+
+bool StackSampler::report(Report& report, Report::eViewOption view, u64 startHpc, u64 endHpc, uint threadId) {
+  std::vector<stack_sample_t> samples;
+  {
+    std::scoped_lock lock(mSampleLock);
+    u64 oldest = mWritten > kSampleCapacity ? mWritten - kSampleCapacity : 0;
+    for(u64 i = oldest; i < mWritten; i++) {
+      const stack_sample_t& sample = mSamples[i % kSampleCapacity];
+      if(sample.hpc < startHpc || sample.hpc >= endHpc) continue;
+      if(threadId != 0 && sample.thread != threadId) continue;
+      samples.push_back(sample);
+    }
+  }
+  if(samples.empty()) return false;
+
+  size_t nodeCount = 1;
+  for(const stack_sample_t& sample: samples) {
+    nodeCount += sample.depth;
+  }
+  // reserved up front, samples link to each other by pointer
+  std::vector<prof_sample_t> nodes;
+  nodes.reserve(nodeCount);
+
+  prof_sample_t* root = &nodes.emplace_back();
+  root->id = "__Samples__";
+  root->starHpc = 0;
+  root->endHpc = 0;
+
+  std::scoped_lock lock(mSymbolLock);
+  for(const stack_sample_t& sample: samples) {
+    root->endHpc += sample.weightHpc;
+    prof_sample_t* parent = root;
+    for(uint i = sample.depth; i-- > 0;) {
+      prof_sample_t* node = &nodes.emplace_back();
+      // a return address points past the call, which can be the first instruction of the next function
+      node->id = symbolName(i == 0 ? sample.frames[0] : sample.frames[i] - 1);
+      node->starHpc = 0;
+      node->endHpc = sample.weightHpc;
+      node->mParent = parent;
+      parent->addChild(node);
+      parent = node;
+    }
+  }
+
+  report.fromSample(root, view);
+  return true;
+}
+
+void Profile::startSampling(uint frequency) {
+  gSampler.start(frequency);
+}
+
+void Profile::stopSampling() {
+  gSampler.stop();
+}
+
+bool Profile::sampling() {
+  return gSampler.running();
+}
+
+std::vector<sampled_thread_t> Profile::sampledThreads() {
+  return gSampler.threads();
+}
+
+bool Profile::sampleReport(Report& report, Report::eViewOption view,
+                           uint oldestFrameOffset, uint newestFrameOffset, uint threadId) {
+  u64 startHpc, endHpc;
+  if(!frameRange(oldestFrameOffset, newestFrameOffset, startHpc, endHpc)) return false;
+  return gSampler.report(report, view, startHpc, endHpc, threadId);
+}
+
+void Profile::detail::registerSampledThread(const char* name) {
+  gSampler.registerThread(name);
+  tRegistration.registered = true;
+}
+
+COMMAND_REG("profiler_sampling", "enabled: bool [frequency: uint]", "start/stop sampling the call stacks of every named thread")(Command& cmd) {
+  if(!cmd.arg<0, bool>()) {
+    stopSampling();
+    Log::logf("[profiler] sampling off");
+    return true;
+  }
+
+  uint frequency = 1000;
+  try {
+    frequency = cmd.arg<1, uint>();
+  } catch(const ArgumentNotFoundException&) {}
+
+  startSampling(frequency);
+  Log::logf("[profiler] sampling %u threads at %u Hz", (uint)sampledThreads().size(), frequency);
+  return true;
+}
+
+COMMAND_REG("profiler_sample_report", "eViewOption: flat|tree [frames: uint]", "print the sampled call stacks of the last few frames")(Command& cmd) {
+  Report::eViewOption view;
+  if(cmd.arg<0>() == "flat") {
+    view = Report::VIEW_FLAT;
+  } else if(cmd.arg<0>() == "tree") {
+    view = Report::VIEW_TREE;
+  } else {
+    throw InvalidArgumentException(0);
+  }
+
+  uint frameCount = 1;
+  try {
+    frameCount = std::max(1u, cmd.arg<1, uint>());
+  } catch(const ArgumentNotFoundException&) {}
+
+  Report report;
+  if(!sampleReport(report, view, frameCount)) {
+    Log::warnf("[profiler] no sample in the last %u frames, try `profiler_sampling true` first", frameCount);
+    return false;
+  }
+  report.sort(view == Report::VIEW_FLAT ? Report::SORT_SELF_TIME : Report::SORT_TOTAL_TIME);
+  report.log(view);
+  return true;
+}
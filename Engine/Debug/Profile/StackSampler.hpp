@@ -0,0 +1,47 @@
+﻿#pragma once
+#include "Engine/Core/common.hpp"
+#include "Engine/Debug/Profile/Report.hpp"
+#include <string>
+#include <vector>
+
+/*
+ * sampling profiler, sees the code nobody put a PROF_SCOPE in. A sampler thread suspends every named thread at a
+ * fixed rate and walks its call stack; only return addresses are stored. They are resolved to function names with
+ * DbgHelp when a report is built, which needs the pdb next to the executable.
+ * Samples of a frame range fold into a Report like instrumented frames do: a sample is one call of every function
+ * on its stack lasting one sampling period, so `callCount` counts hits and the times are estimates.
+ * Threads are sampled once they get a name, see CurrentThread::setName.
+ *   Profile::startSampling(1000);
+ *   Report report;
+ *   Profile::sampleReport(report, Report::VIEW_FLAT, 16);
+ *   report.sort(Report::SORT_SELF_TIME);
+ *   report.log(Report::VIEW_FLAT);
+ */
+namespace Profile {
+  static constexpr uint kMaxSampleDepth = 48;
+  static constexpr uint kSampleCapacity = 16384; // samples kept, every thread together
+
+  struct sampled_thread_t {
+    uint id; // system thread id
+    std::string name;
+  };
+
+  // `frequency` in samples per second per thread, calling it again while sampling changes the rate
+  void startSampling(uint frequency = 1000);
+  void stopSampling();
+  bool sampling();
+  std::vector<sampled_thread_t> sampledThreads();
+
+  /*
+   * folds the samples taken during frames [current - oldestFrameOffset, current - newestFrameOffset] of thread `threadId`,
+   * 0 for every thread, into `report`. The root is `__Samples__`.
+   * return false if the frames are not recorded or no sample fell in them
+   */
+  bool sampleReport(Report& report, Report::eViewOption view,
+                    uint oldestFrameOffset, uint newestFrameOffset = 1, uint threadId = 0);
+
+  namespace detail {
+    // the calling thread is sampled from now on under `name`, until it exits
+    void registerSampledThread(const char* name);
+  }
+}
@@ -5,6 +5,7 @@
 #include "Engine/Renderer/Shader/Material.hpp"
 #include "Engine/Renderer/Renderable/Renderable.hpp"
 #include "Engine/Graphics/Camera.hpp"
+#include "Engine/Memory/ScratchArena.hpp"
 
 particle_t::particle_t(float spawnTime, float lifeTime)
   : timeSpawnSec(spawnTime)
@@ -50,7 +51,8 @@ void ParticleEmitter::update() {
 }
 
 void ParticleEmitter::setup(const Camera& cam) {
-  Mesher ms;
+  // only lives until the mesh is uploaded
+  Mesher ms(ScratchArena::resource());
 
   vec3 right = (transform.worldToLocal() * vec4(cam.right(), 0.f)).xyz();
   vec3 up = (transform.worldToLocal() * vec4(cam.up(), 0.f)).xyz();
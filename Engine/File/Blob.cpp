@@ -1,6 +1,8 @@
 ﻿#include "Blob.hpp"
+#include <algorithm>
 Blob::~Blob() {
   free(buffer);
+  Mem::onFree(mTag, bufferSize);
 }
 
 Blob::Blob(Blob&& source) noexcept {
@@ -9,6 +11,7 @@ Blob::Blob(Blob&& source) noexcept {
   buffer = source.buffer;
   dataSize = source.dataSize;
   bufferSize = source.bufferSize;
+  mTag = source.mTag;
 
   source.buffer = malloc(0);
   source.dataSize = 0;
@@ -16,31 +19,32 @@ Blob::Blob(Blob&& source) noexcept {
 }
 
 Blob Blob::clone() const {
-  void* block = malloc(dataSize);
-
-  memcpy(block, buffer, dataSize);
-
-  return Blob(block, dataSize);
+  return Blob(buffer, dataSize, mTag);
 }
 
 void Blob::set(const void* data, size_t size, size_t offset) {
-  if (dataSize + bufferSize < offset + size) {
+  if (bufferSize < offset + size) {
     void* newBuffer = malloc(offset + size);
     memcpy(newBuffer, buffer, dataSize);
     free(buffer);
     buffer = newBuffer;
-    dataSize = offset + size;
+    Mem::onFree(mTag, bufferSize);
+    bufferSize = offset + size;
+    Mem::onAlloc(mTag, bufferSize);
   }
 
   memcpy((unsigned char*)buffer + offset, data, size);
+  dataSize = std::max(dataSize, offset + size);
 }
 
 Blob& Blob::operator=(Blob&& other) noexcept {
 
   free(buffer);
+  Mem::onFree(mTag, bufferSize);
   buffer = other.buffer;
   dataSize = other.dataSize;
   bufferSize = other.bufferSize;
+  mTag = other.mTag;
 
   other.buffer = malloc(0);
   other.dataSize = 0;
@@ -2,15 +2,19 @@
 #include <memory>
 #include "Engine/Core/common.hpp"
 #include "Engine/Debug/ErrorWarningAssert.hpp"
+#include "Engine/Memory/MemTrack.hpp"
 
 class Blob {
 public:
   template<typename T>
-  Blob(T* source, size_t size): buffer(malloc(size)), dataSize(size), bufferSize(size) {
+  Blob(T* source, size_t size, eMemTag tag = MEMTAG_UNTAGGED): buffer(malloc(size)), dataSize(size), bufferSize(size), mTag(tag) {
     memcpy_s(buffer, size, source, size);
+    Mem::onAlloc(mTag, bufferSize);
   }
 
-  Blob(size_t size): buffer(malloc(size)), dataSize(0), bufferSize(size) {}
+  Blob(size_t size, eMemTag tag = MEMTAG_UNTAGGED): buffer(malloc(size)), dataSize(0), bufferSize(size), mTag(tag) {
+    Mem::onAlloc(mTag, bufferSize);
+  }
 
   Blob(): buffer(malloc(0)), dataSize(0), bufferSize(0) {}
 
@@ -64,5 +68,6 @@ protected:
   void* buffer = nullptr;
   size_t dataSize;
   size_t bufferSize;
+  eMemTag mTag = MEMTAG_UNTAGGED;
 
 };
@@ -37,7 +37,7 @@ Blob fs::read(const path& filePath) {
 
   if (file.read(buffer, size)) {
     buffer[size] = 0;
-    Blob b(buffer, (uint)size);
+    Blob b(buffer, (uint)size, MEMTAG_RESOURCE);
     delete[] buffer;
     return b;
   } else {
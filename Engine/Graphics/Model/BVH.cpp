@@ -6,6 +6,7 @@
 #include "Engine/Math/Primitives/uvec2.hpp"
 #include "Engine/Math/Range.hpp"
 #include "Engine/Debug/Log.hpp"
+#include "Engine/Memory/ScratchArena.hpp"
 
 const float& visit(const vec3& vec, BVH::eSortPolicy policy) {
   switch(policy) { 
@@ -51,9 +52,11 @@ const float& visit(const BVH::Prim& vec, BVH::eSortPolicy policy) {
 //   bounds.grow(z.position);
 // }
 
-BVH::BVH(span<vec3> vertices, span<vec4> color, uint depth) {
+BVH::BVH(span<vec3> vertices, span<vec4> color, uint depth)
+  : mNodes(size_t(2) << (depth + 2), MEMTAG_MESH)
+  , mPrims(vertices.size() / 3 + 1, MEMTAG_MESH) {
 
-  mPrims.reserve(vertices.size() / 3 + 1);
+  mPrims.reserve(vertices.size() / 3);
 
   EXPECTS(vertices.size() % 3 == 0);
 
@@ -74,9 +77,7 @@ BVH::BVH(span<vec3> vertices, span<vec4> color, uint depth) {
     size_t endIndex; // exclusive
   };
 
-  std::stack<Job> jobs;
-
-  mNodes.reserve(uint64_t(2) << (depth + 2));
+  std::stack<Job, std::pmr::vector<Job>> jobs{ std::pmr::vector<Job>(ScratchArena::resource()) };
 
   {
     sort(mPrims, policy);
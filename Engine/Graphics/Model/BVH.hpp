@@ -6,6 +6,7 @@
 #include "Engine/Math/Primitives/aabb3.hpp"
 #include "Engine/Math/Primitives/vec4.hpp"
 #include "Engine/Math/Primitives/vec2.hpp"
+#include "Engine/Memory/VirtualArena.hpp"
 
 struct vertex_pcu_t;
 class RHIBuffer;
@@ -51,8 +52,9 @@ protected:
   static void sort(span<Prim> vectices, eSortPolicy policy);
   static size_t alignedMedian(span<const Prim> vertices, eSortPolicy policy);
   static eSortPolicy stepPolicy(eSortPolicy policy, uint step);
-  std::vector<Node> mNodes;
-  std::vector<Prim> mPrims;
+  // nodes point at each other, they must never move while the tree is built
+  VirtualArray<Node> mNodes;
+  VirtualArray<Prim> mPrims;
 };
 
 
@@ -3,7 +3,7 @@
 
 Mesh& Mesh::setVertices(uint streamIndex, uint stride, uint count, const void* vertices) {
   if (!mVertices[streamIndex]) {
-    mVertices[streamIndex] = VertexBuffer::create(stride, count, RHIResource::BindingFlag::VertexBuffer | RHIResource::BindingFlag::ShaderResource);
+    mVertices[streamIndex] = VertexBuffer::create(stride, count, RHIResource::BindingFlag::VertexBuffer | RHIResource::BindingFlag::ShaderResource, MEMTAG_MESH);
   }
   mVertices[streamIndex]->set(stride, count, vertices);
   mVertices[streamIndex]->uploadGpu();
@@ -35,7 +35,7 @@ Mesh::Mesh(const VertexLayout* layout): mLayout(layout) {
 
 Mesh& Mesh::setIndices(span<const uint> indices) {
   if(!mIndices) {
-    mIndices = IndexBuffer::For<uint>((u32)indices.size(), RHIResource::BindingFlag::IndexBuffer | RHIResource::BindingFlag::ShaderResource);
+    mIndices = IndexBuffer::For<uint>((u32)indices.size(), RHIResource::BindingFlag::IndexBuffer | RHIResource::BindingFlag::ShaderResource, MEMTAG_MESH);
   }
   mIndices->set(indices);
   mIndices->uploadGpu();
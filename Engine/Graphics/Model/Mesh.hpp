@@ -26,7 +26,7 @@ public:
 
   Mesh & setIndices(span<const uint> indices);
   Mesh& pushInstruction(eDrawPrimitive prim, bool useIndices, uint startIdx, uint elemCount);
-  inline Mesh& setInstructions(const std::vector<draw_instr_t>& ins) { mIns = ins; return *this; };
+  inline Mesh& setInstructions(span<const draw_instr_t> ins) { mIns.assign(ins.begin(), ins.end()); return *this; };
   Mesh& resetInstruction(uint index);
 
   const VertexBuffer::sptr_t& vertices(uint streamIndex) const { return mVertices[streamIndex]; }
@@ -71,7 +71,7 @@ public:
 };
 
 template<typename V>
-Pool<VertexMesh<V>> VertexMesh<V>::pool{};
+Pool<VertexMesh<V>> VertexMesh<V>::pool{ MEMTAG_MESH };
 
 //template<>
 //ResDef<Mesh> Resource<Mesh>::load(const std::string& file);
@@ -156,6 +156,11 @@ void MikktBinding::mikktSetTSpace(const SMikkTSpaceContext* pContext,
   tangent.w = (float)bIsOrientationPreserving;
 }
 
+Mesher::Mesher(std::pmr::memory_resource* resource)
+  : mVertices(resource)
+  , mIndices(resource)
+  , mIns(resource) {}
+
 void Mesher::reserve(size_t size) {
   mVertices.reserve((uint)size);
   mIndices.reserve(size);
@@ -15,6 +15,10 @@ class BVH;
 class Mesher {
   friend class MikktBinding;
 public:
+  Mesher() = default;
+  // every buffer of the mesher comes from `resource`, eg. ScratchArena::resource() for a mesher living within a frame
+  explicit Mesher(std::pmr::memory_resource* resource);
+
   void setWindingOrder(eWindOrder windOrder) { mWindOrder = windOrder; }
   void reserve(size_t size);
   Mesher & begin(eDrawPrimitive prim, bool useIndices = true);
@@ -87,13 +91,16 @@ public:
   void mikkt();
   template<typename VertexType = vertex_lit_t>
   owner<Mesh*> createMesh();
+  // gives a mesh from createMesh back to its pool, VertexType has to match
+  template<typename VertexType = vertex_lit_t>
+  static void destroyMesh(Mesh*& mesh);
   owner<BVH*> createBVH(uint maxDepth);
   template<typename VertexType = vertex_lit_t>
   void resetMesh(Mesh& mesh);
 
   Vertex mVertices;
-  std::vector<uint> mIndices;
-  std::vector<draw_instr_t> mIns;
+  std::pmr::vector<uint> mIndices;
+  std::pmr::vector<draw_instr_t> mIns;
 protected:
   vec3 normalOf(uint a, uint b, uint c);
   uint currentElementCount() const;
@@ -119,6 +126,13 @@ owner<Mesh*> Mesher::createMesh() {
   return m;
 }
 
+template< typename VertexType >
+void Mesher::destroyMesh(Mesh*& mesh) {
+  if(mesh == nullptr) return;
+  VertexMesh<VertexType>::pool.release(static_cast<VertexMesh<VertexType>*>(mesh));
+  mesh = nullptr;
+}
+
 template< typename VertexType >
 void Mesher::resetMesh(Mesh& mesh) {
   GUARANTEE_OR_DIE(isDrawing == false, "createMesh called without calling end()");
@@ -25,7 +25,12 @@ DefineVertexType(vertex_lit_t) {
 }
 
 
-Vertex::Vertex() {
+Vertex::Vertex(std::pmr::memory_resource* resource)
+  : mPositions(resource)
+  , mColors(resource)
+  , mUVs(resource)
+  , mNormals(resource)
+  , mTangents(resource) {
   reserve(1000u);
 }
 
@@ -4,6 +4,7 @@
 #include "Engine/Math/Primitives/vec3.hpp"
 #include "Engine/Math/Primitives/vec2.hpp"
 #include "Engine/Graphics/RHI/VertexLayout.hpp"
+#include <memory_resource>
 
 DeclVertexType(vertex_pcu_t) {
   vec3 position{ 0.f };
@@ -46,7 +47,7 @@ struct vertex_a_t {
 };
 class Vertex {
 public:
-  Vertex();
+  explicit Vertex(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 
   vertex_a_t vertices();
 
@@ -57,10 +58,10 @@ public:
   void reserve(uint size);
   void clear();
 protected:
-  std::vector<vec3> mPositions;
-  std::vector<vec4> mColors;
-  std::vector<vec2> mUVs;
-  std::vector<vec3> mNormals;
-  std::vector<vec4> mTangents;
+  std::pmr::vector<vec3> mPositions;
+  std::pmr::vector<vec4> mColors;
+  std::pmr::vector<vec2> mUVs;
+  std::pmr::vector<vec3> mNormals;
+  std::pmr::vector<vec4> mTangents;
   uint mCount = 0;
 };
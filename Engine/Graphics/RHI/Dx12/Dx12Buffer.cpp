@@ -73,6 +73,10 @@ bool RHIBuffer::rhiInit(bool hasInitData) {
 
   mRhiHandle->SetName(L"Buffer");
 
+  // constant buffers got rounded up above, what is allocated is what counts
+  mTrackedSize = mSize;
+  Mem::onAlloc(mMemTag, mTrackedSize);
+
   return true;
 }
 
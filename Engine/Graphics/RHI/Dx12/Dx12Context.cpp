@@ -12,6 +12,7 @@
 #include "Engine/Graphics/RHI/PipelineState.hpp"
 #include "ThirdParty/WinPixEventRuntime/Include/pix3.h"
 #include "Engine/Math/MathUtils.hpp"
+#include "Engine/Debug/Profile/Profiler.hpp"
 
 #pragma comment(lib, "ThirdParty/WinPixEventRuntime/bin/WinPixEventRuntime.lib")
 
@@ -557,6 +558,7 @@ void RHIContext::updateTexture(const RHITexture& texture, const void* data) {
   mCommandsPending = true;
 
   u64 uploadBufferSize = GetRequiredIntermediateSize(texture.handle().Get(), 0, 1);
+  PROF_COUNTER("rhi bytes uploaded", uploadBufferSize);
 
   auto buffer = RHIBuffer::create(uploadBufferSize, RHIBuffer::BindingFlag::None, RHIBuffer::CPUAccess::Write, nullptr);
 
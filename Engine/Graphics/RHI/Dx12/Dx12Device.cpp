@@ -2,6 +2,9 @@
 #include "Engine/Graphics/RHI/RHIDevice.hpp"
 #include "Engine/Debug/ErrorWarningAssert.hpp"
 #include "Engine/Application/Window.hpp"
+#include "Engine/Memory/FrameAllocator.hpp"
+
+static_assert(FrameAllocator::kFrameCount == RHIDevice::FRAME_COUNT, "a frame allocator region per frame in flight");
 
 extern "C" {
   __declspec(dllexport) DWORD NvOptimusEnablement = 0x00000001;
@@ -248,7 +251,8 @@ void RHIDevice::executeDeferredRelease() {
 void RHIDevice::present() {
   mRenderContext->transitionBarrier(backBuffer().get(), RHIResource::State::Present);
   mRenderContext->flush();
-  mFrameFence->gpuSignal(mRenderContext->mContextData->commandQueue());
+  u64 frameFence = mFrameFence->gpuSignal(mRenderContext->mContextData->commandQueue());
+  FrameAllocator::get().endFrame(frameFence);
 
   // need to take care of the full screen mode
   // UINT presentFlags = (m_tearingSupport && m_windowedMode) ? DXGI_PRESENT_ALLOW_TEARING : 0;
@@ -257,6 +261,10 @@ void RHIDevice::present() {
   d3d_call(mSwapChain->Present(0, presentFlags));
   executeDeferredRelease();
 
+  // transient memory of the oldest frame in flight is handed out again, the gpu has to be done with it
+  mFrameFence->syncCpu(FrameAllocator::get().pendingFence());
+  FrameAllocator::get().beginFrame();
+
   mCurrentBackBufferIndex = mSwapChain->GetCurrentBackBufferIndex();
   mRenderContext->transitionBarrier(backBuffer().get(), RHIResource::State::RenderTarget);
   mRenderContext->transitionBarrier(depthBuffer().get(), RHIResource::State::DepthStencil);
@@ -34,9 +34,13 @@ u64 Fence::gpuSignal(command_queue_handle_t cq) {
 }
 
 void Fence::syncCpu() {
+  syncCpu(mCpuValue - 1);
+}
+
+void Fence::syncCpu(u64 value) {
   uint64_t gpuVal = gpuVaule();
-  if (gpuVal < mCpuValue - 1) {
-    d3d_call(mHandle->SetEventOnCompletion(mCpuValue - 1, mData->eventHandle));
+  if (gpuVal < value) {
+    d3d_call(mHandle->SetEventOnCompletion(value, mData->eventHandle));
     WaitForSingleObject(mData->eventHandle, INFINITE);
   }
 }
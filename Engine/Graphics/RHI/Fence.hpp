@@ -19,6 +19,8 @@ public:
   u64 gpuVaule() const;
   u64 gpuSignal(command_queue_handle_t cq);
   void syncCpu();
+  // blocks until the gpu reaches `value`
+  void syncCpu(u64 value);
   void syncGpu(command_queue_handle_t cq);
 protected:
   Fence(): mCpuValue(0) {}
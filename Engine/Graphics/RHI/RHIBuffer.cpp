@@ -3,6 +3,7 @@
 #include "Engine/Graphics/RHI/RHIDevice.hpp"
 
 RHIBuffer::~RHIBuffer() {
+  Mem::onFree(mMemTag, mTrackedSize);
   if(RHIDevice::get())
     RHIDevice::get()->releaseResource(mRhiHandle);
 }
@@ -1,6 +1,7 @@
 ﻿#pragma once
 #include "Engine/Core/common.hpp"
 #include "Engine/Graphics/RHI/RHIResource.hpp"
+#include "Engine/Memory/MemTrack.hpp"
 
 class RHIBuffer: public RHIResource, public inherit_shared_from_this<RHIResource, RHIBuffer> {
 public:
@@ -55,10 +56,13 @@ public:
 protected:
   bool rhiInit(bool hasInitData);
 
-  RHIBuffer(size_t size, BindingFlag binding, CPUAccess update)
-  : RHIResource(Type::Buffer, binding), mSize(size), mCpuAccess(update) {}
+  // the gpu memory counts against `tag` for the lifetime of the buffer, from rhiInit on
+  RHIBuffer(size_t size, BindingFlag binding, CPUAccess update, eMemTag tag = MEMTAG_UNTAGGED)
+  : RHIResource(Type::Buffer, binding), mSize(size), mCpuAccess(update), mMemTag(tag) {}
 
   size_t mSize= 0;
   CPUAccess mCpuAccess;
+  eMemTag mMemTag = MEMTAG_UNTAGGED;
+  size_t mTrackedSize = 0; // reported to Mem once rhiInit settled `mSize`, freed as is
 
 };
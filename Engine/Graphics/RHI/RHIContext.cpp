@@ -12,6 +12,7 @@
 #include "Engine/Graphics/RHI/FrameBuffer.hpp"
 #include "Engine/Graphics/RHI/PipelineState.hpp"
 #include "Engine/Graphics/RHI/VertexLayout.hpp"
+#include "Engine/Debug/Profile/Profiler.hpp"
 
 void RHIContext::updateBuffer(RHIBuffer* buffer, const void* data, size_t offset, size_t byteCount) {
   if (byteCount == 0) {
@@ -22,6 +23,7 @@ void RHIContext::updateBuffer(RHIBuffer* buffer, const void* data, size_t offset
   // I will just assume the input is always legal first
 
   mCommandsPending = true;
+  PROF_COUNTER("rhi bytes uploaded", byteCount);
 
   // Allocate a buffer on the upload heap
 
@@ -47,8 +47,8 @@ RHIBuffer::sptr_t& TypedBuffer::uavCounter() {
   return mUavCounter;
 }
 
-TypedBuffer::sptr_t TypedBuffer::create(u32 stride, u32 eleCount, BindingFlag bindingFlags) {
-  sptr_t b = sptr_t(new TypedBuffer(eleCount, stride, bindingFlags));
+TypedBuffer::sptr_t TypedBuffer::create(u32 stride, u32 eleCount, BindingFlag bindingFlags, eMemTag tag) {
+  sptr_t b = sptr_t(new TypedBuffer(eleCount, stride, bindingFlags, tag));
 
   if(!b->rhiInit(false)) {
     return nullptr;
@@ -57,10 +57,11 @@ TypedBuffer::sptr_t TypedBuffer::create(u32 stride, u32 eleCount, BindingFlag bi
   return b;
 }
 
-TypedBuffer::TypedBuffer(u32 eleCount, u32 stride, BindingFlag bindingFlags)
-  :RHIBuffer(eleCount * stride, bindingFlags, CPUAccess::None)
+TypedBuffer::TypedBuffer(u32 eleCount, u32 stride, BindingFlag bindingFlags, eMemTag tag)
+  :RHIBuffer(eleCount * stride, bindingFlags, CPUAccess::None, tag)
   , mElementCount(eleCount)
-  , mStride(stride) {
+  , mStride(stride)
+  , mData(0, tag) {
 }
 
 void TypedBuffer::set(const void* data, u32 size, u32 byteOffset) {
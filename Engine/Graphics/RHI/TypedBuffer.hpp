@@ -5,7 +5,7 @@
 #include "Engine/Graphics/RHI/ResourceView.hpp"
 
 /*
- * Array of same type elements
+ * Array of same type elements, the cpu copy and the gpu buffer both count against the memory tag it is created with
  */
 class TypedBuffer : public RHIBuffer {
 public:
@@ -78,8 +78,8 @@ public:
   virtual ShaderResourceView* srv(uint mipLevel = 0, uint mipCount = ResourceViewInfo::MAX_POSSIBLE) const override;
 
   template<typename T>
-  static sptr_t For(u32 eleCount = 1, BindingFlag bindingFlags = BindingFlag::ShaderResource) {
-    return create(sizeof(T), eleCount, bindingFlags);
+  static sptr_t For(u32 eleCount = 1, BindingFlag bindingFlags = BindingFlag::ShaderResource, eMemTag tag = MEMTAG_UNTAGGED) {
+    return create(sizeof(T), eleCount, bindingFlags, tag);
   }
 
   virtual const UnorderedAccessView* uav(uint mipLevel = 0) const override;
@@ -88,10 +88,10 @@ public:
 
   RHIBuffer::sptr_t& uavCounter();
 
-  static sptr_t create(u32 stride, u32 eleCount, BindingFlag bindingFlags = BindingFlag::ShaderResource);
+  static sptr_t create(u32 stride, u32 eleCount, BindingFlag bindingFlags = BindingFlag::ShaderResource, eMemTag tag = MEMTAG_UNTAGGED);
 protected:
 
-  TypedBuffer(u32 eleCount, u32 stride, BindingFlag bindingFlags);
+  TypedBuffer(u32 eleCount, u32 stride, BindingFlag bindingFlags, eMemTag tag);
 
   void set(const void* data, u32 size, u32 byteOffset);
   void* get(u32 byteOffset);
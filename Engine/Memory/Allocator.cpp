@@ -1,66 +1,368 @@
 #include "Allocator.hpp"
 #include "Engine/Debug/ErrorWarningAssert.hpp"
-BlockAllocator::BlockAllocator(size_t blockSize, uint prealloc)
-  : mBlockSize(blockSize)
-  , mBlockPerChunk(blockSize / CHUNK_SIZE) {
+#include "Engine/Debug/Log.hpp"
+#include "Engine/Debug/Console/Command.hpp"
+#include "Engine/Debug/Console/Console.hpp"
+#include "Engine/Core/Time/Time.hpp"
+#include "Engine/Async/Thread.hpp"
+#include <algorithm>
+#include <new>
 
-  EXPECTS(mBlockSize < CHUNK_SIZE && mBlockSize != 0);
+#define WIN32_LEAN_AND_MEAN		// Always #define this before #including <windows.h>
+#include <windows.h>
 
-  size_t chunkCount = prealloc * blockSize / CHUNK_SIZE + 1;
-  for(size_t i = 0; i < chunkCount; i++) {
-    allocChunk();
+// 16 byte steps up to 128, then 4 classes for every power of two
+static constexpr uint kClassSize[SlabAllocator::kClassCount] = {
+  16, 32, 48, 64, 80, 96, 112, 128,
+  160, 192, 224, 256,
+  320, 384, 448, 512,
+  640, 768, 896, 1024,
+  1280, 1536, 1792, 2048,
+};
+static_assert(kClassSize[SlabAllocator::kClassCount - 1] == SlabAllocator::kMaxBlockSize, "the last class is the biggest block");
+
+struct class_lookup_t {
+  u8 classOf[SlabAllocator::kMaxBlockSize / 16 + 1] = {};
+
+  constexpr class_lookup_t() {
+    uint sizeClass = 0;
+    for(uint i = 0; i < std::size(classOf); i++) {
+      while(kClassSize[sizeClass] < i * 16) sizeClass++;
+      classOf[i] = u8(sizeClass);
+    }
   }
+};
+static constexpr class_lookup_t gClassLookup;
+
+static uint batchCountOf(uint sizeClass) {
+  return std::max(4u, uint(SlabAllocator::kBatchBytes / kClassSize[sizeClass]));
 }
 
-BlockAllocator::~BlockAllocator() {
-  for(void*& chunk: mChunks) {
-    ::free(chunk);
-  }
+// chunk map: one byte for every 64 KB of address space, 0 if no slab owns the chunk,
+// otherwise 1 + instance * kClassCount + size class. Two levels cover 48 bits of address space.
+static constexpr uint kChunkShift = 16;
+static constexpr uint kMapLeafBits = 16;
+static constexpr uint kMapLeafSize = 1u << kMapLeafBits;
+static_assert(SlabAllocator::kChunkSize == 1u << kChunkShift, "chunks are addressed by their upper bits");
+static_assert(1 + SlabAllocator::kMaxInstance * SlabAllocator::kClassCount <= 255, "a chunk map entry is one byte");
+
+static std::atomic<std::atomic<u8>*> gChunkMap[1u << (48 - kChunkShift - kMapLeafBits)];
+static std::mutex gChunkMapLock;
+
+static u8 chunkEntry(const void* ptr) {
+  uintptr_t index = uintptr_t(ptr) >> kChunkShift;
+  if((index >> kMapLeafBits) >= std::size(gChunkMap)) return 0;
+  std::atomic<u8>* leaf = gChunkMap[index >> kMapLeafBits].load(std::memory_order_acquire);
+  return leaf == nullptr ? 0 : leaf[index & (kMapLeafSize - 1)].load(std::memory_order_relaxed);
 }
 
-void* BlockAllocator::alloc(size_t size) {
-  EXPECTS(size <= mBlockSize);
-  UNUSED(size);
-  if(mFreeBlocks.empty()) {
-    allocChunk();
+static void setChunkEntry(const void* chunk, u8 entry) {
+  uintptr_t index = uintptr_t(chunk) >> kChunkShift;
+  EXPECTS((index >> kMapLeafBits) < std::size(gChunkMap));
+
+  std::atomic<std::atomic<u8>*>& slot = gChunkMap[index >> kMapLeafBits];
+  std::atomic<u8>* leaf = slot.load(std::memory_order_acquire);
+  if(leaf == nullptr) {
+    std::scoped_lock lock(gChunkMapLock);
+    leaf = slot.load(std::memory_order_relaxed);
+    if(leaf == nullptr) {
+      // leaves are never freed, a lock-free reader could still be looking at one
+      leaf = new std::atomic<u8>[kMapLeafSize]{};
+      slot.store(leaf, std::memory_order_release);
+    }
   }
+  leaf[index & (kMapLeafSize - 1)].store(entry, std::memory_order_relaxed);
+}
 
-  ENSURES(!mFreeBlocks.empty());
+// live instances, a thread cache of an instance is only valid while the generation matches
+static std::mutex gInstanceLock;
+static SlabAllocator* gInstances[SlabAllocator::kMaxInstance] = {};
+static uint gNextGeneration = 1;
 
-  void* ptr = mFreeBlocks.top();
-  mFreeBlocks.pop();
+struct SlabAllocator::thread_cache_t {
+  struct instance_cache_t {
+    uint generation = 0;
+    batch_t lists[kClassCount];
+  };
+  instance_cache_t instances[kMaxInstance];
 
-  return ptr;
+  ~thread_cache_t();
+};
+
+thread_local SlabAllocator::thread_cache_t SlabAllocator::sCache;
+
+SlabAllocator::thread_cache_t::~thread_cache_t() {
+  std::scoped_lock lock(gInstanceLock);
+  for(uint i = 0; i < kMaxInstance; i++) {
+    SlabAllocator* owner = gInstances[i];
+    if(owner == nullptr || owner->mGeneration != instances[i].generation) continue;
+    for(uint c = 0; c < kClassCount; c++) {
+      if(instances[i].lists[c].count > 0) {
+        owner->giveBack(instances[i].lists[c], c, instances[i].lists[c].count);
+      }
+    }
+  }
+}
+
+SlabAllocator::SlabAllocator(eMemTag tag)
+  : mTag(tag) {
+  std::scoped_lock lock(gInstanceLock);
+  for(uint i = 0; i < kMaxInstance; i++) {
+    if(gInstances[i] == nullptr) {
+      gInstances[i] = this;
+      mInstance = i;
+      mGeneration = gNextGeneration++;
+      return;
+    }
+  }
+  ERROR_AND_DIE("too many slab allocators alive");
 }
 
-void BlockAllocator::free(void* ptr) {
-  EXPECTS(own(ptr));
+SlabAllocator::~SlabAllocator() {
+  {
+    std::scoped_lock lock(gInstanceLock);
+    gInstances[mInstance] = nullptr;
+  }
 
-  mFreeBlocks.push(ptr);
+  std::scoped_lock lock(mChunkLock);
+  for(void* chunk: mChunks) {
+    setChunkEntry(chunk, 0);
+    ::VirtualFree(chunk, 0, MEM_RELEASE);
+  }
 }
 
-void BlockAllocator::allocChunk() {
+uint SlabAllocator::classOf(size_t size) {
+  return gClassLookup.classOf[(size + 15) >> 4];
+}
 
-  uint8_t *buffer = (uint8_t*)malloc(CHUNK_SIZE);
-  mChunks.push_back(buffer);
+// a large allocation keeps its size in front of it, for the memory tracking,
+// and a marker so a pointer which did not come from the allocator is caught instead of freed
+struct large_header_t {
+  size_t size;
+  size_t marker;
+};
+static constexpr size_t kLargeHeaderSize = alignof(std::max_align_t);
+static constexpr size_t kLargeMarker = size_t(0x51ab1a26e51ab1a2ull);
+static_assert(sizeof(large_header_t) <= kLargeHeaderSize, "the header keeps the block aligned");
 
+void* SlabAllocator::alloc(size_t size) {
+  if(size > kMaxBlockSize) {
+    mLargeAllocCount.fetch_add(1, std::memory_order_relaxed);
+    byte_t* ptr = (byte_t*)::malloc(kLargeHeaderSize + size);
+    ENSURES(ptr != nullptr);
+    *(large_header_t*)ptr = { size, kLargeMarker };
+    Mem::onAlloc(mTag, size);
+    return ptr + kLargeHeaderSize;
+  }
 
-  for(size_t i = 0; i < mBlockPerChunk; ++i) {
-    mFreeBlocks.push(buffer);
-    buffer += mBlockSize;
+  thread_cache_t::instance_cache_t& cache = sCache.instances[mInstance];
+  if(cache.generation != mGeneration) {
+    // left by a destroyed instance which had the same slot, its blocks are gone with it
+    cache = {};
+    cache.generation = mGeneration;
   }
+
+  uint sizeClass = classOf(size);
+  batch_t& list = cache.lists[sizeClass];
+  if(list.head == nullptr) refill(list, sizeClass);
+  Mem::onAlloc(mTag, kClassSize[sizeClass]);
+
+  block_t* block = list.head;
+  list.head = block->next;
+  list.count--;
+  return block;
 }
 
-bool BlockAllocator::own(void* ptr) const {
+void SlabAllocator::free(void* ptr) {
+  if(ptr == nullptr) return;
 
-  for(void* chunk: mChunks) {
-    size_t offset = (uint8_t*)ptr - (uint8_t*)chunk;
-    if(offset < CHUNK_SIZE) {
-      if(offset % mBlockSize == 0) {
-        return true;
-      }
+  u8 entry = chunkEntry(ptr);
+  if(entry == 0) {
+    large_header_t* header = (large_header_t*)((byte_t*)ptr - kLargeHeaderSize);
+    // not in a chunk and not a large block either: a foreign pointer, or a large block freed twice
+    EXPECTS(header->marker == kLargeMarker);
+    header->marker = 0;
+    Mem::onFree(mTag, header->size);
+    ::free(header);
+    return;
+  }
+  EXPECTS((entry - 1u) / kClassCount == mInstance);
+
+  thread_cache_t::instance_cache_t& cache = sCache.instances[mInstance];
+  if(cache.generation != mGeneration) {
+    cache = {};
+    cache.generation = mGeneration;
+  }
+
+  uint sizeClass = (entry - 1u) % kClassCount;
+  Mem::onFree(mTag, kClassSize[sizeClass]);
+  batch_t& list = cache.lists[sizeClass];
+  block_t* block = (block_t*)ptr;
+  block->next = list.head;
+  list.head = block;
+  list.count++;
+
+  // keep one batch around, so alloc/free alternating on a batch boundary does not go to the shared list every time
+  uint batchCount = batchCountOf(sizeClass);
+  if(list.count >= 2 * batchCount) giveBack(list, sizeClass, batchCount);
+}
+
+bool SlabAllocator::own(const void* ptr) const {
+  u8 entry = chunkEntry(ptr);
+  return entry != 0 && (entry - 1u) / kClassCount == mInstance;
+}
+
+size_t SlabAllocator::blockSize(const void* ptr) {
+  u8 entry = chunkEntry(ptr);
+  return entry == 0 ? 0 : kClassSize[(entry - 1u) % kClassCount];
+}
+
+void SlabAllocator::refill(batch_t& cache, uint sizeClass) {
+  size_class_t& cls = mClasses[sizeClass];
+  std::scoped_lock lock(cls.lock);
+
+  if(!cls.batches.empty()) {
+    cache = cls.batches.back();
+    cls.batches.pop_back();
+    cls.sharedBlocks.fetch_sub(cache.count, std::memory_order_relaxed);
+    return;
+  }
+
+  size_t size = kClassSize[sizeClass];
+  uint batchCount = batchCountOf(sizeClass);
+  uint count = 0;
+  block_t* head = nullptr;
+  while(count < batchCount) {
+    if(cls.carve + size > cls.carveEnd) {
+      if(count > 0) break;
+      cls.carve = newChunk(sizeClass);
+      cls.carveEnd = cls.carve + kChunkSize;
     }
+    block_t* block = (block_t*)cls.carve;
+    cls.carve += size;
+    block->next = head;
+    head = block;
+    count++;
+  }
+
+  cache.head = head;
+  cache.count = count;
+  cls.carvedBlocks.fetch_add(count, std::memory_order_relaxed);
+}
+
+void SlabAllocator::giveBack(batch_t& cache, uint sizeClass, uint count) {
+  EXPECTS(count > 0 && count <= cache.count);
+
+  batch_t batch { cache.head, count };
+  block_t* last = cache.head;
+  for(uint i = 1; i < count; i++) last = last->next;
+  cache.head = last->next;
+  cache.count -= count;
+  last->next = nullptr;
+
+  size_class_t& cls = mClasses[sizeClass];
+  std::scoped_lock lock(cls.lock);
+  cls.batches.push_back(batch);
+  cls.sharedBlocks.fetch_add(count, std::memory_order_relaxed);
+}
+
+byte_t* SlabAllocator::newChunk(uint sizeClass) {
+  // VirtualAlloc hands out whole allocation granularity units, 64 KB aligned, what the chunk map relies on
+  byte_t* chunk = (byte_t*)::VirtualAlloc(nullptr, kChunkSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+  ENSURES(chunk != nullptr && (uintptr_t(chunk) & (kChunkSize - 1)) == 0);
+
+  setChunkEntry(chunk, u8(1 + mInstance * kClassCount + sizeClass));
+  {
+    std::scoped_lock lock(mChunkLock);
+    mChunks.push_back(chunk);
+  }
+  mReservedBytes.fetch_add(kChunkSize, std::memory_order_relaxed);
+  return chunk;
+}
+
+SlabAllocator::stats_t SlabAllocator::stats() const {
+  stats_t stats;
+  stats.reservedBytes = mReservedBytes.load(std::memory_order_relaxed);
+  stats.largeAllocCount = mLargeAllocCount.load(std::memory_order_relaxed);
+  for(uint c = 0; c < kClassCount; c++) {
+    size_t carved = mClasses[c].carvedBlocks.load(std::memory_order_relaxed);
+    size_t shared = mClasses[c].sharedBlocks.load(std::memory_order_relaxed);
+    stats.usedBytes += (carved - std::min(carved, shared)) * kClassSize[c];
+  }
+  return stats;
+}
+
+SlabAllocator& SlabAllocator::global() {
+  // never destroyed, threads still running at exit can free into it
+  static SlabAllocator* sGlobal = new SlabAllocator();
+  return *sGlobal;
+}
+
+void* SlabAllocator::Resource::do_allocate(size_t bytes, size_t alignment) {
+  // blocks are 16 bytes aligned, as malloc
+  if(alignment > alignof(std::max_align_t)) return ::operator new(bytes, std::align_val_t(alignment));
+  return mOwner.alloc(bytes);
+}
+
+void SlabAllocator::Resource::do_deallocate(void* ptr, size_t bytes, size_t alignment) {
+  if(alignment > alignof(std::max_align_t)) {
+    ::operator delete(ptr, bytes, std::align_val_t(alignment));
+    return;
+  }
+  mOwner.free(ptr);
+}
+
+COMMAND_REG("slab_stats", "", "print the memory the global slab allocator holds")(Command&) {
+  SlabAllocator::stats_t stats = SlabAllocator::global().stats();
+  Log::logf("[slab] reserved: %.1f KB, used: %.1f KB (thread caches included), allocations above %u bytes: %llu",
+            double(stats.reservedBytes) / 1024.0, double(stats.usedBytes) / 1024.0,
+            uint(SlabAllocator::kMaxBlockSize), stats.largeAllocCount);
+  return true;
+}
+
+// benchmark: every thread keeps 1024 live blocks of 16 to 1024 bytes and keeps replacing a random one
+
+static void slabBenchThread(Allocator& allocator, uint seed, uint opCount) {
+  constexpr uint kLiveCount = 1024;
+  void* live[kLiveCount] = {};
+
+  uint state = seed * 2654435761u + 1;
+  for(uint i = 0; i < opCount; i++) {
+    state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+    uint slot = state % kLiveCount;
+    size_t size = 16 + (state >> 10) % (1024 - 16 + 1);
+    allocator.free(live[slot]);
+    live[slot] = allocator.alloc(size);
+    *(uint*)live[slot] = i;
+  }
+
+  for(void* ptr: live) allocator.free(ptr);
+}
+
+static double slabBenchRun(Allocator& allocator, uint threadCount, uint opCount) {
+  u64 start = GetPerformanceCounter();
+  std::vector<Thread> threads;
+  threads.reserve(threadCount);
+  for(uint i = 0; i < threadCount; i++) {
+    threads.emplace_back("slab bench", &slabBenchThread, std::ref(allocator), i, opCount);
+  }
+  for(Thread& thread: threads) thread.join();
+  return PerformanceCountToSecond(GetPerformanceCounter() - start);
+}
+
+COMMAND_REG("slab_bench", "", "replace 1M random 16-1024 byte blocks per thread through malloc and the slab allocator, 1 to 16 threads")(Command&) {
+  constexpr uint kOpCount = 1000000;
+  DefaultAllocator heap;
+  SlabAllocator& slab = SlabAllocator::global();
+
+  for(uint threadCount = 1; threadCount <= 16; threadCount *= 2) {
+    double heapSeconds = slabBenchRun(heap, threadCount, kOpCount);
+    double slabSeconds = slabBenchRun(slab, threadCount, kOpCount);
+    Log::logf("[slab_bench] %u threads: malloc %s, slab %s (x%.2f)", threadCount,
+              beautifySeconds(heapSeconds).c_str(), beautifySeconds(slabSeconds).c_str(), heapSeconds / slabSeconds);
   }
 
-  return false;
+  SlabAllocator::stats_t stats = slab.stats();
+  Log::logf("[slab_bench] slab reserved: %.1f KB", double(stats.reservedBytes) / 1024.0);
+  return true;
 }
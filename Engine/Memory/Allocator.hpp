@@ -1,44 +1,127 @@
 #pragma once
 
 #include "Engine/Core/common.hpp"
+#include "Engine/Memory/MemTrack.hpp"
+#include <atomic>
+#include <memory_resource>
+#include <mutex>
 #include <vector>
-#include <stack>
 
 
 class Allocator {
 public:
   virtual ~Allocator() = default;
 
-private:
   virtual void* alloc(size_t size) = 0;
   virtual void free(void* ptr) = 0;
+
+  template<typename T, typename ...Args>
+  T* create(Args&& ...args) {
+    return new (alloc(sizeof(T))) T(std::forward<Args>(args)...);
+  }
+
+  template<typename T>
+  void destroy(T* obj) {
+    if(obj == nullptr) return;
+    obj->~T();
+    free(obj);
+  }
 };
 
 
 class DefaultAllocator: public Allocator {
 
 public:
-    virtual ~DefaultAllocator() override;
-private:
+  virtual ~DefaultAllocator() override = default;
   void* alloc(size_t size) override { return malloc(size); };
   void free(void* ptr) override { ::free(ptr); };
 };
 
-class BlockAllocator: public Allocator {
-  static constexpr size_t CHUNK_SIZE = 64 KB;
+/*
+ * size-class slab allocator, thread safe.
+ * Blocks up to kMaxBlockSize come from 64 KB aligned chunks, every chunk serves one size class; a global chunk map
+ * gives the owner and the class of any pointer without reading it. Bigger requests go to malloc behind a marked header;
+ * freeing a pointer which is neither in a chunk nor behind that header fails an EXPECTS.
+ * Every thread keeps a free list per class; alloc and free only touch it, a full batch of blocks moves between
+ * the thread and the shared list of the class under a lock once in kBatchBytes worth of operations,
+ * so blocks freed on another thread flow back in batches. Blocks count against the memory tag of the allocator.
+ *   NetPacket* packet = SlabAllocator::global().create<NetPacket>();
+ *   SlabAllocator::global().destroy(packet);
+ */
+class SlabAllocator: public Allocator {
 public:
-  BlockAllocator(size_t blockSize, uint prealloc = 0);
-  virtual ~BlockAllocator() override;
+  static constexpr size_t kChunkSize = 64 KB;
+  static constexpr size_t kMaxBlockSize = 2048;
+  static constexpr size_t kBatchBytes = 8 KB;   // how much moves between a thread and the shared list at once
+  static constexpr uint   kClassCount = 24;
+  static constexpr uint   kMaxInstance = 8;     // instances alive at the same time, thread caches are indexed by instance
+
+  struct stats_t {
+    size_t reservedBytes = 0;  // chunks taken from the heap
+    size_t usedBytes = 0;      // blocks carved out of the chunks, minus the ones in the shared lists
+    u64 largeAllocCount = 0;   // requests above kMaxBlockSize, served by malloc
+  };
+
+  explicit SlabAllocator(eMemTag tag = MEMTAG_UNTAGGED);
+  ~SlabAllocator() override;
+  SlabAllocator(const SlabAllocator&) = delete;
+  SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+  void* alloc(size_t size) override;
+  void free(void* ptr) override;
+
+  // O(1), looks the chunk up in the chunk map, the pointer itself is never read
+  bool own(const void* ptr) const;
+  // size of the block behind `ptr`, 0 if the slab allocator does not own it
+  static size_t blockSize(const void* ptr);
+
+  stats_t stats() const;
+  // std::pmr adapter, for containers of small nodes, eg. std::pmr::map
+  std::pmr::memory_resource* resource() { return &mResource; }
+
+  static SlabAllocator& global();
+
+protected:
+  struct block_t {
+    block_t* next;
+  };
+  struct batch_t {
+    block_t* head = nullptr;
+    uint count = 0;
+  };
+  struct alignas(64) size_class_t {
+    std::mutex lock;
+    std::vector<batch_t> batches;  // lists handed back by threads
+    byte_t* carve = nullptr;       // unused part of the newest chunk
+    byte_t* carveEnd = nullptr;
+    std::atomic<size_t> carvedBlocks = 0;
+    std::atomic<size_t> sharedBlocks = 0;
+  };
+  struct thread_cache_t;
+  static thread_local thread_cache_t sCache;
 
-  virtual void* alloc(size_t size) override;
-  virtual void  free(void* ptr) override;
+  class Resource: public std::pmr::memory_resource {
+  public:
+    explicit Resource(SlabAllocator& owner): mOwner(owner) {}
+  protected:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* ptr, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+    SlabAllocator& mOwner;
+  };
 
-private:
-  void allocChunk();
-  bool own(void* ptr) const;
+  static uint classOf(size_t size);
+  void refill(batch_t& cache, uint sizeClass);
+  void giveBack(batch_t& cache, uint sizeClass, uint count);
+  byte_t* newChunk(uint sizeClass);
 
+  uint mInstance = 0;
+  uint mGeneration = 0;
+  eMemTag mTag = MEMTAG_UNTAGGED;
+  size_class_t mClasses[kClassCount];
+  std::mutex mChunkLock;
   std::vector<void*> mChunks;
-  std::stack<void*> mFreeBlocks;
-  const size_t mBlockSize;
-  const size_t mBlockPerChunk;
+  std::atomic<size_t> mReservedBytes = 0;
+  std::atomic<u64> mLargeAllocCount = 0;
+  Resource mResource { *this };
 };
@@ -0,0 +1,160 @@
+﻿#include "FrameAllocator.hpp"
+#include "Engine/Debug/ErrorWarningAssert.hpp"
+#include "Engine/Debug/Log.hpp"
+#include "Engine/Debug/Console/Command.hpp"
+#include "Engine/Debug/Console/Console.hpp"
+#include "Engine/Memory/MemTrack.hpp"
+#include <algorithm>
+#include <new>
+
+class FrameResource: public std::pmr::memory_resource {
+protected:
+  void* do_allocate(size_t bytes, size_t alignment) override {
+    return FrameAllocator::get().alloc(bytes, alignment);
+  }
+
+  void do_deallocate(void*, size_t, size_t) override {}
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+};
+
+static FrameResource gFrameResource;
+
+FrameAllocator::FrameAllocator() {}
+
+FrameAllocator::~FrameAllocator() {
+  for(region_t& region: mRegions) {
+    for(block_t* block: region.blocks) {
+      Mem::onFree(MEMTAG_TRANSIENT, sizeof(block_t) + block->capacity);
+      ::free(block);
+    }
+  }
+}
+
+void* FrameAllocator::alloc(size_t size, size_t alignment) {
+  EXPECTS((alignment & (alignment - 1)) == 0);
+
+  for(;;) {
+    u64 epoch = mEpoch.load();
+    if(epoch & 1) {
+      // beginFrame holds the lock until the new region is in place
+      std::scoped_lock wait(mLock);
+      continue;
+    }
+
+    block_t* block = mBlock.load(std::memory_order_acquire);
+    if(block != nullptr) {
+      uintptr_t base = uintptr_t(block + 1);
+      size_t used = block->used.load(std::memory_order_relaxed);
+      for(;;) {
+        size_t offset = align_to(alignment, base + used) - base;
+        if(offset + size > block->capacity) break;
+        if(block->used.compare_exchange_weak(used, offset + size)) {
+          // the block may belong to the frame which just ended, its fence does not cover this allocation;
+          // the bytes are left unused
+          if(mEpoch.load() != epoch) break;
+          return (byte_t*)base + offset;
+        }
+      }
+      if(mEpoch.load() != epoch) continue;
+    }
+    nextBlock(block, size, alignment);
+  }
+}
+
+void FrameAllocator::nextBlock(block_t* full, size_t size, size_t alignment) {
+  static_assert(sizeof(block_t) % alignof(std::max_align_t) == 0, "block data starts aligned");
+  std::scoped_lock lock(mLock);
+  // another thread moved on already
+  if(mBlock.load(std::memory_order_relaxed) != full) return;
+
+  // blocks kept from earlier frames come first, one too small for this allocation is skipped for the rest of the frame
+  region_t& region = mRegions[mRegionIndex];
+  uint next = full == nullptr ? 0 : region.current + 1;
+  while(next < region.blocks.size() && region.blocks[next]->capacity < size + alignment) next++;
+
+  if(next == region.blocks.size()) {
+    size_t capacity = std::max(kBlockSize - sizeof(block_t), size + alignment);
+    block_t* block = (block_t*)::malloc(sizeof(block_t) + capacity);
+    ENSURES(block != nullptr);
+    block->capacity = capacity;
+    new (&block->used) std::atomic<size_t>(0);
+    next = full == nullptr ? 0 : region.current + 1;
+    region.blocks.insert(region.blocks.begin() + next, block);
+    mHeapAllocCount.fetch_add(1, std::memory_order_relaxed);
+    mReservedBytes.fetch_add(sizeof(block_t) + capacity, std::memory_order_relaxed);
+    Mem::onAlloc(MEMTAG_TRANSIENT, sizeof(block_t) + capacity);
+  }
+
+  region.current = next;
+  mBlock.store(region.blocks[next], std::memory_order_release);
+}
+
+size_t FrameAllocator::usedBytes(const region_t& region) const {
+  // blocks are reset when the region starts a frame, the ones after `current` are untouched
+  size_t used = 0;
+  for(uint i = 0; i <= region.current && i < region.blocks.size(); i++) {
+    used += region.blocks[i]->used.load(std::memory_order_relaxed);
+  }
+  return used;
+}
+
+void FrameAllocator::endFrame(u64 fenceValue) {
+  std::scoped_lock lock(mLock);
+  mRegions[mRegionIndex].fence = fenceValue;
+}
+
+u64 FrameAllocator::pendingFence() const {
+  std::scoped_lock lock(mLock);
+  return mRegions[(mRegionIndex + 1) % kFrameCount].fence;
+}
+
+void FrameAllocator::beginFrame() {
+  std::scoped_lock lock(mLock);
+  mEpoch.fetch_add(1);
+
+  size_t frameBytes = usedBytes(mRegions[mRegionIndex]);
+  mLastFrameBytes.store(frameBytes, std::memory_order_relaxed);
+  if(frameBytes > mPeakFrameBytes.load(std::memory_order_relaxed)) {
+    mPeakFrameBytes.store(frameBytes, std::memory_order_relaxed);
+  }
+
+  mRegionIndex = (mRegionIndex + 1) % kFrameCount;
+  region_t& region = mRegions[mRegionIndex];
+  for(block_t* block: region.blocks) block->used.store(0, std::memory_order_relaxed);
+  region.current = 0;
+  mBlock.store(region.blocks.empty() ? nullptr : region.blocks[0], std::memory_order_release);
+  mEpoch.fetch_add(1);
+}
+
+FrameAllocator::stats_t FrameAllocator::stats() const {
+  stats_t stats;
+  {
+    std::scoped_lock lock(mLock);
+    stats.frameBytes = usedBytes(mRegions[mRegionIndex]);
+  }
+  stats.reservedBytes = mReservedBytes.load(std::memory_order_relaxed);
+  stats.heapAllocCount = mHeapAllocCount.load(std::memory_order_relaxed);
+  stats.lastFrameBytes = mLastFrameBytes.load(std::memory_order_relaxed);
+  stats.peakFrameBytes = mPeakFrameBytes.load(std::memory_order_relaxed);
+  return stats;
+}
+
+FrameAllocator& FrameAllocator::get() {
+  static FrameAllocator sAllocator;
+  return sAllocator;
+}
+
+std::pmr::memory_resource* FrameAllocator::resource() {
+  return &gFrameResource;
+}
+
+COMMAND_REG("frame_alloc_stats", "", "print how much transient memory the frame allocator handed out")(Command&) {
+  FrameAllocator::stats_t stats = FrameAllocator::get().stats();
+  Log::logf("[frame_alloc] last frame: %.1f KB, peak frame: %.1f KB, reserved: %.1f KB in %llu heap allocations for %u frames in flight",
+            double(stats.lastFrameBytes) / 1024.0, double(stats.peakFrameBytes) / 1024.0,
+            double(stats.reservedBytes) / 1024.0, stats.heapAllocCount, FrameAllocator::kFrameCount);
+  return true;
+}
@@ -0,0 +1,79 @@
+﻿#pragma once
+#include "Engine/Core/common.hpp"
+#include <atomic>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+/*
+ * linear allocator for transient data of a frame which the gpu may still read after the cpu moved on.
+ * Memory comes from one region per frame in flight; a region is reused kFrameCount frames later,
+ * once the gpu fence of the frame it served has been reached. Allocation is a lock-free pointer bump from any thread,
+ * nothing is freed one by one. RHIDevice::present drives the frame boundary while jobs keep allocating: memory belongs
+ * to the frame alloc() returned in, a bump that raced with beginFrame() is dropped and done again in the new region.
+ *   Mesher ms(FrameAllocator::resource());
+ *   vertex_t* vertices = FrameAllocator::get().alloc<vertex_t>(count);
+ * For cpu-only temporaries of one thread, ScratchArena is cheaper.
+ */
+class FrameAllocator {
+public:
+  static constexpr uint kFrameCount = 2; // RHIDevice::FRAME_COUNT
+  static constexpr size_t kBlockSize = 1024 KB;
+
+  struct stats_t {
+    size_t reservedBytes = 0;   // blocks of every region
+    size_t frameBytes = 0;      // handed out in the frame in progress so far
+    size_t lastFrameBytes = 0;
+    size_t peakFrameBytes = 0;  // since startup
+    u64 heapAllocCount = 0;
+  };
+
+  FrameAllocator();
+  ~FrameAllocator();
+  FrameAllocator(const FrameAllocator&) = delete;
+  FrameAllocator& operator=(const FrameAllocator&) = delete;
+
+  // any thread, also while beginFrame runs
+  void* alloc(size_t size, size_t alignment = alignof(std::max_align_t));
+  template<typename T>
+  T* alloc(size_t count = 1) { return (T*)alloc(sizeof(T) * count, alignof(T)); }
+
+  // the gpu work reading the memory of the frame in progress is done once the frame fence reaches `fenceValue`
+  void endFrame(u64 fenceValue);
+  // the fence value to wait for before beginFrame() hands the memory of the oldest frame out again
+  u64 pendingFence() const;
+  // starts the next frame
+  void beginFrame();
+
+  stats_t stats() const;
+
+  static FrameAllocator& get();
+  // std::pmr adapter of get(), deallocation does nothing
+  static std::pmr::memory_resource* resource();
+
+protected:
+  struct block_t {
+    size_t capacity; // usable bytes after the header
+    std::atomic<size_t> used;
+  };
+  struct region_t {
+    std::vector<block_t*> blocks;
+    uint current = 0;
+    u64 fence = 0;
+  };
+
+  void nextBlock(block_t* full, size_t size, size_t alignment);
+  size_t usedBytes(const region_t& region) const;
+
+  region_t mRegions[kFrameCount];
+  uint mRegionIndex = 0;
+  std::atomic<block_t*> mBlock = nullptr;
+  // odd while beginFrame switches regions, an allocation is only valid if it did not change around the bump
+  std::atomic<u64> mEpoch = 0;
+  mutable std::mutex mLock;
+
+  std::atomic<size_t> mReservedBytes = 0;
+  std::atomic<u64> mHeapAllocCount = 0;
+  std::atomic<size_t> mLastFrameBytes = 0;
+  std::atomic<size_t> mPeakFrameBytes = 0;
+};
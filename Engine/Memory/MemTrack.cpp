@@ -0,0 +1,155 @@
+﻿#include "MemTrack.hpp"
+#include "Engine/Debug/ErrorWarningAssert.hpp"
+#include "Engine/Debug/Log.hpp"
+#include "Engine/Debug/Console/Command.hpp"
+#include "Engine/Debug/Console/Console.hpp"
+#include "Engine/Core/StringUtils.hpp"
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+using Mem::detail::thread_record_t;
+
+static const char* kTagName[NUM_MEMTAG] = { "Untagged", "Net", "Mesh", "Resource", "Log", "Job", "Transient" };
+
+// records are never freed: a thread which exits leaves its record to the next new thread, so its counts stay in the sums
+static std::mutex gRecordLock;
+static std::vector<thread_record_t*> gRecords;
+static std::vector<thread_record_t*> gFreeRecords;
+// counts of threads whose record is already given away, eg. from destructors of other thread locals at thread exit
+static thread_record_t gExitRecord;
+
+static std::atomic<int64> gPeakBytes[NUM_MEMTAG] = {};
+static std::atomic<size_t> gBudget[NUM_MEMTAG] = {};
+static bool gOverBudget[NUM_MEMTAG] = {};
+
+thread_local thread_record_t* Mem::detail::tRecord = nullptr;
+static thread_local bool tExited = false;
+
+struct record_owner_t {
+  thread_record_t* record = nullptr;
+
+  ~record_owner_t() {
+    tExited = true;
+    Mem::detail::tRecord = nullptr;
+    std::scoped_lock lock(gRecordLock);
+    gFreeRecords.push_back(record);
+  }
+};
+
+void Mem::detail::trackSlow(eMemTag tag, int64 bytes, u64 count) {
+  if(tExited) {
+    gExitRecord.liveBytes[tag].fetch_add(bytes, std::memory_order_relaxed);
+    gExitRecord.allocCount[tag].fetch_add(count, std::memory_order_relaxed);
+    return;
+  }
+
+  static thread_local record_owner_t sOwner;
+  {
+    std::scoped_lock lock(gRecordLock);
+    if(gFreeRecords.empty()) {
+      sOwner.record = new thread_record_t();
+      gRecords.push_back(sOwner.record);
+    } else {
+      sOwner.record = gFreeRecords.back();
+      gFreeRecords.pop_back();
+    }
+  }
+  tRecord = sOwner.record;
+  track(tag, bytes, count);
+}
+
+const char* Mem::tagName(eMemTag tag) {
+  EXPECTS(tag < NUM_MEMTAG);
+  return kTagName[tag];
+}
+
+eMemTag Mem::tagFromName(const char* name) {
+  for(uint i = 0; i < NUM_MEMTAG; i++) {
+    if(_stricmp(name, kTagName[i]) == 0) return eMemTag(i);
+  }
+  return NUM_MEMTAG;
+}
+
+static void sumRecords(int64 (&liveBytes)[NUM_MEMTAG], u64 (&allocCount)[NUM_MEMTAG]) {
+  for(uint i = 0; i < NUM_MEMTAG; i++) {
+    liveBytes[i] = gExitRecord.liveBytes[i].load(std::memory_order_relaxed);
+    allocCount[i] = gExitRecord.allocCount[i].load(std::memory_order_relaxed);
+  }
+
+  std::scoped_lock lock(gRecordLock);
+  for(thread_record_t* record: gRecords) {
+    for(uint i = 0; i < NUM_MEMTAG; i++) {
+      liveBytes[i] += record->liveBytes[i].load(std::memory_order_relaxed);
+      allocCount[i] += record->allocCount[i].load(std::memory_order_relaxed);
+    }
+  }
+}
+
+static int64 samplePeak(eMemTag tag, int64 liveBytes) {
+  int64 peak = gPeakBytes[tag].load(std::memory_order_relaxed);
+  while(liveBytes > peak && !gPeakBytes[tag].compare_exchange_weak(peak, liveBytes, std::memory_order_relaxed)) {}
+  return std::max(peak, liveBytes);
+}
+
+Mem::tag_stats_t Mem::stats(eMemTag tag) {
+  EXPECTS(tag < NUM_MEMTAG);
+  int64 liveBytes[NUM_MEMTAG];
+  u64 allocCount[NUM_MEMTAG];
+  sumRecords(liveBytes, allocCount);
+
+  tag_stats_t stats;
+  stats.liveBytes = liveBytes[tag];
+  stats.peakBytes = samplePeak(tag, liveBytes[tag]);
+  stats.allocCount = allocCount[tag];
+  stats.budget = gBudget[tag].load(std::memory_order_relaxed);
+  return stats;
+}
+
+void Mem::setBudget(eMemTag tag, size_t bytes) {
+  EXPECTS(tag < NUM_MEMTAG);
+  gBudget[tag].store(bytes, std::memory_order_relaxed);
+}
+
+void Mem::markFrame() {
+  int64 liveBytes[NUM_MEMTAG];
+  u64 allocCount[NUM_MEMTAG];
+  sumRecords(liveBytes, allocCount);
+
+  for(uint i = 0; i < NUM_MEMTAG; i++) {
+    samplePeak(eMemTag(i), liveBytes[i]);
+
+    size_t budget = gBudget[i].load(std::memory_order_relaxed);
+    bool over = budget != 0 && liveBytes[i] > int64(budget);
+    if(over && !gOverBudget[i]) {
+      Log::warnf("[mem] %s is over its budget: %.1f KB of %.1f KB", kTagName[i], double(liveBytes[i]) / 1024.0, double(budget) / 1024.0);
+    }
+    gOverBudget[i] = over;
+  }
+}
+
+COMMAND_REG("mem", "", "print live, peak bytes and allocation count of every memory tag")(Command&) {
+  for(uint i = 0; i < NUM_MEMTAG; i++) {
+    Mem::tag_stats_t stats = Mem::stats(eMemTag(i));
+    std::string budget = stats.budget == 0 ? "-" : Stringf("%.1f KB", double(stats.budget) / 1024.0);
+    Log::logf("[mem] %-10s live: %10.1f KB  peak: %10.1f KB  allocations: %10llu  budget: %s",
+              kTagName[i], double(stats.liveBytes) / 1024.0, double(stats.peakBytes) / 1024.0, stats.allocCount, budget.c_str());
+  }
+  return true;
+}
+
+COMMAND_REG("mem_budget", "[tag: string][kb: uint = 0]", "set the budget of a memory tag in KB, 0 removes it")(Command& cmd) {
+  std::string name = cmd.arg<0, std::string>();
+  eMemTag tag = Mem::tagFromName(name.c_str());
+  if(tag == NUM_MEMTAG) {
+    Log::warnf("[mem] no memory tag called %s", name.c_str());
+    return false;
+  }
+
+  uint kb = 0;
+  try {
+    kb = cmd.arg<1, uint>();
+  } catch(const ArgumentNotFoundException&) {}
+  Mem::setBudget(tag, size_t(kb) KB);
+  return true;
+}
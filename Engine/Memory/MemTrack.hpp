@@ -0,0 +1,64 @@
+﻿#pragma once
+#include "Engine/Core/common.hpp"
+#include <atomic>
+
+enum eMemTag: uint8_t {
+  MEMTAG_UNTAGGED = 0,
+  MEMTAG_NET,
+  MEMTAG_MESH,
+  MEMTAG_RESOURCE,
+  MEMTAG_LOG,
+  MEMTAG_JOB,
+  MEMTAG_TRANSIENT,   // blocks of the scratch arenas and the frame allocator
+  NUM_MEMTAG,
+};
+
+/*
+ * memory tracking per subsystem tag. Allocators and pools report what they hand out through onAlloc/onFree,
+ * every thread counts into its own record with plain stores, the records are only summed when someone asks.
+ * Peaks are sampled: at every frame boundary and every stats() call. A tag over its budget logs a warning
+ * at the frame boundary, once until it goes back under.
+ *   Mem::onAlloc(MEMTAG_NET, size);
+ *   Mem::setBudget(MEMTAG_MESH, 64 * 1024 KB);
+ */
+namespace Mem {
+  struct tag_stats_t {
+    int64 liveBytes = 0;
+    int64 peakBytes = 0;
+    u64 allocCount = 0;  // since startup
+    size_t budget = 0;   // 0 if the tag has no budget
+  };
+
+  namespace detail {
+    struct thread_record_t {
+      std::atomic<int64> liveBytes[NUM_MEMTAG] = {};
+      std::atomic<u64> allocCount[NUM_MEMTAG] = {};
+    };
+    extern thread_local thread_record_t* tRecord;
+    void trackSlow(eMemTag tag, int64 bytes, u64 count);
+  }
+
+  inline void track(eMemTag tag, int64 bytes, u64 count) {
+    detail::thread_record_t* record = detail::tRecord;
+    if(record == nullptr) {
+      detail::trackSlow(tag, bytes, count);
+      return;
+    }
+    // only the owner thread writes its record
+    record->liveBytes[tag].store(record->liveBytes[tag].load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+    record->allocCount[tag].store(record->allocCount[tag].load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+  }
+
+  inline void onAlloc(eMemTag tag, size_t bytes) { track(tag, int64(bytes), 1); }
+  inline void onFree(eMemTag tag, size_t bytes) { track(tag, -int64(bytes), 0); }
+
+  const char* tagName(eMemTag tag);
+  // NUM_MEMTAG if no tag has that name, case insensitive
+  eMemTag tagFromName(const char* name);
+
+  tag_stats_t stats(eMemTag tag);
+  void setBudget(eMemTag tag, size_t bytes);
+
+  // samples the peaks and checks the budgets, the application calls it once per frame
+  void markFrame();
+}
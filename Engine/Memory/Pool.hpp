@@ -1,33 +1,163 @@
 ﻿#pragma once
 #include "Engine/Core/common.hpp"
-#include <stack>
-#include "Engine/Memory/Allocator.hpp"
+#include "Engine/Debug/ErrorWarningAssert.hpp"
+#include "Engine/Memory/MemTrack.hpp"
+#include <algorithm>
+#include <new>
+#include <vector>
 
-template<typename T>
+/*
+ * object pool handing out 32 bit handles: 20 bits of slot index, 12 bits of generation.
+ * Objects live in pages of kPageCapacity slots which are never moved, so raw pointers stay valid until release.
+ * A released slot bumps its generation, `get` returns nullptr for a handle of an object which is gone.
+ * Released slots are reused first and `forEach` walks the pages in address order, so live objects are visited linearly.
+ * Live objects count against the memory tag given at construction. Not thread safe.
+ *   Pool<Particle>::handle_t h = pool.create(position);
+ *   if(Particle* p = pool.get(h)) p->update();
+ *   pool.forEach([](Particle& p) { p.update(); });
+ *   pool.release(h);
+ */
+template<typename T, uint kPageCapacity = 64>
 class Pool {
 public:
+  static constexpr uint kIndexBits = 20;
+  static constexpr uint kMaxCount = 1u << kIndexBits;
+  static constexpr uint kGenerationMask = (1u << (32 - kIndexBits)) - 1;
+
+  class handle_t {
+    friend class Pool;
+  public:
+    handle_t() = default;
+    uint index() const { return mValue & (kMaxCount - 1); }
+    uint generation() const { return mValue >> kIndexBits; }
+    u32 value() const { return mValue; }
+    bool valid() const { return mValue != 0; }
+    bool operator==(const handle_t& rhs) const { return mValue == rhs.mValue; }
+    bool operator!=(const handle_t& rhs) const { return mValue != rhs.mValue; }
+
+  protected:
+    handle_t(uint index, uint generation): mValue(index | ((generation & kGenerationMask) << kIndexBits)) {}
+    u32 mValue = 0; // 0 is never handed out, a live slot has an odd generation
+  };
+
+  explicit Pool(eMemTag tag = MEMTAG_UNTAGGED): mTag(tag) {}
+  Pool(const Pool&) = delete;
+  Pool& operator=(const Pool&) = delete;
+
   ~Pool() {
-    while(!mFreeObjects.empty()) {
-      T* ptr = mFreeObjects.top();
-      delete ptr;
-    }
+    clear();
+    for(slot_t* page: mPages) ::free(page);
   }
 
   template<typename ...Args>
-  T* acquire(Args... args) {
-    T* ptr = nullptr;
-    if(mFreeObjects.empty()) {
-      ptr = new T(args...);
-    } else {
-      ptr = mFreeObjects.top();
-    }
-    return ptr;
+  handle_t create(Args&& ...args) {
+    slot_t& slot = claimSlot();
+    new (slot.storage) T(std::forward<Args>(args)...);
+    slot.generation++;
+    mPageLiveCount[slot.index / kPageCapacity]++;
+    mCount++;
+    Mem::onAlloc(mTag, sizeof(T));
+    return { slot.index, slot.generation };
+  }
+
+  template<typename ...Args>
+  T* acquire(Args&& ...args) {
+    return get(create(std::forward<Args>(args)...));
+  }
+
+  void release(handle_t handle) {
+    T* obj = get(handle);
+    EXPECTS(obj != nullptr);
+    release(obj);
   }
 
   void release(T* obj) {
-    mFreeObjects.push(obj);
+    slot_t& slot = slotOf(obj);
+    EXPECTS(alive(slot));
+    obj->~T();
+    slot.generation++;
+    slot.nextFree = mFreeHead;
+    mFreeHead = slot.index;
+    mPageLiveCount[slot.index / kPageCapacity]--;
+    mCount--;
+    Mem::onFree(mTag, sizeof(T));
+  }
+
+  // nullptr if the object of the handle has been released
+  T* get(handle_t handle) const {
+    uint index = handle.index();
+    if(index >= mSlotCount) return nullptr;
+    slot_t& slot = slotAt(index);
+    if(!alive(slot) || (slot.generation & kGenerationMask) != handle.generation()) return nullptr;
+    return (T*)slot.storage;
+  }
+
+  handle_t handleOf(const T* obj) const {
+    const slot_t& slot = slotOf(obj);
+    EXPECTS(alive(slot));
+    return { slot.index, slot.generation };
+  }
+
+  template<typename Fn>
+  void forEach(Fn&& fn) {
+    for(uint p = 0; p < mPages.size(); p++) {
+      if(mPageLiveCount[p] == 0) continue;
+      slot_t* page = mPages[p];
+      uint end = std::min(kPageCapacity, mSlotCount - p * kPageCapacity);
+      for(uint i = 0; i < end; i++) {
+        if(alive(page[i])) fn(*(T*)page[i].storage);
+      }
+    }
+  }
+
+  void clear() {
+    forEach([this](T& obj) { release(&obj); });
+  }
+
+  uint size() const { return mCount; }
+  uint capacity() const { return uint(mPages.size()) * kPageCapacity; }
+
+protected:
+  static constexpr uint kNoSlot = ~0u;
+
+  struct slot_t {
+    alignas(T) byte_t storage[sizeof(T)];
+    uint index;
+    uint generation;  // odd while the slot holds an object
+    uint nextFree;
+  };
+  static_assert(alignof(T) <= alignof(std::max_align_t), "pages come from malloc");
+
+  static bool alive(const slot_t& slot) { return (slot.generation & 1) != 0; }
+  slot_t& slotAt(uint index) const { return mPages[index / kPageCapacity][index % kPageCapacity]; }
+  // the object is the first member of its slot
+  static slot_t& slotOf(const T* obj) { return *(slot_t*)obj; }
+
+  slot_t& claimSlot() {
+    if(mFreeHead != kNoSlot) {
+      slot_t& slot = slotAt(mFreeHead);
+      mFreeHead = slot.nextFree;
+      return slot;
+    }
+
+    EXPECTS(mSlotCount < kMaxCount);
+    if(mSlotCount == capacity()) {
+      slot_t* page = (slot_t*)::malloc(sizeof(slot_t) * kPageCapacity);
+      ENSURES(page != nullptr);
+      mPages.push_back(page);
+      mPageLiveCount.push_back(0);
+    }
+    slot_t& slot = slotAt(mSlotCount);
+    slot.index = mSlotCount++;
+    slot.generation = 0;
+    slot.nextFree = kNoSlot;
+    return slot;
   }
 
-private:
-  std::stack<T*> mFreeObjects;
+  std::vector<slot_t*> mPages;
+  std::vector<uint> mPageLiveCount;
+  uint mSlotCount = 0;  // slots ever handed out, the high-water mark
+  uint mCount = 0;
+  uint mFreeHead = kNoSlot;
+  eMemTag mTag = MEMTAG_UNTAGGED;
 };
@@ -1 +1,125 @@
 ﻿#include "RingBuffer.hpp"
+#include "Engine/Debug/Log.hpp"
+#include "Engine/Debug/Console/Command.hpp"
+#include "Engine/Debug/Console/Console.hpp"
+#include "Engine/Core/Time/Time.hpp"
+#include "Engine/Async/Thread.hpp"
+#include <mutex>
+#include <queue>
+#include <vector>
+
+// benchmark: producers push 2M integers in total, consumers pop them all, a full or empty queue yields the thread
+
+static constexpr size_t kRingBenchCapacity = 1024;
+static constexpr u64 kRingBenchItemCount = 2000000;
+
+// the baseline the lock-free queues replace
+class LockedQueue {
+public:
+  bool tryPush(u64 val) {
+    std::scoped_lock lock(mLock);
+    if(mQueue.size() >= kRingBenchCapacity) return false;
+    mQueue.push(val);
+    return true;
+  }
+  bool tryPop(u64& out) {
+    std::scoped_lock lock(mLock);
+    if(mQueue.empty()) return false;
+    out = mQueue.front();
+    mQueue.pop();
+    return true;
+  }
+  size_t pushBatch(const u64* values, size_t count) {
+    std::scoped_lock lock(mLock);
+    count = std::min(count, kRingBenchCapacity - mQueue.size());
+    for(size_t i = 0; i < count; i++) mQueue.push(values[i]);
+    return count;
+  }
+  size_t popBatch(u64* out, size_t maxCount) {
+    std::scoped_lock lock(mLock);
+    size_t count = std::min(maxCount, mQueue.size());
+    for(size_t i = 0; i < count; i++) {
+      out[i] = mQueue.front();
+      mQueue.pop();
+    }
+    return count;
+  }
+protected:
+  std::mutex mLock;
+  std::queue<u64> mQueue;
+};
+
+template<typename Queue>
+static void ringBenchProducer(Queue& queue, u64 first, u64 count, uint batchSize) {
+  u64 batch[64];
+  for(u64 i = 0; i < count;) {
+    if(batchSize == 1) {
+      if(queue.tryPush(first + i)) i++;
+      else CurrentThread::yield();
+      continue;
+    }
+    size_t n = (size_t)std::min<u64>(batchSize, count - i);
+    for(size_t k = 0; k < n; k++) batch[k] = first + i + k;
+    size_t pushed = queue.pushBatch(batch, n);
+    i += pushed;
+    if(pushed < n) CurrentThread::yield();
+  }
+}
+
+template<typename Queue>
+static void ringBenchConsumer(Queue& queue, std::atomic<u64>& popped, std::atomic<u64>& checksum, uint batchSize) {
+  u64 batch[64];
+  u64 sum = 0;
+  while(popped.load(std::memory_order_relaxed) < kRingBenchItemCount) {
+    size_t n = 0;
+    if(batchSize == 1) n = queue.tryPop(batch[0]) ? 1 : 0;
+    else n = queue.popBatch(batch, batchSize);
+    if(n == 0) {
+      CurrentThread::yield();
+      continue;
+    }
+    for(size_t k = 0; k < n; k++) sum += batch[k];
+    popped.fetch_add(n, std::memory_order_relaxed);
+  }
+  checksum.fetch_add(sum, std::memory_order_relaxed);
+}
+
+template<typename Queue>
+static void ringBenchRun(const char* name, uint producerCount, uint consumerCount, uint batchSize) {
+  Queue* queue = new Queue();
+  std::atomic<u64> popped = 0;
+  std::atomic<u64> checksum = 0;
+  u64 perProducer = kRingBenchItemCount / producerCount;
+
+  u64 start = GetPerformanceCounter();
+  std::vector<Thread> threads;
+  for(uint i = 0; i < consumerCount; i++) {
+    threads.emplace_back("ring bench", [=, &popped, &checksum]() { ringBenchConsumer(*queue, popped, checksum, batchSize); });
+  }
+  for(uint i = 0; i < producerCount; i++) {
+    u64 count = i + 1 == producerCount ? kRingBenchItemCount - perProducer * i : perProducer;
+    threads.emplace_back("ring bench", [=]() { ringBenchProducer(*queue, perProducer * i, count, batchSize); });
+  }
+  for(Thread& thread: threads) thread.join();
+  double seconds = PerformanceCountToSecond(GetPerformanceCounter() - start);
+  delete queue;
+
+  bool valid = checksum.load() == kRingBenchItemCount * (kRingBenchItemCount - 1) / 2;
+  Log::logf("[ring_bench] %-6s %uP/%uC batch %2u: %s, %.2f Mops/s%s", name, producerCount, consumerCount, batchSize,
+            beautifySeconds(seconds).c_str(), double(kRingBenchItemCount) / seconds * 1e-6, valid ? "" : " CHECKSUM MISMATCH");
+}
+
+COMMAND_REG("ring_bench", "", "push 2M integers through the spsc, mpmc and mutex queues with 1 to 4 producers and consumers")(Command&) {
+  using Spsc = SpscRingBuffer<u64, kRingBenchCapacity>;
+  using Mpmc = MpmcRingBuffer<u64, kRingBenchCapacity>;
+
+  ringBenchRun<Spsc>("spsc", 1, 1, 1);
+  ringBenchRun<Spsc>("spsc", 1, 1, 32);
+  for(uint threadCount = 1; threadCount <= 4; threadCount *= 2) {
+    ringBenchRun<Mpmc>("mpmc", threadCount, threadCount, 1);
+    ringBenchRun<Mpmc>("mpmc", threadCount, threadCount, 32);
+    ringBenchRun<LockedQueue>("mutex", threadCount, threadCount, 1);
+    ringBenchRun<LockedQueue>("mutex", threadCount, threadCount, 32);
+  }
+  return true;
+}
@@ -1,35 +1,283 @@
 ﻿#pragma once
 #include "Engine/Core/common.hpp"
 #include "Engine/Debug/ErrorWarningAssert.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <thread>
 
+/**
+ * \brief fixed size ring buffer, single thread. N has to be power of 2.
+ */
+template<typename T, size_t N = 32>
 class RingBuffer {
+  static_assert(N != 0 && !(N & (N - 1)), "size of the ring buffer has to be power of 2");
 public:
 
   size_t size() const { return mWriteIndex - mReadIndex; }
   bool empty() const { return mReadIndex == mWriteIndex; }
   bool full() const { return size() == kBufferSize; }
 
-  size_t push(const float& val) {
+  size_t push(const T& val) {
     EXPECTS(!full());
     size_t writeIndex = mask(mWriteIndex++);
     mBuffer[writeIndex] = val; 
     return writeIndex;
   }
 
-  float pop() { EXPECTS(!empty()); return mBuffer[mask(mReadIndex++)]; }
+  T pop() { EXPECTS(!empty()); return std::move(mBuffer[mask(mReadIndex++)]); }
 
   const size_t offset() { return mReadIndex; }
-  const float& front() const { return mBuffer[mask(mReadIndex)]; }
+  const T& front() const { return mBuffer[mask(mReadIndex)]; }
 
   constexpr size_t capacity() const { return kBufferSize; }
-  static constexpr size_t kBufferSize = BIT_FLAG(5);
+  static constexpr size_t kBufferSize = N;
 
-  static_assert(!(kBufferSize&(kBufferSize - 1)), "size of the ring buffer has to be power of 2");
 protected:
 
   static constexpr size_t mask(size_t val) { return val & (kBufferSize - 1); }
-  std::array<float, kBufferSize> mBuffer{};
+  std::array<T, kBufferSize> mBuffer{};
   size_t mReadIndex = 1;
   size_t mWriteIndex = 1;
 
 };
+
+/**
+ * \brief bounded lock-free queue, one producer thread and one consumer thread.
+ *        Each side keeps its index on its own cache line with a cached copy of the other side's index,
+ *        so it only reads the shared line when the cached copy says full or empty.
+ *        Batched push and pop publish the whole batch with one store.
+ * \tparam T default constructible and move assignable; N has to be power of 2.
+ */
+template<typename T, size_t N>
+class SpscRingBuffer {
+  static_assert(N != 0 && !(N & (N - 1)), "size of the ring buffer has to be power of 2");
+public:
+  SpscRingBuffer() = default;
+  SpscRingBuffer(const SpscRingBuffer&) = delete;
+  SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+  // producer thread only
+  template<typename U>
+  bool tryPush(U&& val) {
+    size_t tail = mProducer.tail.load(std::memory_order_relaxed);
+    if(tail - mProducer.headCache >= N) {
+      mProducer.headCache = mConsumer.head.load(std::memory_order_acquire);
+      if(tail - mProducer.headCache >= N) return false;
+    }
+    mSlots[tail & (N - 1)] = std::forward<U>(val);
+    mProducer.tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // producer thread only, return how many of `count` values went in
+  size_t pushBatch(const T* values, size_t count) {
+    size_t tail = mProducer.tail.load(std::memory_order_relaxed);
+    if(tail - mProducer.headCache + count > N) {
+      mProducer.headCache = mConsumer.head.load(std::memory_order_acquire);
+    }
+    count = std::min(count, N - (tail - mProducer.headCache));
+    for(size_t i = 0; i < count; i++) {
+      mSlots[(tail + i) & (N - 1)] = values[i];
+    }
+    mProducer.tail.store(tail + count, std::memory_order_release);
+    return count;
+  }
+
+  // producer thread only, all of `count` values or none, eg. a record cut in several slots
+  bool tryPushAll(const T* values, size_t count) {
+    size_t tail = mProducer.tail.load(std::memory_order_relaxed);
+    if(tail - mProducer.headCache + count > N) {
+      mProducer.headCache = mConsumer.head.load(std::memory_order_acquire);
+      if(tail - mProducer.headCache + count > N) return false;
+    }
+    for(size_t i = 0; i < count; i++) {
+      mSlots[(tail + i) & (N - 1)] = values[i];
+    }
+    mProducer.tail.store(tail + count, std::memory_order_release);
+    return true;
+  }
+
+  // consumer thread only
+  bool tryPop(T& out) {
+    size_t head = mConsumer.head.load(std::memory_order_relaxed);
+    if(head == mConsumer.tailCache) {
+      mConsumer.tailCache = mProducer.tail.load(std::memory_order_acquire);
+      if(head == mConsumer.tailCache) return false;
+    }
+    out = std::move(mSlots[head & (N - 1)]);
+    mConsumer.head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer thread only, return how many values went to `out`, at most `maxCount`
+  size_t popBatch(T* out, size_t maxCount) {
+    size_t head = mConsumer.head.load(std::memory_order_relaxed);
+    if(mConsumer.tailCache - head < maxCount) {
+      mConsumer.tailCache = mProducer.tail.load(std::memory_order_acquire);
+    }
+    size_t count = std::min(maxCount, mConsumer.tailCache - head);
+    for(size_t i = 0; i < count; i++) {
+      out[i] = std::move(mSlots[(head + i) & (N - 1)]);
+    }
+    mConsumer.head.store(head + count, std::memory_order_release);
+    return count;
+  }
+
+  // approximate when called while the other side is running
+  size_t size() const {
+    return mProducer.tail.load(std::memory_order_acquire) - mConsumer.head.load(std::memory_order_acquire);
+  }
+  bool empty() const { return size() == 0; }
+  constexpr size_t capacity() const { return N; }
+
+protected:
+  struct alignas(64) producer_t {
+    std::atomic<size_t> tail = 0;
+    size_t headCache = 0;
+  };
+  struct alignas(64) consumer_t {
+    std::atomic<size_t> head = 0;
+    size_t tailCache = 0;
+  };
+
+  producer_t mProducer;
+  consumer_t mConsumer;
+  std::array<T, N> mSlots{};
+};
+
+/**
+ * \brief bounded lock-free queue, any number of producer and consumer threads.
+ *        Every slot carries a sequence number telling which lap of the ring it is ready for (Dmitry Vyukov's bounded MPMC queue):
+ *        a producer claims the tail with one CAS, writes, then bumps the slot sequence for the consumer of that lap, and the other way around.
+ *        A batch claims a run of slots with one CAS when the last slot of the run is ready; a slot before it
+ *        whose previous user claimed it but has not finished yet is waited on.
+ * \tparam T default constructible and move assignable; N has to be power of 2.
+ */
+template<typename T, size_t N>
+class MpmcRingBuffer {
+  static_assert(N >= 2 && !(N & (N - 1)), "size of the ring buffer has to be power of 2");
+public:
+  MpmcRingBuffer() {
+    for(size_t i = 0; i < N; i++) {
+      mSlots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+  MpmcRingBuffer(const MpmcRingBuffer&) = delete;
+  MpmcRingBuffer& operator=(const MpmcRingBuffer&) = delete;
+
+  template<typename U>
+  bool tryPush(U&& val) {
+    size_t pos = mTail.load(std::memory_order_relaxed);
+    slot_t* slot;
+    for(;;) {
+      slot = &mSlots[pos & (N - 1)];
+      size_t seq = slot->sequence.load(std::memory_order_acquire);
+      intptr_t diff = intptr_t(seq) - intptr_t(pos);
+      if(diff == 0) {
+        if(mTail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      } else if(diff < 0) {
+        return false; // the consumer of the previous lap has not taken the value yet
+      } else {
+        pos = mTail.load(std::memory_order_relaxed);
+      }
+    }
+    slot->value = std::forward<U>(val);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool tryPop(T& out) {
+    size_t pos = mHead.load(std::memory_order_relaxed);
+    slot_t* slot;
+    for(;;) {
+      slot = &mSlots[pos & (N - 1)];
+      size_t seq = slot->sequence.load(std::memory_order_acquire);
+      intptr_t diff = intptr_t(seq) - intptr_t(pos + 1);
+      if(diff == 0) {
+        if(mHead.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      } else if(diff < 0) {
+        return false;
+      } else {
+        pos = mHead.load(std::memory_order_relaxed);
+      }
+    }
+    out = std::move(slot->value);
+    slot->sequence.store(pos + N, std::memory_order_release);
+    return true;
+  }
+
+  size_t pushBatch(const T* values, size_t count) {
+    if(count == 0) return 0;
+    size_t pos = mTail.load(std::memory_order_relaxed);
+    size_t n;
+    for(;;) {
+      size_t seq = mSlots[pos & (N - 1)].sequence.load(std::memory_order_acquire);
+      intptr_t diff = intptr_t(seq) - intptr_t(pos);
+      if(diff < 0) return 0;
+      if(diff > 0) {
+        pos = mTail.load(std::memory_order_relaxed);
+        continue;
+      }
+      // the whole run is free for this lap once its last slot is, slots before it may still be finishing a pop
+      size_t head = mHead.load(std::memory_order_acquire);
+      n = std::min(count, N - std::min<size_t>(N - 1, pos - head));
+      if(n > 1 && mSlots[(pos + n - 1) & (N - 1)].sequence.load(std::memory_order_acquire) != pos + n - 1) n = 1;
+      if(mTail.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed)) break;
+    }
+
+    for(size_t i = 0; i < n; i++) {
+      slot_t& slot = mSlots[(pos + i) & (N - 1)];
+      while(slot.sequence.load(std::memory_order_acquire) != pos + i) std::this_thread::yield();
+      slot.value = values[i];
+      slot.sequence.store(pos + i + 1, std::memory_order_release);
+    }
+    return n;
+  }
+
+  size_t popBatch(T* out, size_t maxCount) {
+    if(maxCount == 0) return 0;
+    size_t pos = mHead.load(std::memory_order_relaxed);
+    size_t n;
+    for(;;) {
+      size_t seq = mSlots[pos & (N - 1)].sequence.load(std::memory_order_acquire);
+      intptr_t diff = intptr_t(seq) - intptr_t(pos + 1);
+      if(diff < 0) return 0;
+      if(diff > 0) {
+        pos = mHead.load(std::memory_order_relaxed);
+        continue;
+      }
+      size_t tail = mTail.load(std::memory_order_acquire);
+      n = std::min(maxCount, std::max<size_t>(1, tail - pos));
+      if(n > 1 && mSlots[(pos + n - 1) & (N - 1)].sequence.load(std::memory_order_acquire) != pos + n) n = 1;
+      if(mHead.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed)) break;
+    }
+
+    for(size_t i = 0; i < n; i++) {
+      slot_t& slot = mSlots[(pos + i) & (N - 1)];
+      while(slot.sequence.load(std::memory_order_acquire) != pos + i + 1) std::this_thread::yield();
+      out[i] = std::move(slot.value);
+      slot.sequence.store(pos + i + N, std::memory_order_release);
+    }
+    return n;
+  }
+
+  // approximate when called while other threads are running
+  size_t size() const {
+    size_t tail = mTail.load(std::memory_order_acquire);
+    size_t head = mHead.load(std::memory_order_acquire);
+    return tail > head ? tail - head : 0;
+  }
+  bool empty() const { return size() == 0; }
+  constexpr size_t capacity() const { return N; }
+
+protected:
+  struct slot_t {
+    std::atomic<size_t> sequence;
+    T value{};
+  };
+
+  alignas(64) std::atomic<size_t> mTail = 0;
+  alignas(64) std::atomic<size_t> mHead = 0;
+  alignas(64) std::array<slot_t, N> mSlots;
+};
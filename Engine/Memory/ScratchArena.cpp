@@ -0,0 +1,199 @@
+﻿#include "ScratchArena.hpp"
+#include "Engine/Debug/ErrorWarningAssert.hpp"
+#include "Engine/Debug/Log.hpp"
+#include "Engine/Debug/Console/Command.hpp"
+#include "Engine/Debug/Console/Console.hpp"
+#include "Engine/Core/Time/Time.hpp"
+#include "Engine/Memory/MemTrack.hpp"
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+static std::atomic<uint> gScratchFrame = 0;
+static std::mutex gScratchArenaLock;
+static std::vector<ScratchArena*> gScratchArenas;
+
+class ScratchResource: public std::pmr::memory_resource {
+protected:
+  void* do_allocate(size_t bytes, size_t alignment) override {
+    return ScratchArena::local().alloc(bytes, alignment);
+  }
+
+  void do_deallocate(void*, size_t, size_t) override {}
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+};
+
+static ScratchResource gScratchResource;
+
+ScratchArena::ScratchArena() {
+  mFrame = gScratchFrame.load(std::memory_order_relaxed);
+  std::scoped_lock lock(gScratchArenaLock);
+  gScratchArenas.push_back(this);
+}
+
+ScratchArena::~ScratchArena() {
+  {
+    std::scoped_lock lock(gScratchArenaLock);
+    gScratchArenas.erase(std::find(gScratchArenas.begin(), gScratchArenas.end(), this));
+  }
+
+  block_t* block = mFirst;
+  while(block != nullptr) {
+    block_t* next = block->next;
+    Mem::onFree(MEMTAG_TRANSIENT, sizeof(block_t) + block->capacity);
+    ::free(block);
+    block = next;
+  }
+}
+
+void* ScratchArena::alloc(size_t size, size_t alignment) {
+  EXPECTS((alignment & (alignment - 1)) == 0);
+
+  byte_t* ptr = (byte_t*)align_to(alignment, (uintptr_t)mCursor);
+  if(mCursor == nullptr || ptr + size > mEnd) {
+    ptr = (byte_t*)allocSlow(size, alignment);
+  }
+  mCursor = ptr + size;
+
+  mFrameBytes += size;
+  mFrameAllocCount++;
+  mAllocCount.store(mAllocCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  mAllocBytes.store(mAllocBytes.load(std::memory_order_relaxed) + size, std::memory_order_relaxed);
+  return ptr;
+}
+
+void ScratchArena::rewind(const marker_t& marker) {
+  if(marker.block == nullptr) {
+    reset();
+    return;
+  }
+  mCurrent = marker.block;
+  mCursor = marker.cursor;
+  mEnd = (byte_t*)(mCurrent + 1) + mCurrent->capacity;
+}
+
+void ScratchArena::reset() {
+  mCurrent = mFirst;
+  mCursor = mFirst == nullptr ? nullptr : (byte_t*)(mFirst + 1);
+  mEnd = mFirst == nullptr ? nullptr : mCursor + mFirst->capacity;
+}
+
+void* ScratchArena::allocSlow(size_t size, size_t alignment) {
+  // blocks kept from earlier frames come first, one too small for this allocation is skipped for the rest of the frame
+  block_t* next = mCurrent == nullptr ? mFirst : mCurrent->next;
+  while(next != nullptr && next->capacity < size + alignment) {
+    next = next->next;
+  }
+
+  if(next == nullptr) {
+    size_t capacity = std::max(kBlockSize - sizeof(block_t), size + alignment);
+    next = (block_t*)::malloc(sizeof(block_t) + capacity);
+    ENSURES(next != nullptr);
+    next->capacity = capacity;
+    if(mCurrent == nullptr) {
+      next->next = mFirst;
+      mFirst = next;
+    } else {
+      next->next = mCurrent->next;
+      mCurrent->next = next;
+    }
+    mHeapAllocCount.store(mHeapAllocCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    mReservedBytes.store(mReservedBytes.load(std::memory_order_relaxed) + sizeof(block_t) + capacity, std::memory_order_relaxed);
+    Mem::onAlloc(MEMTAG_TRANSIENT, sizeof(block_t) + capacity);
+  }
+
+  mCurrent = next;
+  mCursor = (byte_t*)(next + 1);
+  mEnd = mCursor + next->capacity;
+  return (byte_t*)align_to(alignment, (uintptr_t)mCursor);
+}
+
+void ScratchArena::beginFrame(uint frame) {
+  mLastFrameAllocCount.store(mFrameAllocCount, std::memory_order_relaxed);
+  mLastFrameBytes.store(mFrameBytes, std::memory_order_relaxed);
+  if(mFrameBytes > mPeakFrameBytes.load(std::memory_order_relaxed)) {
+    mPeakFrameBytes.store(mFrameBytes, std::memory_order_relaxed);
+  }
+  mFrameBytes = 0;
+  mFrameAllocCount = 0;
+  mFrame = frame;
+  reset();
+}
+
+ScratchArena& ScratchArena::local() {
+  static thread_local ScratchArena sArena;
+  return sArena;
+}
+
+void ScratchArena::markFrame() {
+  gScratchFrame.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ScratchArena::safePoint() {
+  ScratchArena& arena = local();
+  uint frame = gScratchFrame.load(std::memory_order_relaxed);
+  if(frame != arena.mFrame) arena.beginFrame(frame);
+}
+
+std::pmr::memory_resource* ScratchArena::resource() {
+  return &gScratchResource;
+}
+
+ScratchArena::stats_t ScratchArena::stats() {
+  stats_t stats;
+  std::scoped_lock lock(gScratchArenaLock);
+  for(ScratchArena* arena: gScratchArenas) {
+    stats.arenaCount++;
+    stats.allocCount += arena->mAllocCount.load(std::memory_order_relaxed);
+    stats.allocBytes += arena->mAllocBytes.load(std::memory_order_relaxed);
+    stats.heapAllocCount += arena->mHeapAllocCount.load(std::memory_order_relaxed);
+    stats.reservedBytes += arena->mReservedBytes.load(std::memory_order_relaxed);
+    stats.lastFrameAllocCount += arena->mLastFrameAllocCount.load(std::memory_order_relaxed);
+    stats.lastFrameBytes += arena->mLastFrameBytes.load(std::memory_order_relaxed);
+    stats.peakFrameBytes = std::max(stats.peakFrameBytes, arena->mPeakFrameBytes.load(std::memory_order_relaxed));
+  }
+  return stats;
+}
+
+COMMAND_REG("scratch_stats", "", "print scratch arena allocation counters of every thread")(Command&) {
+  ScratchArena::stats_t stats = ScratchArena::stats();
+  Log::logf("[scratch] arenas: %u, reserved: %.1f KB in %llu heap allocations",
+            stats.arenaCount, double(stats.reservedBytes) / 1024.0, stats.heapAllocCount);
+  Log::logf("[scratch] last frame: %llu allocations, %.1f KB; since startup: %llu allocations, %.1f KB; peak frame of one thread: %.1f KB",
+            stats.lastFrameAllocCount, double(stats.lastFrameBytes) / 1024.0,
+            stats.allocCount, double(stats.allocBytes) / 1024.0, double(stats.peakFrameBytes) / 1024.0);
+  return true;
+}
+
+// benchmark: a job-like workload building small temporary vectors, global heap vs thread scratch arena
+
+COMMAND_REG("scratch_bench", "", "build 100k temporary vectors through the heap and through the scratch arena")(Command&) {
+  constexpr uint kRound = 100000;
+  u64 checksum = 0;
+
+  u64 start = GetPerformanceCounter();
+  for(uint i = 0; i < kRound; i++) {
+    std::vector<uint> values;
+    for(uint k = 0; k < 64 + i % 64; k++) values.push_back(k ^ i);
+    checksum += values.back();
+  }
+  double heap = PerformanceCountToSecond(GetPerformanceCounter() - start);
+
+  u64 heapAllocBefore = ScratchArena::stats().heapAllocCount;
+  start = GetPerformanceCounter();
+  for(uint i = 0; i < kRound; i++) {
+    ScratchScope scope;
+    std::pmr::vector<uint> values(ScratchArena::resource());
+    for(uint k = 0; k < 64 + i % 64; k++) values.push_back(k ^ i);
+    checksum += values.back();
+  }
+  double scratch = PerformanceCountToSecond(GetPerformanceCounter() - start);
+
+  Log::logf("[scratch_bench] heap: %s, scratch: %s (x%.2f), arena heap allocations: %llu, checksum: %llu",
+            beautifySeconds(heap).c_str(), beautifySeconds(scratch).c_str(), heap / scratch,
+            ScratchArena::stats().heapAllocCount - heapAllocBefore, checksum);
+  return true;
+}
@@ -0,0 +1,102 @@
+﻿#pragma once
+#include "Engine/Core/common.hpp"
+#include <atomic>
+#include <memory_resource>
+
+/*
+ * linear scratch memory of one thread. Allocation is a pointer bump, nothing is freed one by one:
+ * the whole arena rewinds at the first safe point of its thread after a frame boundary, a point where nothing
+ * allocated from it can still be in use: the main loop right after the frame boundary, a job worker between two jobs
+ * when no job is parked on it. A job running across a frame boundary keeps its memory until it is done.
+ * Do not keep memory across a frame, and do not hand it to a job of another thread which could still be running
+ * in the next frame. A thread which never reaches a safe point never rewinds, give back its memory with ScratchScope.
+ *   std::pmr::vector<RenderTask> tasks(ScratchArena::resource());
+ *   Mesher ms(ScratchArena::resource());
+ *   int* ids = ScratchArena::local().alloc<int>(count);
+ */
+class ScratchArena {
+public:
+  static constexpr size_t kBlockSize = 256 KB;
+
+  struct block_t {
+    block_t* next;
+    size_t capacity; // usable bytes after the header
+  };
+
+  struct marker_t {
+    block_t* block = nullptr;
+    byte_t* cursor = nullptr;
+  };
+
+  struct stats_t {
+    uint arenaCount = 0;
+    u64 allocCount = 0;        // since startup
+    u64 allocBytes = 0;
+    u64 heapAllocCount = 0;    // blocks the arenas took from the heap
+    size_t reservedBytes = 0;  // blocks alive right now
+    u64 lastFrameAllocCount = 0;
+    u64 lastFrameBytes = 0;
+    u64 peakFrameBytes = 0;    // most bytes one arena handed out within a frame
+  };
+
+  ScratchArena();
+  ~ScratchArena();
+  ScratchArena(const ScratchArena&) = delete;
+  ScratchArena& operator=(const ScratchArena&) = delete;
+
+  void* alloc(size_t size, size_t alignment = alignof(std::max_align_t));
+  template<typename T>
+  T* alloc(size_t count = 1) { return (T*)alloc(sizeof(T) * count, alignof(T)); }
+
+  // `rewind` drops everything allocated after `mark`, see ScratchScope
+  marker_t mark() const { return { mCurrent, mCursor }; }
+  void rewind(const marker_t& marker);
+  void reset();
+
+  // the arena of the calling thread
+  static ScratchArena& local();
+  // frame boundary, every arena rewinds at the next safe point of its thread
+  static void markFrame();
+  // nothing the calling thread allocated from its arena is in use: rewind if a frame boundary went by since the last time
+  static void safePoint();
+  // std::pmr adapter allocating from the arena of the thread which allocates, deallocation does nothing
+  static std::pmr::memory_resource* resource();
+  static stats_t stats();
+
+protected:
+  void* allocSlow(size_t size, size_t alignment);
+  void beginFrame(uint frame);
+
+  block_t* mFirst = nullptr;
+  block_t* mCurrent = nullptr;
+  byte_t* mCursor = nullptr;
+  byte_t* mEnd = nullptr;
+  uint mFrame = 0;
+  u64 mFrameBytes = 0;
+  u64 mFrameAllocCount = 0;
+
+  // written by the owner thread only, read by stats()
+  std::atomic<u64> mAllocCount = 0;
+  std::atomic<u64> mAllocBytes = 0;
+  std::atomic<u64> mHeapAllocCount = 0;
+  std::atomic<size_t> mReservedBytes = 0;
+  std::atomic<u64> mLastFrameAllocCount = 0;
+  std::atomic<u64> mLastFrameBytes = 0;
+  std::atomic<u64> mPeakFrameBytes = 0;
+};
+
+/*
+ * gives back everything allocated from the thread arena within the scope, eg. inside a job.
+ * Only for code which does not wait on other jobs inside the scope: a waiting job lets others run on the same thread.
+ */
+class ScratchScope {
+public:
+  ScratchScope(): mArena(ScratchArena::local()), mMarker(mArena.mark()) {}
+  ~ScratchScope() { mArena.rewind(mMarker); }
+  ScratchScope(const ScratchScope&) = delete;
+  ScratchScope& operator=(const ScratchScope&) = delete;
+
+protected:
+  ScratchArena& mArena;
+  ScratchArena::marker_t mMarker;
+};
@@ -0,0 +1,163 @@
+﻿#include "VirtualArena.hpp"
+#include "Engine/Debug/Log.hpp"
+#include "Engine/Debug/Console/Command.hpp"
+#include "Engine/Debug/Console/Console.hpp"
+#include "Engine/Core/Time/Time.hpp"
+#include <algorithm>
+#include <vector>
+
+#define WIN32_LEAN_AND_MEAN		// Always #define this before #including <windows.h>
+#include <windows.h>
+
+// large pages need SeLockMemoryPrivilege in the process token, granted to the user by policy; asked for once
+static size_t largePageSize() {
+  static size_t sLargePageSize = []() -> size_t {
+    size_t size = ::GetLargePageMinimum();
+    if(size == 0) return 0;
+
+    HANDLE token = nullptr;
+    if(!::OpenProcessToken(::GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) return 0;
+
+    TOKEN_PRIVILEGES privileges = {};
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    bool granted = ::LookupPrivilegeValueA(nullptr, "SeLockMemoryPrivilege", &privileges.Privileges[0].Luid)
+                && ::AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr)
+                && ::GetLastError() == ERROR_SUCCESS;
+    ::CloseHandle(token);
+
+    if(!granted) {
+      Log::warnf("[vmem] no lock memory privilege, large page arenas use regular pages");
+      return 0;
+    }
+    return size;
+  }();
+  return sLargePageSize;
+}
+
+VirtualArena::VirtualArena(size_t reserveSize, eMemTag tag, bool largePages)
+  : mTag(tag) {
+  EXPECTS(reserveSize > 0);
+
+  size_t pageSize = largePages ? largePageSize() : 0;
+  if(pageSize != 0) {
+    size_t size = align_to(pageSize, reserveSize);
+    mBase = (byte_t*)::VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+    if(mBase != nullptr) {
+      mReserved = size;
+      mCommitted = size;
+      mLargePages = true;
+      Mem::onAlloc(mTag, mCommitted);
+      return;
+    }
+    // physical memory too fragmented for contiguous large pages
+    Log::warnf("[vmem] large page allocation of %.1f KB failed, falling back to regular pages", double(size) / 1024.0);
+  }
+
+  mReserved = align_to(kCommitGranularity, reserveSize);
+  mBase = (byte_t*)::VirtualAlloc(nullptr, mReserved, MEM_RESERVE, PAGE_NOACCESS);
+  ENSURES(mBase != nullptr);
+}
+
+VirtualArena::~VirtualArena() {
+  release();
+}
+
+VirtualArena::VirtualArena(VirtualArena&& other) noexcept
+  : mBase(other.mBase)
+  , mUsed(other.mUsed)
+  , mCommitted(other.mCommitted)
+  , mReserved(other.mReserved)
+  , mTag(other.mTag)
+  , mLargePages(other.mLargePages) {
+  other.mBase = nullptr;
+  other.mUsed = other.mCommitted = other.mReserved = 0;
+}
+
+VirtualArena& VirtualArena::operator=(VirtualArena&& other) noexcept {
+  if(this == &other) return *this;
+  release();
+  mBase = other.mBase;
+  mUsed = other.mUsed;
+  mCommitted = other.mCommitted;
+  mReserved = other.mReserved;
+  mTag = other.mTag;
+  mLargePages = other.mLargePages;
+  other.mBase = nullptr;
+  other.mUsed = other.mCommitted = other.mReserved = 0;
+  return *this;
+}
+
+void* VirtualArena::alloc(size_t size, size_t alignment) {
+  EXPECTS((alignment & (alignment - 1)) == 0);
+
+  size_t offset = align_to(alignment, (uintptr_t)mBase + mUsed) - (uintptr_t)mBase;
+  if(offset + size > mCommitted && !commit(offset + size)) return nullptr;
+  mUsed = offset + size;
+  return mBase + offset;
+}
+
+bool VirtualArena::commit(size_t size) {
+  if(size <= mCommitted) return true;
+  if(size > mReserved) return false;
+
+  // commit ahead by a quarter of what is committed already, so a steadily growing buffer commits O(log n) times
+  size_t target = std::max(size, mCommitted + mCommitted / 4);
+  target = std::min(align_to(kCommitGranularity, target), mReserved);
+  void* pages = ::VirtualAlloc(mBase + mCommitted, target - mCommitted, MEM_COMMIT, PAGE_READWRITE);
+  if(pages == nullptr) return false;
+
+  Mem::onAlloc(mTag, target - mCommitted);
+  mCommitted = target;
+  return true;
+}
+
+void VirtualArena::rewind(size_t used) {
+  EXPECTS(used <= mUsed);
+  mUsed = used;
+}
+
+void VirtualArena::reset(bool decommit) {
+  mUsed = 0;
+  if(!decommit || mLargePages || mCommitted == 0) return;
+
+  ::VirtualFree(mBase, mCommitted, MEM_DECOMMIT);
+  Mem::onFree(mTag, mCommitted);
+  mCommitted = 0;
+}
+
+void VirtualArena::release() {
+  if(mBase == nullptr) return;
+  ::VirtualFree(mBase, 0, MEM_RELEASE);
+  Mem::onFree(mTag, mCommitted);
+  mBase = nullptr;
+  mUsed = mCommitted = mReserved = 0;
+}
+
+// benchmark: a buffer growing to 64 MB one element at a time, std::vector vs VirtualArray
+
+COMMAND_REG("vmem_bench", "", "grow a 64 MB buffer through std::vector and through a VirtualArray")(Command&) {
+  struct element_t { u64 values[4]; };
+  constexpr size_t kCount = 64 * 1024 KB / sizeof(element_t);
+  u64 checksum = 0;
+
+  u64 start = GetPerformanceCounter();
+  {
+    std::vector<element_t> elements;
+    for(size_t i = 0; i < kCount; i++) elements.push_back({ i, i, i, i });
+    checksum += elements.back().values[0];
+  }
+  double vector = PerformanceCountToSecond(GetPerformanceCounter() - start);
+
+  start = GetPerformanceCounter();
+  {
+    VirtualArray<element_t> elements(kCount);
+    for(size_t i = 0; i < kCount; i++) elements.push_back({ i, i, i, i });
+    checksum += elements.back().values[0];
+  }
+  double virtualArray = PerformanceCountToSecond(GetPerformanceCounter() - start);
+
+  Log::logf("[vmem_bench] std::vector: %s, VirtualArray: %s (x%.2f), checksum: %llu",
+            beautifySeconds(vector).c_str(), beautifySeconds(virtualArray).c_str(), vector / virtualArray, checksum);
+  return true;
+}
@@ -0,0 +1,158 @@
+﻿#pragma once
+#include "Engine/Core/common.hpp"
+#include "Engine/Debug/ErrorWarningAssert.hpp"
+#include "Engine/Memory/MemTrack.hpp"
+#include <new>
+#include <utility>
+
+/*
+ * reserves a range of address space up front and commits pages only as the used part grows.
+ * Memory never moves: pointers into the arena stay valid until it is reset or destroyed, and growing needs no copy.
+ * Only committed pages count against the memory tag, reserving costs address space only.
+ * In large page mode the whole range is committed at once, Windows cannot commit large pages on demand;
+ * without the lock memory privilege it falls back to regular pages.
+ *   VirtualArena arena(256 * 1024 KB, MEMTAG_MESH);
+ *   BVH::Prim* prims = arena.alloc<BVH::Prim>(count);
+ */
+class VirtualArena {
+public:
+  static constexpr size_t kCommitGranularity = 64 KB;
+
+  VirtualArena() = default;
+  explicit VirtualArena(size_t reserveSize, eMemTag tag = MEMTAG_UNTAGGED, bool largePages = false);
+  ~VirtualArena();
+  VirtualArena(VirtualArena&& other) noexcept;
+  VirtualArena& operator=(VirtualArena&& other) noexcept;
+  VirtualArena(const VirtualArena&) = delete;
+  VirtualArena& operator=(const VirtualArena&) = delete;
+
+  // nullptr once the reservation is used up
+  void* alloc(size_t size, size_t alignment = alignof(std::max_align_t));
+  template<typename T>
+  T* alloc(size_t count = 1) { return (T*)alloc(sizeof(T) * count, alignof(T)); }
+
+  // makes sure the first `size` bytes of the range are committed, false if it is beyond the reservation
+  bool commit(size_t size);
+  // drops everything allocated after the first `used` bytes
+  void rewind(size_t used);
+  // `decommit` hands the pages back to the system, the range stays reserved
+  void reset(bool decommit = false);
+
+  byte_t* base() const { return mBase; }
+  size_t used() const { return mUsed; }
+  size_t committed() const { return mCommitted; }
+  size_t reserved() const { return mReserved; }
+  bool largePages() const { return mLargePages; }
+  bool valid() const { return mBase != nullptr; }
+
+protected:
+  void release();
+
+  byte_t* mBase = nullptr;
+  size_t mUsed = 0;
+  size_t mCommitted = 0;
+  size_t mReserved = 0;
+  eMemTag mTag = MEMTAG_UNTAGGED;
+  bool mLargePages = false;
+};
+
+/*
+ * array growing in place inside a VirtualArena, up to the element count it is created with.
+ * Elements never move, so pointers to them stay valid while the array grows. Not thread safe.
+ *   VirtualArray<BVH::Node> nodes(maxNodeCount, MEMTAG_MESH);
+ *   BVH::Node& root = nodes.emplace_back();
+ */
+template<typename T>
+class VirtualArray {
+public:
+  using value_type = T;
+  using pointer = T*;
+  using const_pointer = const T*;
+  using iterator = T*;
+  using const_iterator = const T*;
+
+  VirtualArray() = default;
+  explicit VirtualArray(size_t maxCount, eMemTag tag = MEMTAG_UNTAGGED, bool largePages = false)
+    : mArena(maxCount * sizeof(T), tag, largePages), mMaxCount(maxCount) {}
+  ~VirtualArray() { clear(); }
+
+  VirtualArray(VirtualArray&& other) noexcept
+    : mArena(std::move(other.mArena)), mCount(other.mCount), mMaxCount(other.mMaxCount) {
+    other.mCount = 0;
+    other.mMaxCount = 0;
+  }
+
+  VirtualArray& operator=(VirtualArray&& other) noexcept {
+    if(this == &other) return *this;
+    clear();
+    mArena = std::move(other.mArena);
+    mCount = other.mCount;
+    mMaxCount = other.mMaxCount;
+    other.mCount = 0;
+    other.mMaxCount = 0;
+    return *this;
+  }
+
+  VirtualArray(const VirtualArray&) = delete;
+  VirtualArray& operator=(const VirtualArray&) = delete;
+
+  template<typename ...Args>
+  T& emplace_back(Args&& ...args) {
+    if((mCount + 1) * sizeof(T) > mArena.committed()) grow(mCount + 1);
+    T* element = new (data() + mCount) T(std::forward<Args>(args)...);
+    mCount++;
+    return *element;
+  }
+
+  void push_back(const T& value) { emplace_back(value); }
+  void push_back(T&& value) { emplace_back(std::move(value)); }
+
+  void pop_back() {
+    EXPECTS(mCount > 0);
+    mCount--;
+    data()[mCount].~T();
+  }
+
+  void resize(size_t count) {
+    while(mCount > count) pop_back();
+    reserve(count);
+    while(mCount < count) emplace_back();
+  }
+
+  // commits the pages for `count` elements, the elements stay where they are
+  void reserve(size_t count) {
+    if(count * sizeof(T) > mArena.committed()) grow(count);
+  }
+
+  void clear() {
+    while(mCount > 0) pop_back();
+  }
+
+  T* data() { return (T*)mArena.base(); }
+  const T* data() const { return (const T*)mArena.base(); }
+  size_t size() const { return mCount; }
+  // the most elements the array can ever hold
+  size_t capacity() const { return mMaxCount; }
+  bool empty() const { return mCount == 0; }
+
+  T& operator[](size_t index) { return data()[index]; }
+  const T& operator[](size_t index) const { return data()[index]; }
+  T& back() { EXPECTS(mCount > 0); return data()[mCount - 1]; }
+  const T& back() const { EXPECTS(mCount > 0); return data()[mCount - 1]; }
+
+  T* begin() { return data(); }
+  T* end() { return data() + mCount; }
+  const T* begin() const { return data(); }
+  const T* end() const { return data() + mCount; }
+
+protected:
+  void grow(size_t count) {
+    if(count > mMaxCount || !mArena.commit(count * sizeof(T))) {
+      ERROR_AND_DIE("VirtualArray grows beyond the element count it reserved");
+    }
+  }
+
+  VirtualArena mArena;
+  size_t mCount = 0;
+  size_t mMaxCount = 0;
+};
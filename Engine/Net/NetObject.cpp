@@ -2,6 +2,7 @@
 #include "Engine/Debug/ErrorWarningAssert.hpp"
 #include "Engine/Net/UDPSession.hpp"
 #include "Engine/Debug/Log.hpp"
+#include "Engine/Debug/Profile/Profiler.hpp"
 
 void NetObject::ViewCollection::add(View&& view) {
   for(View& v: mViews) {
@@ -186,6 +187,7 @@ NetObject* NetObjectManager::createObject(net_object_type_t type, net_object_loc
 
   mObjectIdLookup[obj->id] = obj;
   mObjectPtrLookup[obj->ptr] = obj;
+  PROF_GAUGE("net objects", mObjectIdLookup.size());
 
   auto objType = this->type(type);
   obj->mLatestsnapshot.size = (uint16_t)objType->snapshotSize();
@@ -199,6 +201,7 @@ bool NetObjectManager::destoryObject(NetObject* obj) {
   if(obj == nullptr) return false;
   mObjectIdLookup.erase(obj->id);
   mObjectPtrLookup.erase(obj->ptr);
+  PROF_GAUGE("net objects", mObjectIdLookup.size());
 
   Log::logf("net object with id %u destroyed", obj->id);
   free(obj->mLatestsnapshot.data);
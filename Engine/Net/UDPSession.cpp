@@ -5,6 +5,8 @@
 #include "Engine/Net/NetMessage.hpp"
 #include "Engine/Debug/Log.hpp"
 #include "Engine/Net/NetPacket.hpp"
+#include "Engine/Memory/Allocator.hpp"
+#include "Engine/Memory/FrameAllocator.hpp"
 #include "Engine/Renderer/Font.hpp"
 #include "Engine/Graphics/Model/Mesher.hpp"
 #include "Engine/Graphics/Model/Mesh.hpp"
@@ -227,6 +229,7 @@ bool UDPSession::in() {
 
     if(!verify(*packet)) {
       Log::tagf("net", "Received invalid traffic from %s", addr.toString());
+      freePacket(packet);
       return false;
     }
 
@@ -420,7 +423,7 @@ void UDPSession::renderUI() const {
 
   auto font = Font::Default();
 
-  Mesher ms;
+  Mesher ms(FrameAllocator::resource());
   constexpr float LINE_PADDING = 10.f;
   aabb2 bound = Window::Get()->bounds();
 
@@ -486,7 +489,7 @@ void UDPSession::renderUI() const {
   // renderer.setTexture(font->texture());
   // renderer.drawMesh(*mesh);
 
-  delete mesh;
+  Mesher::destroyMesh<vertex_pcu_t>(mesh);
 }
 
 eSessionError UDPSession::err() {
@@ -598,12 +601,19 @@ void UDPSession::processPackets() {
   }
 }
 
+static SlabAllocator& packetAllocator() {
+  // never destroyed, like SlabAllocator::global()
+  static SlabAllocator* sAllocator = new SlabAllocator(MEMTAG_NET);
+  return *sAllocator;
+}
+
 NetPacket* UDPSession::allocPacket() {
-  return new NetPacket();
+  return packetAllocator().create<NetPacket>();
 }
 
 void UDPSession::freePacket(NetPacket*& packet) {
-  SAFE_DELETE(packet);
+  packetAllocator().destroy(packet);
+  packet = nullptr;
 }
 
 void UDPSession::registerCoreMessage() {
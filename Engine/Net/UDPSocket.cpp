@@ -6,6 +6,7 @@
 #include "UDPSocket.hpp"
 #include "Engine/Debug/ErrorWarningAssert.hpp"
 #include "Engine/Debug/Log.hpp"
+#include "Engine/Debug/Profile/Profiler.hpp"
 
 bool UDPSocket::bind(const NetAddress& addr, uint16_t portRange) {
   ASSERT_OR_RETURN(!opened(), false);
@@ -46,6 +47,8 @@ size_t UDPSocket::send(const NetAddress& addr, const void* data, size_t byteCoun
   int sent = ::sendto(sock, (const char*)data, (int)byteCount, 0, (sockaddr*)&storage, len);
 
   if(sent > 0) {
+    PROF_COUNTER("udp packets sent", 1);
+    PROF_COUNTER("udp bytes sent", sent);
     if(sent < byteCount) {
       Log::tagf("net", "the sent size is smaller than the actual size");
     }
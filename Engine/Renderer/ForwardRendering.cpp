@@ -12,6 +12,7 @@
 #include "Engine/Renderer/glFunctions.hpp"
 #include "Engine/Renderer/AfterEffect/BloomEffect.hpp"
 #include "Engine/Renderer/AfterEffect/FogEffect.hpp"
+#include "Engine/Memory/ScratchArena.hpp"
 #include "Engine/Debug/Profile/Profiler.hpp"
 
 ForwardRendering::ForwardRendering(Renderer* renderer): mRenderer(renderer) {
@@ -36,8 +37,7 @@ void ForwardRendering::render(RenderScene& scene) {
  */
 void ForwardRendering::renderView(RenderScene& scene, Camera& cam) {
   PROF_FUNC();
-  std::vector<RenderTask> tasks;
-  tasks.clear();
+  std::pmr::vector<RenderTask> tasks(ScratchArena::resource());
   mRenderer->setCamera(&cam);
 
   TODO("replace with sky box or something")
@@ -165,6 +165,7 @@ void ForwardRendering::pass(RenderScene& scene, span<RenderTask> tasks, Camera&
       {
         PROF_SCOPE("ForwardRendering::pass::draw mesh");
         mRenderer->drawMesh(*task.mesh);
+        PROF_COUNTER("draw calls", 1);
       }
     }
   }
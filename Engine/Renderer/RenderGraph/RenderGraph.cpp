@@ -4,6 +4,7 @@
 #include "Engine/Renderer/RenderGraph/RenderNode.hpp"
 #include <stack>
 #include "Engine/Graphics/RHI/RHIDevice.hpp"
+#include "Engine/Memory/ScratchArena.hpp"
 
 class FunctionalRenderPass: public RenderPass {
 
@@ -60,7 +61,7 @@ void RenderGraph::connect(RenderNode& fromNode, std::string_view fromRes, Render
   mResourceSet.bind(to->name, from->name);
 }
 
-void RenderGraph::topologySortVisitor(std::vector<RenderNode*>& sortedNodes, RenderNode* node) const {
+void RenderGraph::topologySortVisitor(std::pmr::vector<RenderNode*>& sortedNodes, RenderNode* node) const {
   if(node->mVisited) return;
   node->mVisited = true;
   for(auto n: node->mInComingNodes) {
@@ -76,7 +77,7 @@ bool RenderGraph::execute() {
   for(auto& [_, node]: mDefinedNodes) {
     node->mVisited = false;
   }
-  std::vector<RenderNode*> sortedNodes;
+  std::pmr::vector<RenderNode*> sortedNodes(ScratchArena::resource());
   topologySortVisitor(sortedNodes, mOutputNode);
 
 
@@ -5,6 +5,7 @@
 #include <map>
 #include <functional>
 #include <unordered_set>
+#include <memory_resource>
 #include "Engine/Renderer/RenderGraph/RenderEdge.hpp"
 #include "Engine/Renderer/RenderGraph/RenderGraphResourceSet.hpp"
 
@@ -121,5 +122,5 @@ protected:
   RenderGraphResourceSet mResourceSet;
 
 private:
-  void topologySortVisitor(std::vector<RenderNode*>& sortedNodes, RenderNode* node) const;
+  void topologySortVisitor(std::pmr::vector<RenderNode*>& sortedNodes, RenderNode* node) const;
 };